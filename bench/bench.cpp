@@ -0,0 +1,1566 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Micro-benchmarks for the per-hop analysis and serialization paths.
+//
+// Prints one CSV line per benchmark and size:
+//
+//   benchmark,size,iterations,ns_per_hop
+//
+// so that runs from different releases can be diffed or plotted.  Run as
+// "firemix-audio-bench [min_ms]"; each benchmark runs for at least min_ms
+// (default 200) after a warm-up pass.  It exits with an error, before timing
+// anything, if the spectrum binner disagrees with the legacy bucket tables,
+// if a compact spectrum encoding doesn't round-trip within its quantization
+// step, if handing a frame from an analyzer to the sender allocates
+// memory, if the band envelope followers, chroma or mel bands put a tone in
+// the wrong band, or if the tempo tracker gets a drum loop's tempo or beat
+// times wrong.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QTemporaryFile>
+
+#include "analyzer.h"
+#include "file_source.h"
+#include "sliding_window.h"
+#include "spectrum.h"
+#include "onset_detector.h"
+#include "pitch_detector.h"
+#include "frame_queue.h"
+#include "spectrum_codec.h"
+#include "spectrum_gate.h"
+#include "envelope_follower.h"
+#include "tempo_tracker.h"
+#include "load_budget.h"
+#include "frame_kernels.h"
+#include "networking.h"
+#include "byte_order.h"
+
+#define SAMPLERATE 48000
+
+static const unsigned int fft_sizes[] = { 256, 512, 1024, 2048, 4096 };
+static const int num_fft_sizes = sizeof(fft_sizes) / sizeof(fft_sizes[0]);
+
+static qint64 min_ns = 200 * 1000000LL;
+
+
+// Counts heap allocations while enabled.  glibc lets the program interpose
+// malloc (which operator new uses too) and still reach the real allocator.
+static bool count_allocations = false;
+static volatile int allocations = 0;
+
+#ifdef __GLIBC__
+extern "C" void *__libc_malloc(size_t size);
+
+extern "C" void *malloc(size_t size)
+{
+    if (count_allocations) {
+        allocations++;
+    }
+    return __libc_malloc(size);
+}
+#endif
+
+
+class Benchmark
+{
+public:
+    virtual ~Benchmark() {}
+    virtual void run(void) = 0;
+};
+
+
+// Prints and returns the average time per call
+static double report(const char *name, unsigned int size, Benchmark& b)
+{
+    QElapsedTimer timer;
+    qint64 iterations = 0;
+
+    // Warm up caches and any lazily initialized state
+    for (int i = 0; i < 16; i++) {
+        b.run();
+    }
+
+    timer.start();
+    do {
+        for (int i = 0; i < 64; i++) {
+            b.run();
+        }
+        iterations += 64;
+    } while (timer.nsecsElapsed() < min_ns);
+
+    double ns = (double)timer.nsecsElapsed() / iterations;
+    printf("%s,%u,%lld,%.1f\n", name, size, iterations, ns);
+    fflush(stdout);
+    return ns;
+}
+
+
+// A test signal with some harmonic content and a little noise
+static void fill_signal(fvec_t *v)
+{
+    for (unsigned int i = 0; i < v->length; i++) {
+        v->data[i] = 0.5 * sin(2 * M_PI * 220.0 * i / SAMPLERATE)
+                   + 0.25 * sin(2 * M_PI * 1320.0 * i / SAMPLERATE)
+                   + 0.05 * (rand() / (float)RAND_MAX - 0.5);
+    }
+}
+
+
+class FftBenchmark : public Benchmark
+{
+public:
+    FftBenchmark(unsigned int size)
+    {
+        _fft = new_aubio_fft(size);
+        _in = new_fvec(size);
+        _grain = new_cvec(size);
+        fill_signal(_in);
+    }
+    ~FftBenchmark()
+    {
+        del_aubio_fft(_fft);
+        del_fvec(_in);
+        del_cvec(_grain);
+    }
+    void run(void) { aubio_fft_do(_fft, _in, _grain); }
+    cvec_t *grain(void) { return _grain; }
+
+private:
+    aubio_fft_t *_fft;
+    fvec_t *_in;
+    cvec_t *_grain;
+};
+
+
+// Windowing one frame, with the kernel specialized for its size or the
+// generic one
+class WindowBenchmark : public Benchmark
+{
+public:
+    WindowBenchmark(unsigned int size, bool generic) : _size(size)
+    {
+        static const WindowKernel kernels[NUM_KERNEL_SIZES] = KERNEL_TABLE(window_kernel);
+        char window_type[] = "hanningz";
+        _kernel = kernels[generic ? 0 : Kernels::index(size)];
+        _in = new_fvec(size);
+        _window = new_aubio_window(window_type, size);
+        _out = new_fvec(size);
+        fill_signal(_in);
+    }
+    ~WindowBenchmark()
+    {
+        del_fvec(_in);
+        del_fvec(_window);
+        del_fvec(_out);
+    }
+    void run(void) { _kernel(_in->data, _window->data, _out->data, _size); }
+
+private:
+    typedef void (*WindowKernel)(const sample_t *, const smpl_t *, smpl_t *, unsigned int);
+
+    WindowKernel _kernel;
+    unsigned int _size;
+    fvec_t *_in;
+    fvec_t *_window;
+    fvec_t *_out;
+};
+
+
+// The level of one hop, as the onset detector's silence gate needs it
+class LevelBenchmark : public Benchmark
+{
+public:
+    LevelBenchmark(unsigned int size, bool generic) : _size(size)
+    {
+        static const LevelKernel kernels[NUM_KERNEL_SIZES] = KERNEL_TABLE(level_kernel);
+        _kernel = kernels[generic ? 0 : Kernels::index(size)];
+        _in = new_fvec(size);
+        fill_signal(_in);
+    }
+    ~LevelBenchmark() { del_fvec(_in); }
+    void run(void) { _sink = _kernel(_in->data, _size); }
+
+private:
+    typedef smpl_t (*LevelKernel)(const sample_t *, unsigned int);
+
+    LevelKernel _kernel;
+    unsigned int _size;
+    fvec_t *_in;
+    volatile smpl_t _sink;
+};
+
+
+class LegacySpectrumBenchmark : public Benchmark
+{
+public:
+    LegacySpectrumBenchmark(const smpl_t *norm) : _norm(norm) {}
+    void run(void) { legacy_log_spectrum(_norm, _out); }
+
+private:
+    const smpl_t *_norm;
+    float _out[LOG_SPECTRUM_SIZE];
+};
+
+
+class BinnerBenchmark : public Benchmark
+{
+public:
+    BinnerBenchmark(const SpectrumBinner& binner, const smpl_t *norm)
+        : _binner(binner), _norm(norm)
+    {
+        _out = new float[binner.bands()];
+    }
+    ~BinnerBenchmark() { delete[] _out; }
+    void run(void) { _binner.apply(_norm, _out); }
+
+private:
+    const SpectrumBinner& _binner;
+    const smpl_t *_norm;
+    float *_out;
+};
+
+
+// Runs a chain over samples pushed period frames at a time, as the analysis
+// thread does, and copies out the first max_frames frames it publishes
+static unsigned int run_hops(const AnalyzerConfig& config, const sample_t *samples,
+                             unsigned int nframes, unsigned int period,
+                             AnalysisFrame *frames, unsigned int max_frames)
+{
+    Analyzer analyzer(0, SAMPLERATE, config);
+    SlidingWindow history(config.window_size + period);
+    unsigned int count = 0;
+
+    for (unsigned int done = 0; done < nframes; done += period) {
+        unsigned int n = nframes - done < period ? nframes - done : period;
+        history.push(samples + done, n);
+        analyzer.process(history, n, done, 0);
+
+        AnalysisFrame *frame;
+        while ((frame = analyzer.queue()->take()) != NULL) {
+            if (count < max_frames) {
+                frames[count] = *frame;
+            }
+            count++;
+            analyzer.queue()->release(frame);
+        }
+    }
+    return count;
+}
+
+
+// Only the fields check_hop_alignment()'s chain fills in
+static bool same_hop(const AnalysisFrame& a, const AnalysisFrame& b)
+{
+    if (a.time != b.time || a.onset != b.onset || a.has_spectrum != b.has_spectrum
+        || a.bands != b.bands || a.mel_bands != b.mel_bands
+        || a.envelope_steps != b.envelope_steps || a.envelope_bands != b.envelope_bands
+        || memcmp(a.spectrum, b.spectrum, a.bands * sizeof(float)) != 0
+        || memcmp(a.mel, b.mel, a.mel_bands * sizeof(float)) != 0)
+    {
+        return false;
+    }
+    for (unsigned int i = 0; i < a.envelope_steps; i++) {
+        if (memcmp(a.envelopes[i], b.envelopes[i],
+                   a.envelope_bands * sizeof(EnvelopeLevels)) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// However the input is split into periods, a chain must see the same hops:
+// every frame's time, spectrum, mel bands, envelopes and onset bit for bit
+// the same as when the whole signal arrives at once.  The hop divides some
+// of the periods and not others.
+static bool check_hop_alignment(void)
+{
+    // The reference publishes all its frames in one call, so they have to
+    // fit in the pool
+    const unsigned int hops = FRAME_POOL_SIZE - 1;
+    const unsigned int window = 1024, hop = 768;
+    const unsigned int nframes = hops * hop + hop / 2;
+    static const unsigned int periods[] = { 32, 64, 100, 128, 1000, 2048, 8192 };
+    static AnalysisFrame expected[FRAME_POOL_SIZE], frames[FRAME_POOL_SIZE];
+    bool ok = true;
+
+    AnalyzerConfig config;
+    config.window_size = window;
+    config.hop_size = hop;
+    config.stages = CHAIN_SPECTRUM | CHAIN_MEL | CHAIN_ONSET | CHAIN_ENVELOPE;
+    config.mel_bands = 24;
+    config.envelope_steps = 4;
+
+    fvec_t *signal = new_fvec(nframes);
+    fill_signal(signal);
+    unsigned int count = run_hops(config, signal->data, nframes, nframes, expected, hops);
+    for (unsigned int i = 0; i < count; i++) {
+        if (expected[i].time != (i + 1) * hop) {
+            fprintf(stderr, "Hop %u of a single chunk ends at %u, not %u\n",
+                    i, expected[i].time, (i + 1) * hop);
+            ok = false;
+        }
+    }
+    if (count != hops) {
+        fprintf(stderr, "A single chunk made %u hops, not %u\n", count, hops);
+        ok = false;
+    }
+
+    for (unsigned int p = 0; p < sizeof(periods) / sizeof(periods[0]) && ok; p++) {
+        if (run_hops(config, signal->data, nframes, periods[p], frames, hops) != count) {
+            fprintf(stderr, "%u-frame periods made a different number of hops\n", periods[p]);
+            ok = false;
+        }
+        for (unsigned int i = 0; i < count && ok; i++) {
+            if (!same_hop(expected[i], frames[i])) {
+                fprintf(stderr, "Hop %u differs when pushed in %u-frame periods\n",
+                        i, periods[p]);
+                ok = false;
+            }
+        }
+    }
+
+    del_fvec(signal);
+    return ok;
+}
+
+
+// The legacy SpectrumBinner layout must reproduce the original tables
+static bool check_legacy_binner(const smpl_t *norm)
+{
+    SpectrumBinner binner;
+    float expected[LOG_SPECTRUM_SIZE];
+    float actual[LOG_SPECTRUM_SIZE];
+
+    legacy_log_spectrum(norm, expected);
+    binner.apply(norm, actual);
+
+    for (int i = 0; i < LOG_SPECTRUM_SIZE; i++) {
+        if (fabsf(actual[i] - expected[i]) > 1e-5 * (1 + fabsf(expected[i]))) {
+            fprintf(stderr, "Spectrum binner mismatch at band %d: %g != %g\n",
+                    i, actual[i], expected[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+class PitchBenchmark : public Benchmark
+{
+public:
+    PitchBenchmark(unsigned int size)
+    {
+        char mode[] = "yinfft";
+        char unit[] = "Hz";
+        _pitch = new_aubio_pitch(mode, size, size, SAMPLERATE);
+        aubio_pitch_set_unit(_pitch, unit);
+        _in = new_fvec(size);
+        _out = new_fvec(1);
+        fill_signal(_in);
+    }
+    ~PitchBenchmark()
+    {
+        del_aubio_pitch(_pitch);
+        del_fvec(_in);
+        del_fvec(_out);
+    }
+    void run(void) { aubio_pitch_do(_pitch, _in, _out); }
+
+private:
+    aubio_pitch_t *_pitch;
+    fvec_t *_in;
+    fvec_t *_out;
+};
+
+
+class OnsetBenchmark : public Benchmark
+{
+public:
+    OnsetBenchmark(unsigned int size)
+    {
+        char mode[] = "mkl";
+        _onset = new_aubio_onset(mode, size, size, SAMPLERATE);
+        aubio_onset_set_threshold(_onset, 0.3);
+        aubio_onset_set_silence(_onset, -70.0);
+        aubio_onset_set_minioi_ms(_onset, 250);
+        _in = new_fvec(size);
+        _out = new_fvec(1);
+        fill_signal(_in);
+    }
+    ~OnsetBenchmark()
+    {
+        del_aubio_onset(_onset);
+        del_fvec(_in);
+        del_fvec(_out);
+    }
+    void run(void) { aubio_onset_do(_onset, _in, _out); }
+
+private:
+    aubio_onset_t *_onset;
+    fvec_t *_in;
+    fvec_t *_out;
+};
+
+
+// The stages Analyzer actually runs, all fed from one shared FFT
+class SharedPitchBenchmark : public Benchmark
+{
+public:
+    SharedPitchBenchmark(unsigned int size, const cvec_t *grain)
+        : _pitch(size, SAMPLERATE), _grain(grain) {}
+    void run(void) { _pitch.detect(_grain); }
+
+private:
+    PitchDetector _pitch;
+    const cvec_t *_grain;
+};
+
+
+class SharedOnsetBenchmark : public Benchmark
+{
+public:
+    SharedOnsetBenchmark(unsigned int size, const cvec_t *grain)
+        : _onset("mkl", size, size, SAMPLERATE), _grain(grain) {}
+    void run(void) { _onset.detect(_grain, 0); }
+
+private:
+    OnsetDetector _onset;
+    const cvec_t *_grain;
+};
+
+
+// Datagram construction as done by Networking::transmit_frame, into its
+// reused buffer: one legacy message, or a whole v2 frame
+class DatagramBenchmark : public Benchmark
+{
+public:
+    DatagramBenchmark(int msg, bool has_spectrum = true) : _msg(msg)
+    {
+        _frame.channel = 0;
+        _frame.samplerate = SAMPLERATE;
+        _frame.time = 0;
+        _frame.onset = true;
+        _frame.has_pitch = true;
+        _frame.pitch = 440.0;
+        _frame.confidence = 0.9;
+        _frame.has_tempo = false;
+        _frame.has_envelope = false;
+        _frame.has_load = false;
+        _frame.has_chroma = false;
+        _frame.has_mel = false;
+        _frame.has_spectrum = has_spectrum;
+        _frame.bands = LOG_SPECTRUM_SIZE;
+        for (int i = 0; i < LOG_SPECTRUM_SIZE; i++) {
+            _frame.spectrum[i] = i / (float)LOG_SPECTRUM_SIZE;
+        }
+    }
+    void run(void)
+    {
+        int len = 0;
+        switch (_msg) {
+        case MSG_FFT:
+            len = Networking::encode_fft_data(_buffer, 0, _frame.bands, _frame.spectrum);
+            break;
+        case MSG_ONSET:
+            len = Networking::encode_onset(_buffer, 0);
+            break;
+        case MSG_PITCH:
+            len = Networking::encode_pitch_data(_buffer, 0, _frame.pitch, _frame.confidence);
+            break;
+        case MSG_FRAME:
+            len = Networking::encode_frame(_buffer, _frame.time++, _frame);
+            break;
+        }
+        _sink += len;
+    }
+
+private:
+    int _msg;
+    AnalysisFrame _frame;
+    char _buffer[MAX_DATAGRAM_SIZE];
+    volatile int _sink;
+};
+
+
+// A slowly changing spectrum spanning the codecs' whole range, with a few
+// bands below the floor and above the ceiling
+static void fill_spectrum(float *spectrum, unsigned int bands, int frame)
+{
+    for (unsigned int i = 0; i < bands; i++) {
+        float db = SPECTRUM_DB_FLOOR - 10
+                 + (SPECTRUM_DB_CEIL - SPECTRUM_DB_FLOOR + 20) * i / bands
+                 + 3 * sinf(0.1f * frame + i);
+        spectrum[i] = powf(10, db / 20);
+    }
+}
+
+
+// Every band must come back within half a quantization step (in dB), or as
+// silence / the ceiling when out of range, and delta coding must decode to
+// exactly what full frames do, recovering at the next keyframe after a loss
+static bool check_spectrum_codec(SpectrumCodec::Encoding encoding, bool delta)
+{
+    SpectrumCodec encoder(encoding, delta);
+    SpectrumCodec decoder;
+    static float in[LOG_SPECTRUM_SIZE], out[LOG_SPECTRUM_SIZE];
+    static char buf[MAX_DATAGRAM_SIZE];
+    float tolerance = SpectrumCodec::step_db(encoding) / 2 + 1e-3f;
+    int missed = 0;
+
+    for (int frame = 0; frame < 4 * SPECTRUM_KEYFRAME_INTERVAL; frame++) {
+        bool delta_used;
+        fill_spectrum(in, LOG_SPECTRUM_SIZE, frame);
+        int len = encoder.encode(buf, 0, frame, in, LOG_SPECTRUM_SIZE, &delta_used);
+
+        // Lose one frame in the middle of the run
+        if (frame == SPECTRUM_KEYFRAME_INTERVAL + 3) {
+            continue;
+        }
+
+        int used = decoder.decode(buf, len, encoding, delta_used, 0, frame,
+                                  out, LOG_SPECTRUM_SIZE);
+        if (used < 0) {
+            missed++;
+            continue;
+        }
+        if (used != len) {
+            fprintf(stderr, "Spectrum codec read %d of %d bytes\n", used, len);
+            return false;
+        }
+
+        for (int i = 0; i < LOG_SPECTRUM_SIZE; i++) {
+            float db_in = 20 * log10f(in[i]);
+            float db_out = out[i] > 0 ? 20 * log10f(out[i]) : SPECTRUM_DB_FLOOR;
+            if (db_in < SPECTRUM_DB_FLOOR || db_in > SPECTRUM_DB_CEIL) {
+                db_in = db_in < SPECTRUM_DB_FLOOR ? SPECTRUM_DB_FLOOR : SPECTRUM_DB_CEIL;
+                if (encoding != SpectrumCodec::ENCODING_FLOAT && fabsf(db_out - db_in) > tolerance) {
+                    fprintf(stderr, "Spectrum codec %d: out-of-range band %d came back as %g dB\n",
+                            encoding, i, db_out);
+                    return false;
+                }
+            } else if (fabsf(db_out - db_in) > tolerance) {
+                fprintf(stderr, "Spectrum codec %d%s: band %d off by %g dB (bound %g)\n",
+                        encoding, delta ? " delta" : "", i, db_out - db_in, tolerance);
+                return false;
+            }
+        }
+    }
+
+    // Delta frames after the lost one can't be decoded until the next
+    // keyframe; without delta coding nothing else is missed
+    int expected = 0;
+    if (encoder.delta()) {
+        expected = SPECTRUM_KEYFRAME_INTERVAL - 4;
+    }
+    if (missed != expected) {
+        fprintf(stderr, "Spectrum codec %d%s missed %d frames after a loss, expected %d\n",
+                encoding, delta ? " delta" : "", missed, expected);
+        return false;
+    }
+    return true;
+}
+
+
+static float hz_to_mel(float hz)
+{
+    return 2595 * log10f(1 + hz / 700);
+}
+
+
+// A 440 Hz tone must peak in pitch class A and in the mel band centred
+// nearest it, a flat spectrum must come out flat across the mel bands, and
+// both features must survive a log8 frame within half a step
+static bool check_features(void)
+{
+    static const unsigned int sizes[] = { 1024, 4096 };
+    const unsigned int mel_bands = 24;
+    static AnalysisFrame frame, decoded;
+    static char buf[MAX_DATAGRAM_SIZE];
+
+    float mel_lo = hz_to_mel(SPECTRUM_DEFAULT_FMIN);
+    float mel_step = (hz_to_mel(SPECTRUM_DEFAULT_FMAX) - mel_lo) / (mel_bands + 1);
+    unsigned int expected_mel = (unsigned int)((hz_to_mel(440) - mel_lo) / mel_step + 0.5) - 1;
+
+    for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        unsigned int size = sizes[s];
+        aubio_fft_t *fft = new_aubio_fft(size);
+        fvec_t *in = new_fvec(size);
+        cvec_t *grain = new_cvec(size);
+        SpectrumBinner *chroma = SpectrumBinner::chroma(size, SAMPLERATE);
+        SpectrumBinner *mel = SpectrumBinner::mel(size, SAMPLERATE, mel_bands,
+                                                  SPECTRUM_DEFAULT_FMIN, SPECTRUM_DEFAULT_FMAX);
+        bool ok = true;
+
+        for (unsigned int i = 0; i < size; i++) {
+            in->data[i] = 0.5 * sin(2 * M_PI * 440.0 * i / SAMPLERATE)
+                        * (0.5 - 0.5 * cos(2 * M_PI * i / size));
+        }
+        aubio_fft_do(fft, in, grain);
+        chroma->apply(grain->norm, frame.chroma);
+        mel->apply(grain->norm, frame.mel);
+
+        unsigned int chroma_peak = 0, mel_peak = 0;
+        for (unsigned int i = 1; i < CHROMA_BINS; i++) {
+            if (frame.chroma[i] > frame.chroma[chroma_peak]) {
+                chroma_peak = i;
+            }
+        }
+        for (unsigned int i = 1; i < mel_bands; i++) {
+            if (frame.mel[i] > frame.mel[mel_peak]) {
+                mel_peak = i;
+            }
+        }
+        if (chroma_peak != 9 || mel_peak != expected_mel) {
+            fprintf(stderr, "Features at %u: 440 Hz peaked in pitch class %u and mel "
+                    "band %u, expected 9 and %u\n", size, chroma_peak, mel_peak, expected_mel);
+            ok = false;
+        }
+
+        frame.channel = 0;
+        frame.samplerate = SAMPLERATE;
+        frame.has_chroma = true;
+        frame.has_mel = true;
+        frame.mel_bands = mel_bands;
+        SpectrumCodec codec(SpectrumCodec::ENCODING_LOG8);
+        int len = Networking::encode_frame(buf, s, frame, &codec, STREAM_CHROMA | STREAM_MEL);
+        uint32_t sequence;
+        float tolerance = SpectrumCodec::step_db(SpectrumCodec::ENCODING_LOG8) / 2 + 1e-3f;
+        if (len != FRAME_HEADER_SIZE + FEATURES_HEADER_SIZE + CHROMA_BINS + (int)mel_bands
+            || !Networking::decode_frame(buf, len, &sequence, &decoded)
+            || !decoded.has_chroma || !decoded.has_mel || decoded.mel_bands != mel_bands)
+        {
+            fprintf(stderr, "Features at %u: %d-byte frame didn't decode\n", size, len);
+            ok = false;
+        }
+        for (unsigned int i = 0; ok && i < CHROMA_BINS + mel_bands; i++) {
+            float a = i < CHROMA_BINS ? frame.chroma[i] : frame.mel[i - CHROMA_BINS];
+            float b = i < CHROMA_BINS ? decoded.chroma[i] : decoded.mel[i - CHROMA_BINS];
+            if (20 * log10f(a) > SPECTRUM_DB_FLOOR
+                && fabsf(20 * log10f(b) - 20 * log10f(a)) > tolerance)
+            {
+                fprintf(stderr, "Features at %u: value %u came back as %g, sent %g\n",
+                        size, i, b, a);
+                ok = false;
+            }
+        }
+
+        for (unsigned int i = 0; i <= size / 2; i++) {
+            grain->norm[i] = 1;
+        }
+        mel->apply(grain->norm, frame.mel);
+        for (unsigned int i = 0; ok && i < mel_bands; i++) {
+            if (fabsf(frame.mel[i] - 1) > 1e-4) {
+                fprintf(stderr, "Features at %u: flat spectrum gave mel band %u %g\n",
+                        size, i, frame.mel[i]);
+                ok = false;
+            }
+        }
+
+        delete chroma;
+        delete mel;
+        del_aubio_fft(fft);
+        del_fvec(in);
+        del_cvec(grain);
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// The gate sends a steady spectrum only as keepalives, a continuously
+// changing one at the maximum rate, and a step change on the very hop it
+// happens, even right after another send
+static bool check_spectrum_gate(void)
+{
+    const unsigned int hop = 512;
+    const int hops = 10 * SAMPLERATE / hop;
+    static float spectrum[LOG_SPECTRUM_SIZE];
+
+    SpectrumGate steady(SAMPLERATE, SPECTRUM_GATE_DEFAULT_THRESHOLD_DB,
+                        SPECTRUM_GATE_DEFAULT_MIN_RATE, SPECTRUM_GATE_DEFAULT_MAX_RATE);
+    fill_spectrum(spectrum, LOG_SPECTRUM_SIZE, 0);
+    int sent = 0;
+    for (int i = 0; i < hops; i++) {
+        sent += steady.update(spectrum, LOG_SPECTRUM_SIZE, hop);
+    }
+    int expected = 1 + (int)(hops * hop / (SAMPLERATE / SPECTRUM_GATE_DEFAULT_MIN_RATE));
+    if (abs(sent - expected) > 1) {
+        fprintf(stderr, "Spectrum gate sent %d of %d steady spectra, expected %d\n",
+                sent, hops, expected);
+        return false;
+    }
+
+    SpectrumGate busy(SAMPLERATE, SPECTRUM_GATE_DEFAULT_THRESHOLD_DB,
+                      SPECTRUM_GATE_DEFAULT_MIN_RATE, SPECTRUM_GATE_DEFAULT_MAX_RATE);
+    sent = 0;
+    for (int i = 0; i < hops; i++) {
+        // About 2 dB RMS from one hop to the next
+        fill_spectrum(spectrum, LOG_SPECTRUM_SIZE, 20 * i);
+        sent += busy.update(spectrum, LOG_SPECTRUM_SIZE, hop);
+    }
+    int most = 1 + (int)(10 * SPECTRUM_GATE_DEFAULT_MAX_RATE);
+    if (sent > most || sent < most / 2) {
+        fprintf(stderr, "Spectrum gate sent %d changing spectra in 10 s, expected up to %d\n",
+                sent, most);
+        return false;
+    }
+
+    SpectrumGate step(SAMPLERATE, SPECTRUM_GATE_DEFAULT_THRESHOLD_DB,
+                      SPECTRUM_GATE_DEFAULT_MIN_RATE, SPECTRUM_GATE_DEFAULT_MAX_RATE);
+    fill_spectrum(spectrum, LOG_SPECTRUM_SIZE, 0);
+    step.update(spectrum, LOG_SPECTRUM_SIZE, hop);
+    for (int i = 0; i < LOG_SPECTRUM_SIZE; i++) {
+        spectrum[i] *= 10;
+    }
+    if (!step.update(spectrum, LOG_SPECTRUM_SIZE, hop)) {
+        fprintf(stderr, "Spectrum gate held back a %g dB step\n", step.change());
+        return false;
+    }
+    return true;
+}
+
+
+// Deciding whether to send a changing spectrum
+class SpectrumGateBenchmark : public Benchmark
+{
+public:
+    SpectrumGateBenchmark()
+        : _gate(SAMPLERATE, SPECTRUM_GATE_DEFAULT_THRESHOLD_DB,
+                SPECTRUM_GATE_DEFAULT_MIN_RATE, SPECTRUM_GATE_DEFAULT_MAX_RATE),
+          _frame(0)
+    {
+        for (int i = 0; i < 4; i++) {
+            fill_spectrum(_spectra[i], LOG_SPECTRUM_SIZE, i);
+        }
+    }
+    void run(void)
+    {
+        _sent = _gate.update(_spectra[_frame++ & 3], LOG_SPECTRUM_SIZE, 512);
+    }
+
+private:
+    SpectrumGate _gate;
+    unsigned int _frame;
+    float _spectra[4][LOG_SPECTRUM_SIZE];
+    volatile bool _sent;
+};
+
+
+// Default crossovers: bass, mids and highs
+static const float envelope_crossovers[] = { 250, 4000 };
+
+static void fill_tone(sample_t *samples, unsigned int nframes, float freq, float amplitude)
+{
+    for (unsigned int i = 0; i < nframes; i++) {
+        samples[i] = amplitude * sin(2 * M_PI * freq * i / SAMPLERATE);
+    }
+}
+
+
+// A tone's RMS must show up in its own band (0.707 of its amplitude, give
+// or take the filter's ripple) and barely at all in the others; the envelope
+// must rise within a few attack times and fall back within a few release
+// times; and a frame's envelopes must survive encoding
+static bool check_envelope_follower(void)
+{
+    // Whole periods of every tone, so each hop's RMS is exact
+    const unsigned int long_hop = SAMPLERATE / 20;
+    const unsigned int hop = 256;
+    const unsigned int steps = 4;
+    const unsigned int nframes = SAMPLERATE;
+    static sample_t samples[SAMPLERATE];
+    static EnvelopeLevels levels[MAX_ENVELOPE_STEPS][MAX_ENVELOPE_BANDS];
+    static const struct {
+        float freq;
+        unsigned int band;
+    } tones[] = { { 60, 0 }, { 1000, 1 }, { 10000, 2 } };
+
+    for (unsigned int t = 0; t < sizeof(tones) / sizeof(tones[0]); t++) {
+        EnvelopeFollower follower(SAMPLERATE, envelope_crossovers, 2,
+                                  ENVELOPE_DEFAULT_ATTACK_MS, ENVELOPE_DEFAULT_RELEASE_MS);
+        fill_tone(samples, nframes, tones[t].freq, 0.5f);
+        for (unsigned int i = 0; i + long_hop <= nframes; i += long_hop) {
+            follower.process(samples + i, long_hop, 1, levels);
+        }
+
+        for (unsigned int b = 0; b < follower.bands(); b++) {
+            const EnvelopeLevels& level = levels[0][b];
+            bool own = b == tones[t].band;
+            if ((own && fabsf(level.rms - 0.3536f) > 0.05f)
+                || (own && fabsf(level.envelope - level.rms) > 0.01f)
+                || (!own && level.rms > 0.16f))
+            {
+                fprintf(stderr, "Envelope follower: %g Hz tone gave band %u rms %g envelope %g\n",
+                        tones[t].freq, b, level.rms, level.envelope);
+                return false;
+            }
+        }
+    }
+
+    // A burst of mids, then silence
+    EnvelopeFollower follower(SAMPLERATE, envelope_crossovers, 2,
+                              ENVELOPE_DEFAULT_ATTACK_MS, ENVELOPE_DEFAULT_RELEASE_MS);
+    fill_tone(samples, nframes, 1000, 0.5f);
+    for (unsigned int i = nframes / 2; i < nframes; i++) {
+        samples[i] = 0;
+    }
+    float attack_at = 0, release_at = 0;
+    for (unsigned int i = 0; i + hop <= nframes; i += hop) {
+        follower.process(samples + i, hop, steps, levels);
+        float ms = 1000.0f * (i + hop) / SAMPLERATE;
+        float envelope = levels[steps - 1][1].envelope;
+        if (attack_at == 0 && envelope > 0.3f) {
+            attack_at = ms;
+        }
+        if (i >= nframes / 2 && release_at == 0 && envelope < 0.05f) {
+            release_at = ms - 1000.0f * (nframes / 2) / SAMPLERATE;
+        }
+    }
+    if (attack_at == 0 || attack_at > 10 * ENVELOPE_DEFAULT_ATTACK_MS + 30
+        || release_at == 0 || release_at > 3 * ENVELOPE_DEFAULT_RELEASE_MS + 30)
+    {
+        fprintf(stderr, "Envelope follower took %g ms to attack and %g ms to release\n",
+                attack_at, release_at);
+        return false;
+    }
+
+    static AnalysisFrame in, out;
+    static char buf[MAX_DATAGRAM_SIZE];
+    in.channel = 1;
+    in.samplerate = SAMPLERATE;
+    in.time = 1234;
+    in.onset = false;
+    in.has_pitch = false;
+    in.has_spectrum = false;
+    in.bands = 0;
+    in.has_envelope = true;
+    in.envelope_bands = follower.bands();
+    in.envelope_steps = steps;
+    in.envelope_step_frames = hop / steps;
+    fill_tone(samples, hop, 1000, 0.5f);
+    follower.process(samples, hop, steps, in.envelopes);
+
+    uint32_t sequence;
+    int len = Networking::encode_frame(buf, 7, in);
+    if (!Networking::decode_frame(buf, len, &sequence, &out) || !out.has_envelope
+        || out.envelope_bands != in.envelope_bands || out.envelope_steps != steps
+        || out.envelope_step_frames != in.envelope_step_frames)
+    {
+        fprintf(stderr, "Envelope frame of %d bytes didn't decode\n", len);
+        return false;
+    }
+    for (unsigned int s = 0; s < steps; s++) {
+        for (unsigned int b = 0; b < in.envelope_bands; b++) {
+            if (out.envelopes[s][b].envelope != in.envelopes[s][b].envelope
+                || out.envelopes[s][b].peak != in.envelopes[s][b].peak
+                || out.envelopes[s][b].rms != in.envelopes[s][b].rms)
+            {
+                fprintf(stderr, "Envelope step %u band %u changed in transit\n", s, b);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+// Each specialized kernel must give exactly what the generic one does, and
+// the level kernel what aubio does
+static bool check_frame_kernels(void)
+{
+    typedef void (*WindowKernel)(const sample_t *, const smpl_t *, smpl_t *, unsigned int);
+    typedef smpl_t (*LevelKernel)(const sample_t *, unsigned int);
+    static const WindowKernel window_kernels[NUM_KERNEL_SIZES] = KERNEL_TABLE(window_kernel);
+    static const LevelKernel level_kernels[NUM_KERNEL_SIZES] = KERNEL_TABLE(level_kernel);
+    char window_type[] = "hanningz";
+    bool ok = true;
+
+    for (unsigned int size = KERNEL_MIN_SIZE; size <= KERNEL_MAX_SIZE && ok; size *= 2) {
+        unsigned int index = Kernels::index(size);
+        fvec_t *in = new_fvec(size);
+        fvec_t *window = new_aubio_window(window_type, size);
+        fvec_t *out = new_fvec(size);
+        fvec_t *expected = new_fvec(size);
+        fill_signal(in);
+
+        window_kernels[index](in->data, window->data, out->data, size);
+        window_kernels[0](in->data, window->data, expected->data, size);
+        if (index == 0 || memcmp(out->data, expected->data, size * sizeof(smpl_t)) != 0) {
+            fprintf(stderr, "Window kernel %u for %u samples differs\n", index, size);
+            ok = false;
+        }
+
+        smpl_t level = level_kernels[index](in->data, size);
+        if (level != level_kernels[0](in->data, size)
+            || fabsf(level - aubio_db_spl(in)) > 0.01f)
+        {
+            fprintf(stderr, "Level kernel for %u samples made %g dB, aubio %g dB\n",
+                    size, level, aubio_db_spl(in));
+            ok = false;
+        }
+
+        del_fvec(in);
+        del_fvec(window);
+        del_fvec(out);
+        del_fvec(expected);
+    }
+
+    // A 256-sample step runs the specialized filter loop
+    const unsigned int hop = 1024, steps = 4;
+    static EnvelopeLevels specialized[MAX_ENVELOPE_STEPS][MAX_ENVELOPE_BANDS];
+    static EnvelopeLevels generic[MAX_ENVELOPE_STEPS][MAX_ENVELOPE_BANDS];
+    fvec_t *in = new_fvec(hop);
+    fill_signal(in);
+    EnvelopeFollower fast(SAMPLERATE, envelope_crossovers, 2,
+                          ENVELOPE_DEFAULT_ATTACK_MS, ENVELOPE_DEFAULT_RELEASE_MS);
+    fast.process(in->data, hop, steps, specialized);
+    Kernels::set_generic(true);
+    EnvelopeFollower slow(SAMPLERATE, envelope_crossovers, 2,
+                          ENVELOPE_DEFAULT_ATTACK_MS, ENVELOPE_DEFAULT_RELEASE_MS);
+    slow.process(in->data, hop, steps, generic);
+    Kernels::set_generic(false);
+    del_fvec(in);
+    if (memcmp(specialized, generic, sizeof(generic)) != 0) {
+        fprintf(stderr, "Envelope kernel for %u-sample steps differs\n", hop / steps);
+        ok = false;
+    }
+    return ok;
+}
+
+
+// Following one hop of every band
+class EnvelopeBenchmark : public Benchmark
+{
+public:
+    EnvelopeBenchmark(unsigned int hop, unsigned int steps)
+        : _follower(SAMPLERATE, envelope_crossovers, 2,
+                    ENVELOPE_DEFAULT_ATTACK_MS, ENVELOPE_DEFAULT_RELEASE_MS),
+          _hop(hop), _steps(steps)
+    {
+        _in = new_fvec(hop);
+        fill_signal(_in);
+    }
+    ~EnvelopeBenchmark() { del_fvec(_in); }
+    void run(void) { _follower.process(_in->data, _hop, _steps, _levels); }
+
+private:
+    EnvelopeFollower _follower;
+    unsigned int _hop;
+    unsigned int _steps;
+    fvec_t *_in;
+    EnvelopeLevels _levels[MAX_ENVELOPE_STEPS][MAX_ENVELOPE_BANDS];
+};
+
+
+// A rock drum loop, the first beat offset samples in: kick on beats 1 and
+// 3, snare on 2 and 4, and a hi-hat on every eighth note
+static void fill_beats(sample_t *samples, unsigned int nframes, float bpm, unsigned int offset)
+{
+    double period = 60.0 * SAMPLERATE / bpm;
+
+    for (unsigned int i = 0; i < nframes; i++) {
+        samples[i] = 0.002f * (rand() / (float)RAND_MAX - 0.5f);
+    }
+    for (int eighth = 0; offset + eighth * period / 2 < nframes; eighth++) {
+        unsigned int at = (unsigned int)(offset + eighth * period / 2);
+        for (unsigned int i = 0; i < SAMPLERATE / 5 && at + i < nframes; i++) {
+            float t = (float)i / SAMPLERATE;
+            float noise = rand() / (float)RAND_MAX - 0.5f;
+            float sample = 0.2f * noise * expf(-t / 0.01f);
+            if (eighth % 4 == 0) {
+                sample += 0.8f * sinf(2 * M_PI * 60 * t) * expf(-t / 0.05f);
+            } else if (eighth % 4 == 2) {
+                sample += 0.5f * noise * expf(-t / 0.04f);
+            }
+            samples[at + i] += sample;
+        }
+    }
+}
+
+
+// Writes samples as a mono 16-bit WAV file
+static bool write_wav(QIODevice& file, const sample_t *samples, unsigned int nframes)
+{
+    char header[44], *p = header;
+    memcpy(p, "RIFF", 4);
+    p = put_u32(p + 4, 36 + 2 * nframes);
+    memcpy(p, "WAVEfmt ", 8);
+    p = put_u32(p + 8, 16);
+    p = put_u16(p, 1);                  // PCM
+    p = put_u16(p, 1);                  // channels
+    p = put_u32(p, SAMPLERATE);
+    p = put_u32(p, 2 * SAMPLERATE);     // bytes per second
+    p = put_u16(p, 2);                  // bytes per frame
+    p = put_u16(p, 16);
+    memcpy(p, "data", 4);
+    put_u32(p + 4, 2 * nframes);
+    if (file.write(header, sizeof(header)) != sizeof(header)) {
+        return false;
+    }
+
+    char pcm[2 * 1024];
+    for (unsigned int done = 0; done < nframes; ) {
+        unsigned int n = nframes - done < 1024 ? nframes - done : 1024;
+        for (unsigned int i = 0; i < n; i++) {
+            float sample = samples[done + i];
+            sample = sample > 1 ? 1 : sample < -1 ? -1 : sample;
+            put_u16(pcm + 2 * i, (uint16_t)(int16_t)lrintf(sample * 32767));
+        }
+        if (file.write(pcm, 2 * n) != 2 * n) {
+            return false;
+        }
+        done += n;
+    }
+    return file.flush();
+}
+
+
+// Analyses a file the way the processor does, through a FileSource and the
+// analysis thread's chunks, with a chain of onsets and tempo at the given
+// shed level; returns the last tempo found and the time it predicted for
+// the next beat
+static bool track_file(const char *path, unsigned int shed, float *bpm,
+                       jack_nframes_t *next_beat)
+{
+    FileSource source(path);
+    if (!source.is_open()) {
+        return false;
+    }
+
+    AnalyzerConfig config;
+    config.window_size = 1024;
+    config.hop_size = 512;
+    config.stages = CHAIN_ONSET | CHAIN_TEMPO;
+    Analyzer analyzer(0, source.samplerate(), config);
+    if (shed != SHED_NONE) {
+        analyzer.set_load(1, shed);
+    }
+    SlidingWindow history(config.window_size + BUF_SIZE);
+    static sample_t chunk[BUF_SIZE];
+    sample_t *bufs[1] = { chunk };
+
+    *bpm = 0;
+    jack_nframes_t time;
+    int n;
+    while ((n = source.read(bufs, BUF_SIZE, &time)) >= 0) {
+        history.push(chunk, n);
+        analyzer.process(history, n, time, source.capture_usecs(time));
+
+        AnalysisFrame *frame;
+        while ((frame = analyzer.queue()->take()) != NULL) {
+            if (frame->has_tempo) {
+                *bpm = frame->bpm;
+                *next_beat = frame->next_beats[0];
+            }
+            analyzer.queue()->release(frame);
+        }
+    }
+    return true;
+}
+
+
+// A drum loop, written to a WAV file and analysed as the processor would
+// analyse it, must have its tempo found within 2% and its next beat
+// predicted within 25 ms, both with every stage running and with onsets
+// shed to every other hop
+static bool check_tempo_tracker(void)
+{
+    const unsigned int nframes = 12 * SAMPLERATE;
+    static sample_t samples[12 * SAMPLERATE];
+    static const float tempos[] = { 92, 120, 143 };
+    static const unsigned int sheds[] = { SHED_NONE, SHED_ONSET };
+    bool ok = true;
+
+    for (unsigned int t = 0; t < sizeof(tempos) / sizeof(tempos[0]) && ok; t++) {
+        unsigned int offset = 1000 + 7919 * t;
+        fill_beats(samples, nframes, tempos[t], offset);
+
+        QTemporaryFile file;
+        if (!file.open() || !write_wav(file, samples, nframes)) {
+            fprintf(stderr, "Could not write a drum loop to a temporary file\n");
+            return false;
+        }
+        QByteArray path = QFile::encodeName(file.fileName());
+
+        for (unsigned int i = 0; i < sizeof(sheds) / sizeof(sheds[0]) && ok; i++) {
+            float bpm;
+            jack_nframes_t next_beat;
+            if (!track_file(path.constData(), sheds[i], &bpm, &next_beat)) {
+                return false;
+            }
+
+            double period = 60.0 * SAMPLERATE / tempos[t];
+            double error = fmod((double)next_beat - offset, period);
+            if (error > period / 2) {
+                error -= period;
+            }
+            error *= 1000.0 / SAMPLERATE;
+            if (fabsf(bpm - tempos[t]) > 0.02f * tempos[t] || fabs(error) > 25) {
+                fprintf(stderr, "Tempo tracker found %g BPM for a %g BPM loop at shed level "
+                        "%u, with beats %g ms off\n", bpm, tempos[t], sheds[i], error);
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+
+// Most of real time the tracker may take, averaged over its hops
+#define TEMPO_MAX_LOAD 0.01
+
+// Following a steady beat, one detection function value per hop.  The
+// estimate is redone every TEMPO_UPDATE_SECONDS, which dominates the average.
+class TempoBenchmark : public Benchmark
+{
+public:
+    TempoBenchmark(unsigned int hop) : _tempo(hop, SAMPLERATE), _hop(0)
+    {
+        double period = 60.0 * SAMPLERATE / 120 / hop;
+        for (int i = 0; i < 1024; i++) {
+            _novelty[i] = fmod(i, period) < 1 ? 10 : rand() / (float)RAND_MAX;
+        }
+    }
+    void run(void) { _tempo.process(_novelty[_hop++ % 1024]); }
+
+private:
+    TempoTracker _tempo;
+    unsigned int _hop;
+    float _novelty[1024];
+};
+
+
+// Runs a LoadBudget over seconds of rounds of a simulated analysis whose
+// stages cost stage_load each when run in full, plus base and extra for
+// everything else, and returns the level it ends at
+static unsigned int run_load_budget(LoadBudget& budget, const float *stage_load, float base,
+                                    float extra, int seconds, unsigned int *highest)
+{
+    const unsigned int round = 512;
+    const jack_time_t round_usecs = (jack_time_t)round * 1000000 / SAMPLERATE;
+
+    for (int i = 0; i < seconds * SAMPLERATE / (int)round; i++) {
+        unsigned int level = budget.level();
+        float load = base + extra;
+        load += level < SHED_PITCH ? stage_load[SHED_PITCH] : 0;
+        load += stage_load[SHED_SPECTRUM]
+                / (level < SHED_SPECTRUM ? 1 : SHED_SPECTRUM_DECIMATION);
+        load += stage_load[SHED_ONSET] / (level < SHED_ONSET ? 1 : SHED_ONSET_DECIMATION);
+
+        budget.update((jack_time_t)(load * round_usecs), round, false, stage_load);
+        if (budget.level() > *highest) {
+            *highest = budget.level();
+        }
+    }
+    return budget.level();
+}
+
+
+// A load of 0.8 sheds pitch and no more.  A busy host then pushes it over
+// budget again, shedding spectrum rate and then onset rate, and once the
+// host is idle again they come back as far as they fit.
+static bool check_load_budget(void)
+{
+    static const float stage_load[NUM_SHED_LEVELS] = { 0, 0.3f, 0.2f, 0.2f };
+    LoadBudget budget(SAMPLERATE, LOAD_DEFAULT_BUDGET);
+    unsigned int highest = SHED_NONE;
+
+    unsigned int level = run_load_budget(budget, stage_load, 0.1f, 0, 10, &highest);
+    if (level != SHED_PITCH || highest != SHED_PITCH) {
+        fprintf(stderr, "Load budget shed %s (at most %s) at a load of 0.8\n",
+                LoadBudget::level_name(level), LoadBudget::level_name(highest));
+        return false;
+    }
+    level = run_load_budget(budget, stage_load, 0.1f, 0.4f, 10, &highest);
+    if (level != SHED_ONSET) {
+        fprintf(stderr, "Load budget shed only %s on a busy host\n",
+                LoadBudget::level_name(level));
+        return false;
+    }
+    level = run_load_budget(budget, stage_load, 0.1f, 0, 20, &highest);
+    if (level != SHED_PITCH) {
+        fprintf(stderr, "Load budget still shed %s once the host was idle\n",
+                LoadBudget::level_name(level));
+        return false;
+    }
+
+    static AnalysisFrame in, out;
+    static char buf[MAX_DATAGRAM_SIZE];
+    in.channel = 0;
+    in.samplerate = SAMPLERATE;
+    in.has_load = true;
+    in.load = 0.734f;
+    in.shed_level = SHED_SPECTRUM;
+    uint32_t sequence;
+    int len = Networking::encode_frame(buf, 0, in);
+    if (!Networking::decode_frame(buf, len, &sequence, &out) || !out.has_load
+        || fabsf(out.load - in.load) > 0.001f || out.shed_level != in.shed_level)
+    {
+        fprintf(stderr, "Load of %g at level %u came through as %g at level %u\n",
+                in.load, in.shed_level, out.load, out.shed_level);
+        return false;
+    }
+    return true;
+}
+
+
+// Encoding one frame's spectrum, with the codec's state carried over
+class SpectrumEncodeBenchmark : public Benchmark
+{
+public:
+    SpectrumEncodeBenchmark(SpectrumCodec::Encoding encoding, bool delta)
+        : _codec(encoding, delta), _frame(0)
+    {
+        for (int i = 0; i < 4; i++) {
+            fill_spectrum(_spectra[i], LOG_SPECTRUM_SIZE, i);
+        }
+    }
+    void run(void)
+    {
+        bool delta;
+        _last = _codec.encode(_buffer, 0, _frame, _spectra[_frame & 3],
+                              LOG_SPECTRUM_SIZE, &delta);
+        _frame++;
+    }
+    // Size of a typical frame, past any keyframe
+    int encoded_size(void)
+    {
+        run();
+        run();
+        return _last;
+    }
+
+private:
+    SpectrumCodec _codec;
+    uint32_t _frame;
+    float _spectra[4][LOG_SPECTRUM_SIZE];
+    char _buffer[MAX_DATAGRAM_SIZE];
+    volatile int _last;
+};
+
+
+// One hop's trip from an Analyzer to the sink and back: take a frame from
+// the pool, publish it, take it on the sender side, serialize it and return
+// it to the pool
+class HandoffBenchmark : public Benchmark
+{
+public:
+    // Frames go to sender, if given, or are only encoded
+    HandoffBenchmark(Networking *sender = NULL) : _sender(sender), _sequence(0) {}
+    void run(void)
+    {
+        AnalysisFrame *frame = _queue.acquire();
+        frame->channel = 0;
+        frame->samplerate = SAMPLERATE;
+        frame->time = _sequence;
+        frame->onset = _sequence % 8 == 0;
+        frame->has_pitch = true;
+        frame->pitch = 440.0;
+        frame->confidence = 0.9;
+        frame->has_tempo = false;
+        frame->has_envelope = false;
+        frame->has_load = false;
+        frame->has_chroma = false;
+        frame->has_mel = false;
+        frame->has_spectrum = true;
+        frame->bands = LOG_SPECTRUM_SIZE;
+        for (int i = 0; i < LOG_SPECTRUM_SIZE; i++) {
+            frame->spectrum[i] = i / (float)LOG_SPECTRUM_SIZE;
+        }
+        _queue.publish(frame);
+
+        frame = _queue.take();
+        if (_sender != NULL) {
+            _sink += _sender->transmit_frame(frame);
+        } else {
+            _sink += Networking::encode_frame(_buffer, _sequence, *frame);
+        }
+        _sequence++;
+        _queue.release(frame);
+    }
+
+private:
+    Networking *_sender;
+    FrameQueue _queue;
+    uint32_t _sequence;
+    char _buffer[MAX_DATAGRAM_SIZE];
+    volatile int _sink;
+};
+
+
+// Reads every datagram waiting on socket, counting them by message type
+static void drain(QUdpSocket& socket, int *received, uint16_t *from = NULL)
+{
+    char buf[MAX_DATAGRAM_SIZE];
+    QHostAddress address;
+    uint16_t port;
+
+    while (socket.hasPendingDatagrams()) {
+        int len = socket.readDatagram(buf, sizeof(buf), &address, &port);
+        if (len > 0) {
+            received[(unsigned char)buf[0]]++;
+            if (from != NULL) {
+                *from = port;
+            }
+        }
+    }
+}
+
+
+// Once running, the handoff and everything the sender does for a hop must
+// not touch the heap at all.  The sender listens for subscribers and sends
+// to two subscribers given up front, one legacy and one v2, and to a third
+// that subscribed itself.
+static bool check_handoff_allocations(void)
+{
+#ifdef __GLIBC__
+    static int received[256], subscribed[256];
+    const QHostAddress localhost(QHostAddress::LocalHost);
+    const int hops = 10000;
+
+    QUdpSocket receiver, subscriber_socket;
+    Networking sender;
+    if (!receiver.bind(localhost, 0) || !subscriber_socket.bind(localhost, 0)
+        || !sender.listen(0))
+    {
+        fprintf(stderr, "Could not bind the handoff check's sockets\n");
+        return false;
+    }
+
+    Networking::Subscriber subscriber;
+    subscriber.address = localhost;
+    subscriber.port = receiver.localPort();
+    subscriber.protocol = Networking::PROTOCOL_LEGACY;
+    sender.add_subscriber(subscriber);
+    subscriber.protocol = Networking::PROTOCOL_V2;
+    subscriber.encoding = SpectrumCodec::ENCODING_LOG8;
+    subscriber.delta = true;
+    sender.add_subscriber(subscriber);
+
+    // The first hop says which port the sender listens on
+    HandoffBenchmark handoff(&sender);
+    handoff.run();
+    uint16_t listen_port = 0;
+    drain(receiver, received, &listen_port);
+
+    char message[SUBSCRIBE_SIZE];
+    subscriber.encoding = SpectrumCodec::ENCODING_LOG16;
+    subscriber.delta = false;
+    subscriber.port = 0;
+    int len = Networking::encode_subscribe(message, subscriber);
+    subscriber_socket.writeDatagram(message, len, localhost, listen_port);
+    for (int i = 0; i < 16; i++) {
+        handoff.run();
+    }
+    drain(receiver, received);
+    drain(subscriber_socket, subscribed);
+    memset(received, 0, sizeof(received));
+    memset(subscribed, 0, sizeof(subscribed));
+
+    // The receivers are drained outside the count, between hops
+    allocations = 0;
+    for (int i = 0; i < hops; i++) {
+        count_allocations = true;
+        handoff.run();
+        count_allocations = false;
+        drain(receiver, received);
+        drain(subscriber_socket, subscribed);
+    }
+
+    if (allocations != 0) {
+        fprintf(stderr, "Frame handoff and sending allocated %d times in %d hops\n",
+                allocations, hops);
+        return false;
+    }
+    if (received[MSG_FFT] == 0 || received[MSG_PITCH] == 0 || received[MSG_ONSET] == 0
+        || received[MSG_FRAME] == 0 || subscribed[MSG_FRAME] == 0)
+    {
+        fprintf(stderr, "The handoff check's subscribers got %d spectra, %d pitches, "
+                "%d onsets and %d and %d frames\n", received[MSG_FFT], received[MSG_PITCH],
+                received[MSG_ONSET], received[MSG_FRAME], subscribed[MSG_FRAME]);
+        return false;
+    }
+#endif
+    return true;
+}
+
+
+static int run_benchmarks(void)
+{
+    printf("benchmark,size,iterations,ns_per_hop\n");
+
+    // The legacy bucket tables are laid out for a 1024-point FFT
+    FftBenchmark legacy_fft(1024);
+    legacy_fft.run();
+    if (!check_legacy_binner(legacy_fft.grain()->norm)) {
+        return 1;
+    }
+    for (int delta = 0; delta < 2; delta++) {
+        if (!check_spectrum_codec(SpectrumCodec::ENCODING_FLOAT, delta)
+            || !check_spectrum_codec(SpectrumCodec::ENCODING_LOG16, delta)
+            || !check_spectrum_codec(SpectrumCodec::ENCODING_LOG8, delta))
+        {
+            return 1;
+        }
+    }
+    if (!check_hop_alignment() || !check_handoff_allocations() || !check_spectrum_gate()
+        || !check_envelope_follower() || !check_tempo_tracker() || !check_load_budget()
+        || !check_frame_kernels() || !check_features())
+    {
+        return 1;
+    }
+
+    LegacySpectrumBenchmark legacy_spectrum(legacy_fft.grain()->norm);
+    report("spectrum_legacy_tables", 1024, legacy_spectrum);
+    SpectrumBinner legacy_binner;
+    BinnerBenchmark legacy_binned(legacy_binner, legacy_fft.grain()->norm);
+    report("spectrum_binner_legacy", 1024, legacy_binned);
+
+    for (int i = 0; i < num_fft_sizes; i++) {
+        unsigned int size = fft_sizes[i];
+
+        FftBenchmark fft(size);
+        report("fft", size, fft);
+
+        WindowBenchmark window(size, false);
+        report("window_kernel", size, window);
+        WindowBenchmark generic_window(size, true);
+        report("window_kernel_generic", size, generic_window);
+        LevelBenchmark level(size, false);
+        report("level_kernel", size, level);
+        LevelBenchmark generic_level(size, true);
+        report("level_kernel_generic", size, generic_level);
+
+        fft.run();
+        SpectrumBinner binner(size, SAMPLERATE, LOG_SPECTRUM_SIZE,
+                              SPECTRUM_DEFAULT_FMIN, SPECTRUM_DEFAULT_FMAX);
+        BinnerBenchmark binned(binner, fft.grain()->norm);
+        report("spectrum_binner", size, binned);
+
+        SpectrumBinner *chroma = SpectrumBinner::chroma(size, SAMPLERATE);
+        BinnerBenchmark chroma_binned(*chroma, fft.grain()->norm);
+        report("chroma_binner", size, chroma_binned);
+        delete chroma;
+        SpectrumBinner *mel = SpectrumBinner::mel(size, SAMPLERATE, 24, SPECTRUM_DEFAULT_FMIN,
+                                                  SPECTRUM_DEFAULT_FMAX);
+        BinnerBenchmark mel_binned(*mel, fft.grain()->norm);
+        report("mel_binner", size, mel_binned);
+        delete mel;
+
+        PitchBenchmark pitch(size);
+        report("pitch_yinfft", size, pitch);
+
+        OnsetBenchmark onset(size);
+        report("onset_mkl", size, onset);
+
+        SharedPitchBenchmark shared_pitch(size, fft.grain());
+        report("pitch_yinfft_shared", size, shared_pitch);
+
+        SharedOnsetBenchmark shared_onset(size, fft.grain());
+        report("onset_mkl_shared", size, shared_onset);
+
+        TempoBenchmark tempo(size);
+        double tempo_ns = report("tempo_tracker", size, tempo);
+        if (tempo_ns > TEMPO_MAX_LOAD * 1e9 * size / SAMPLERATE) {
+            fprintf(stderr, "Tempo tracking takes %.0f ns per %u-sample hop, over %g%% "
+                    "of real time\n", tempo_ns, size, TEMPO_MAX_LOAD * 100);
+            return 1;
+        }
+    }
+
+    DatagramBenchmark fft_dgram(MSG_FFT);
+    report("dgram_fft", LOG_SPECTRUM_SIZE, fft_dgram);
+    DatagramBenchmark onset_dgram(MSG_ONSET);
+    report("dgram_onset", 1, onset_dgram);
+    DatagramBenchmark pitch_dgram(MSG_PITCH);
+    report("dgram_pitch", 2, pitch_dgram);
+    DatagramBenchmark frame_dgram(MSG_FRAME);
+    report("dgram_frame", LOG_SPECTRUM_SIZE, frame_dgram);
+    DatagramBenchmark short_frame_dgram(MSG_FRAME, false);
+    report("dgram_frame", 0, short_frame_dgram);
+
+    // The size column is the encoded spectrum in bytes
+    static const struct {
+        const char *name;
+        SpectrumCodec::Encoding encoding;
+        bool delta;
+    } encodings[] = {
+        { "spectrum_encode_float", SpectrumCodec::ENCODING_FLOAT, false },
+        { "spectrum_encode_log16", SpectrumCodec::ENCODING_LOG16, false },
+        { "spectrum_encode_log16_delta", SpectrumCodec::ENCODING_LOG16, true },
+        { "spectrum_encode_log8", SpectrumCodec::ENCODING_LOG8, false },
+        { "spectrum_encode_log8_delta", SpectrumCodec::ENCODING_LOG8, true },
+    };
+    for (unsigned int i = 0; i < sizeof(encodings) / sizeof(encodings[0]); i++) {
+        SpectrumEncodeBenchmark encode(encodings[i].encoding, encodings[i].delta);
+        report(encodings[i].name, encode.encoded_size(), encode);
+    }
+
+    SpectrumGateBenchmark gate;
+    report("spectrum_gate", LOG_SPECTRUM_SIZE, gate);
+
+    // The size column is the hop
+    EnvelopeBenchmark envelope(256, 1);
+    report("envelope_follower", 256, envelope);
+    EnvelopeBenchmark envelope_steps(256, 4);
+    report("envelope_follower_4_steps", 256, envelope_steps);
+    // The step kernel is picked on the first hop
+    Kernels::set_generic(true);
+    EnvelopeBenchmark generic_envelope(256, 1);
+    generic_envelope.run();
+    Kernels::set_generic(false);
+    report("envelope_follower_generic", 256, generic_envelope);
+
+    HandoffBenchmark handoff;
+    report("handoff_frame", LOG_SPECTRUM_SIZE, handoff);
+
+    return 0;
+}
+
+
+int main(int argc, char** argv)
+{
+    // For the sockets in check_handoff_allocations()
+    QCoreApplication app(argc, argv);
+
+    if (argc > 1) {
+        min_ns = atoi(argv[1]) * 1000000LL;
+    }
+
+    int ret = run_benchmarks();
+
+    // Only once every FFT plan is gone
+    aubio_cleanup();
+
+    return ret;
+}
@@ -0,0 +1,58 @@
+TEMPLATE = app
+CONFIG += qt release console
+CONFIG -= app_bundle
+TARGET = firemix-audio-bench
+QT += core network
+DEFINES += QT_DLL QT_NETWORK_LIB
+INCLUDEPATH += ../src
+
+SOURCES +=  bench.cpp \
+			../src/analyzer.cpp \
+			../src/file_source.cpp \
+			../src/sliding_window.cpp \
+			../src/stats.cpp \
+			../src/spectrum.cpp \
+			../src/spectrum_gate.cpp \
+			../src/envelope_follower.cpp \
+			../src/frame_kernels.cpp \
+			../src/onset_detector.cpp \
+			../src/tempo_tracker.cpp \
+			../src/load_budget.cpp \
+			../src/pitch_detector.cpp \
+			../src/frame_queue.cpp \
+			../src/spectrum_codec.cpp \
+			../src/networking.cpp
+
+HEADERS +=  ../src/analyzer.h \
+			../src/audio_source.h \
+			../src/file_source.h \
+			../src/sliding_window.h \
+			../src/stats.h \
+			../src/spectrum.h \
+			../src/spectrum_gate.h \
+			../src/envelope_follower.h \
+			../src/frame_kernels.h \
+			../src/onset_detector.h \
+			../src/tempo_tracker.h \
+			../src/load_budget.h \
+			../src/pitch_detector.h \
+			../src/analysis_frame.h \
+			../src/frame_queue.h \
+			../src/byte_order.h \
+			../src/spectrum_codec.h \
+			../src/frame_sink.h \
+			../src/networking.h
+
+# qmake CONFIG+=avx builds the SIMD kernels with AVX instead of SSE
+avx:!win32 {
+    QMAKE_CXXFLAGS += -mavx
+}
+
+win32 {
+    INCLUDEPATH += "G:\Program Files (x86)\Jack\includes" "G:\code\aubio\src"
+    LIBS += -L"G:/Program Files (x86)/Jack/lib" -L"G:/code/aubio-0.4.1.win32_binary" -laubio-4 "G:/Program Files (x86)/Jack/lib/libjack.lib"
+}
+
+!win32{
+    LIBS += -ljack -laubio -L/usr/local/lib
+}
@@ -6,10 +6,69 @@ DEFINES += QT_DLL QT_NETWORK_LIB
 
 SOURCES +=  src/main.cpp \
 			src/jack_client.cpp \
-			src/networking.cpp
+			src/file_source.cpp \
+			src/analyzer.cpp \
+			src/spectrum.cpp \
+			src/spectrum_gate.cpp \
+			src/envelope_follower.cpp \
+			src/frame_kernels.cpp \
+			src/onset_detector.cpp \
+			src/tempo_tracker.cpp \
+			src/load_budget.cpp \
+			src/pitch_detector.cpp \
+			src/sliding_window.cpp \
+			src/analysis_thread.cpp \
+			src/worker_pool.cpp \
+			src/realtime.cpp \
+			src/frame_queue.cpp \
+			src/frame_sender.cpp \
+			src/stats.cpp \
+			src/spectrum_codec.cpp \
+			src/networking.cpp \
+			src/frame_writer.cpp \
+			src/frame_recorder.cpp
 
-HEADERS +=  src/jack_client.h \
-			src/networking.h
+HEADERS +=  src/audio_source.h \
+			src/jack_client.h \
+			src/file_source.h \
+			src/analysis_frame.h \
+			src/analyzer.h \
+			src/spectrum.h \
+			src/spectrum_gate.h \
+			src/envelope_follower.h \
+			src/frame_kernels.h \
+			src/onset_detector.h \
+			src/tempo_tracker.h \
+			src/load_budget.h \
+			src/pitch_detector.h \
+			src/sliding_window.h \
+			src/analysis_thread.h \
+			src/worker_pool.h \
+			src/realtime.h \
+			src/frame_queue.h \
+			src/frame_sender.h \
+			src/frame_sink.h \
+			src/stats.h \
+			src/byte_order.h \
+			src/spectrum_codec.h \
+			src/networking.h \
+			src/frame_writer.h \
+			src/recording.h \
+			src/frame_recorder.h
+
+# qmake CONFIG+=avx builds the SIMD kernels with AVX instead of SSE
+avx:!win32 {
+    QMAKE_CXXFLAGS += -mavx
+}
+
+# qmake CONFIG+=rtcheck builds a test binary that aborts if the JACK process
+# callback allocates or locks, or an analysis job allocates, and checks at
+# startup that it does
+rtcheck:linux {
+    DEFINES += RT_CHECKS
+    SOURCES += src/rt_checks.cpp
+    LIBS += -ldl
+}
 
 win32 {
     INCLUDEPATH += "G:\Program Files (x86)\Jack\includes" "G:\code\aubio\src"
@@ -17,5 +76,14 @@ win32 {
 }
 
 !win32{
+    SOURCES += src/shm_ring.cpp \
+			src/shm_publisher.cpp
+    HEADERS += src/shm_ring.h \
+			src/shm_publisher.h
     LIBS += -ljack -laubio -L/usr/local/lib
 }
+
+# shm_open() lives in librt on older glibc
+unix:!macx {
+    LIBS += -lrt
+}
@@ -0,0 +1,139 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _ANALYSIS_FRAME_H
+#define _ANALYSIS_FRAME_H
+
+#include "audio_source.h"
+
+// Most spectrum bands a frame can carry (--bands)
+#define MAX_BANDS 1024
+
+// Pitch classes in a chroma, and most mel bands a frame can carry (--mel)
+#define CHROMA_BINS 12
+#define MAX_MEL_BANDS 128
+
+// Most envelope follower bands, and steps (sub-hops) per hop
+#define MAX_ENVELOPE_BANDS 8
+#define MAX_ENVELOPE_STEPS 16
+
+// Upcoming beats predicted in each frame with a tempo
+#define TEMPO_PREDICTED_BEATS 4
+
+// Most analysis chains per channel, each with its own window and hop and
+// publishing its own frames
+#define MAX_CHAINS 2
+
+
+// Points in a hop's life at which it is timestamped, for Stats
+enum FrameStamp
+{
+  STAMP_START,      // analysis started
+  STAMP_FFT,
+  STAMP_SPECTRUM,
+  STAMP_PITCH,
+  STAMP_ONSET,
+  STAMP_TEMPO,
+  STAMP_ENVELOPE,   // analysis finished
+  STAMP_TAKEN,      // picked up by the sender
+  STAMP_SENT,
+  NUM_STAMPS
+};
+
+
+// One envelope band's levels over one step, as linear amplitudes
+struct EnvelopeLevels
+{
+  float envelope;   // RMS smoothed with the attack and release times
+  float peak;
+  float rms;
+};
+
+
+// Everything one Analyzer found in one hop.  Frames come from the analyzer's
+// pool and go back to it once the sink returns, so sinks must not keep them.
+// An analyzer that doesn't run a stage leaves its fields unset: onset false,
+// has_pitch, has_spectrum, has_chroma, has_mel, has_envelope or has_tempo
+// false.
+struct AnalysisFrame
+{
+  int channel;
+  int samplerate;
+
+  // JACK frame time (for files, the sample position) just past the hop's
+  // last sample
+  jack_nframes_t time;
+
+  bool onset;
+
+  // Tempo in BPM, its confidence (0 to 1), the position within the current
+  // beat (0 on the beat, approaching 1 just before the next) and the frame
+  // times of the next TEMPO_PREDICTED_BEATS beats; only filled in when
+  // has_tempo is set
+  bool has_tempo;
+  float bpm;
+  float tempo_confidence;
+  float beat_phase;
+  jack_nframes_t next_beats[TEMPO_PREDICTED_BEATS];
+
+  // Pitch in Hz and its confidence, only filled in when has_pitch is set
+  bool has_pitch;
+  float pitch;
+  float confidence;
+
+  // Spectrum bands, only filled in when has_spectrum is set
+  bool has_spectrum;
+  unsigned int bands;
+  float spectrum[MAX_BANDS];
+
+  // Chroma, one level per pitch class from C up, and mel band levels, only
+  // filled in when has_chroma or has_mel is set.  A mel band is the average
+  // magnitude under its filter, a pitch class the sum of its notes' averages.
+  bool has_chroma;
+  float chroma[CHROMA_BINS];
+  bool has_mel;
+  unsigned int mel_bands;
+  float mel[MAX_MEL_BANDS];
+
+  // Band levels over each of envelope_steps equal steps of
+  // envelope_step_frames frames, oldest first, the last ending at time;
+  // only filled in when has_envelope is set
+  bool has_envelope;
+  unsigned int envelope_bands;
+  unsigned int envelope_steps;
+  unsigned int envelope_step_frames;
+  EnvelopeLevels envelopes[MAX_ENVELOPE_STEPS][MAX_ENVELOPE_BANDS];
+
+  // Load of the analysis as a fraction of real time, and the shed level
+  // (SHED_* in load_budget.h) this hop ran at; only filled in when has_load
+  // is set, which it is for live input
+  bool has_load;
+  float load;
+  unsigned int shed_level;
+
+  // Stats::now() when the hop's last sample was captured, and at each
+  // FrameStamp
+  jack_time_t captured;
+  jack_time_t stamps[NUM_STAMPS];
+};
+
+#endif
@@ -0,0 +1,198 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "analysis_thread.h"
+
+
+AnalysisThread::AnalysisThread(AudioSource *source, Analyzer **analyzers,
+                               unsigned int count, unsigned int workers,
+                               const RealtimeConfig& realtime, float budget)
+    : _source(source), _realtime(realtime), _pool(workers, realtime), _num_jobs(count),
+      _budget(source->samplerate(), budget)
+{
+  if (realtime.lock_memory)
+  {
+    setStackSize(RT_STACK_SIZE);
+  }
+
+  _channels = source->channels();
+  _running = true;
+  _reported_overflows = 0;
+  _budget_overflows = 0;
+  _frames = 0;
+
+  // Each channel's history holds the longest window of its chains, plus the
+  // chunk that completes it
+  for (unsigned int c = 0; c < _channels; c++)
+  {
+    unsigned int longest = 0;
+    for (unsigned int i = 0; i < count; i++)
+    {
+      if (analyzers[i]->channel() == (int)c && analyzers[i]->window_size() > longest)
+      {
+        longest = analyzers[i]->window_size();
+      }
+    }
+    _histories[c] = new SlidingWindow(longest + BUF_SIZE);
+    _chunks[c] = _samples[c];
+  }
+
+  for (unsigned int i = 0; i < _num_jobs; i++)
+  {
+    _jobs[i].analyzer = analyzers[i];
+    _jobs[i].history = _histories[analyzers[i]->channel()];
+    _pool.add_job(&_jobs[i]);
+  }
+}
+
+
+AnalysisThread::~AnalysisThread()
+{
+  stop();
+  for (unsigned int c = 0; c < _channels; c++)
+  {
+    delete _histories[c];
+  }
+}
+
+
+void AnalysisThread::stop(void)
+{
+  _running = false;
+  wait();
+}
+
+
+void AnalysisThread::run(void)
+{
+  Realtime::configure_thread(_realtime, 0);
+  _timer.start();
+
+  while (_running)
+  {
+    jack_nframes_t time;
+    int n = _source->read(_chunks, BUF_SIZE, &time);
+
+    if (n < 0)
+    {
+      break;
+    }
+
+    if (n == 0)
+    {
+      report_overflows();
+      usleep(ANALYSIS_IDLE_USEC);
+      continue;
+    }
+
+    // Every chain reads the chunk straight out of its channel's history
+    for (unsigned int c = 0; c < _channels; c++)
+    {
+      _histories[c]->push(_chunks[c], n);
+    }
+
+    jack_time_t captured = _source->capture_usecs(time);
+    for (unsigned int i = 0; i < _num_jobs; i++)
+    {
+      _jobs[i].nframes = n;
+      _jobs[i].time = time;
+      _jobs[i].captured = captured;
+    }
+    jack_time_t started = Stats::now();
+    _pool.run();
+    if (_source->is_realtime())
+    {
+      update_load(Stats::now() - started, n);
+    }
+    _frames += n;
+  }
+
+  report_overflows();
+  if (!_source->is_realtime())
+  {
+    report_throughput();
+  }
+}
+
+
+// The critical path of a round, from handing out the jobs to the last one
+// finishing, against the audio it covered
+void AnalysisThread::update_load(jack_time_t busy, unsigned int nframes)
+{
+  float stage_load[NUM_SHED_LEVELS];
+  for (int level = 0; level < NUM_SHED_LEVELS; level++)
+  {
+    stage_load[level] = 0;
+    for (unsigned int i = 0; i < _num_jobs; i++)
+    {
+      stage_load[level] += _jobs[i].analyzer->stage_load(level);
+    }
+  }
+
+  int overflows = _source->overflows();
+  bool overflowed = overflows != _budget_overflows;
+  _budget_overflows = overflows;
+
+  if (_budget.update(busy, nframes, overflowed, stage_load))
+  {
+    if (_budget.level() == SHED_NONE)
+    {
+      qDebug("DSP load %.0f%% of real time: running every stage again",
+             _budget.load() * 100);
+    }
+    else
+    {
+      qDebug("DSP load %.0f%% of real time: shedding %s", _budget.load() * 100,
+             LoadBudget::level_name(_budget.level()));
+    }
+  }
+
+  for (unsigned int i = 0; i < _num_jobs; i++)
+  {
+    _jobs[i].analyzer->set_load(_budget.load(), _budget.level());
+  }
+}
+
+
+// Logging is deferred to here so that the process callback only has to bump
+// a counter when it drops a period.
+void AnalysisThread::report_overflows(void)
+{
+  int overflows = _source->overflows();
+
+  if (overflows != _reported_overflows)
+  {
+    qDebug("Analysis fell behind: %d periods (%d frames) dropped so far",
+           overflows, _source->dropped_frames());
+    _reported_overflows = overflows;
+  }
+}
+
+
+void AnalysisThread::report_throughput(void)
+{
+  double elapsed = _timer.nsecsElapsed() / 1e9;
+  double duration = (double)_frames / _source->samplerate();
+
+  qDebug("Analysed %.1f s of audio in %.2f s (%.1fx realtime)",
+         duration, elapsed, elapsed > 0 ? duration / elapsed : 0.0);
+}
@@ -0,0 +1,110 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _ANALYSIS_THREAD_H
+#define _ANALYSIS_THREAD_H
+
+#include <QtCore/QThread>
+#include <QtCore/QElapsedTimer>
+
+#include "audio_source.h"
+#include "analyzer.h"
+#include "worker_pool.h"
+#include "realtime.h"
+#include "load_budget.h"
+
+// How long the analysis thread sleeps when a realtime source runs dry
+#define ANALYSIS_IDLE_USEC 500
+
+
+// Pulls samples from an AudioSource into one SlidingWindow per channel and
+// runs every channel's Analyzers over it, spreading them over a WorkerPool.
+// Everything downstream of the JACK process callback runs on this thread or
+// the pool's workers.  The thread finishes by itself when an offline source
+// reaches its end.
+class AnalysisThread : public QThread
+{
+  Q_OBJECT
+
+public:
+  // Each analyzer handles its channel() of the source; there may be several
+  // per channel.  Analyzer n runs on worker n % workers, so listing every
+  // channel's first chain, then every channel's second, and so on, puts a
+  // channel's chains on different cores when there are enough.  realtime
+  // applies to this thread and the workers alike.  With a realtime source,
+  // stages are shed to keep the analysis within budget (a share of real
+  // time, 0 for no limit; see LoadBudget).
+  AnalysisThread(AudioSource *source, Analyzer **analyzers, unsigned int count,
+                 unsigned int workers, const RealtimeConfig& realtime, float budget);
+  ~AnalysisThread();
+
+  void stop(void);
+
+protected:
+  void run(void);
+
+private:
+  // One analyzer's share of a chunk, which must not allocate (checked in an
+  // RT_CHECKS build); the workers do block on the pool's semaphores between
+  // jobs, though, so locks are allowed
+  class ChainJob : public WorkerPool::Job
+  {
+  public:
+    void run(void)
+    {
+      Realtime::begin_checked(RT_CHECK_ALLOC);
+      analyzer->process(*history, nframes, time, captured);
+      Realtime::end_checked();
+    }
+
+    Analyzer *analyzer;
+    const SlidingWindow *history;
+    unsigned int nframes;
+    jack_nframes_t time;
+    jack_time_t captured;
+  };
+
+  void update_load(jack_time_t busy, unsigned int nframes);
+  void report_overflows(void);
+  void report_throughput(void);
+
+  AudioSource *_source;
+  RealtimeConfig _realtime;
+  unsigned int _channels;
+  volatile bool _running;
+
+  WorkerPool _pool;
+  ChainJob _jobs[MAX_CHANNELS * MAX_CHAINS];
+  unsigned int _num_jobs;
+  SlidingWindow *_histories[MAX_CHANNELS];
+  sample_t _samples[MAX_CHANNELS][BUF_SIZE];
+  sample_t *_chunks[MAX_CHANNELS];
+  int _reported_overflows;
+
+  LoadBudget _budget;
+  int _budget_overflows;
+
+  QElapsedTimer _timer;
+  qint64 _frames;
+};
+
+#endif
@@ -0,0 +1,359 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <string.h>
+
+#include "analyzer.h"
+
+// Weight of each hop in the average stage costs
+#define STAGE_COST_SMOOTHING 0.05f
+
+AnalyzerConfig::AnalyzerConfig()
+{
+  window_size = DEFAULT_WINDOW_SIZE;
+  hop_size = DEFAULT_HOP_SIZE;
+  window_type = DEFAULT_WINDOW_TYPE;
+  stages = CHAIN_ALL;
+  spectrum_threshold = SPECTRUM_GATE_DEFAULT_THRESHOLD_DB;
+  spectrum_min_rate = SPECTRUM_GATE_DEFAULT_MIN_RATE;
+  spectrum_max_rate = SPECTRUM_GATE_DEFAULT_MAX_RATE;
+  bands = 0;
+  fmin = SPECTRUM_DEFAULT_FMIN;
+  fmax = SPECTRUM_DEFAULT_FMAX;
+  mel_bands = 0;
+  envelope_crossovers = 2;
+  envelope_crossover[0] = 250;
+  envelope_crossover[1] = 4000;
+  envelope_steps = 1;
+  envelope_attack_ms = ENVELOPE_DEFAULT_ATTACK_MS;
+  envelope_release_ms = ENVELOPE_DEFAULT_RELEASE_MS;
+}
+
+
+Analyzer::Analyzer(int channel, int samplerate, const AnalyzerConfig& config)
+    : _channel(channel), _window_size(config.window_size), _hop_size(config.hop_size),
+      _samplerate(samplerate), _stages(config.stages), _to_next_hop(config.hop_size),
+      _gate(samplerate, config.spectrum_threshold, config.spectrum_min_rate,
+            config.spectrum_max_rate),
+      _has_load(false), _load(0), _shed(SHED_NONE), _hops(0), _spectrum_frames(0)
+{
+  _fft = new_aubio_fft(_window_size);
+  _grain = new_cvec(_window_size);
+
+  char window_type[32];
+  strncpy(window_type, config.window_type, sizeof(window_type) - 1);
+  window_type[sizeof(window_type) - 1] = 0;
+  _window = new_aubio_window(window_type, _window_size);
+  if (!_window)
+  {
+    qDebug() << "Unknown window type" << config.window_type << "- using ones";
+    char ones[] = "ones";
+    _window = new_aubio_window(ones, _window_size);
+  }
+  _windowed = new_fvec(_window_size);
+
+  if (config.bands == 0 && _window_size == 1024)
+  {
+    _binner = new SpectrumBinner();
+  }
+  else
+  {
+    // The legacy layout only exists for 1024-point frames
+    _binner = new SpectrumBinner(_window_size, _samplerate,
+                                 config.bands ? config.bands : LOG_SPECTRUM_SIZE,
+                                 config.fmin, config.fmax);
+  }
+
+  _chroma = NULL;
+  if (_stages & CHAIN_CHROMA)
+  {
+    _chroma = SpectrumBinner::chroma(_window_size, _samplerate);
+  }
+  _mel = NULL;
+  if (_stages & CHAIN_MEL)
+  {
+    _mel = SpectrumBinner::mel(_window_size, _samplerate, config.mel_bands,
+                               config.fmin, config.fmax);
+  }
+
+  static const WindowKernel window_kernels[NUM_KERNEL_SIZES] = KERNEL_TABLE(window_kernel);
+  static const LevelKernel level_kernels[NUM_KERNEL_SIZES] = KERNEL_TABLE(level_kernel);
+  _window_kernel = window_kernels[Kernels::index(_window_size)];
+  _level_kernel = level_kernels[Kernels::index(_hop_size)];
+
+  float window_sum = 0;
+  for (unsigned int i = 0; i < _window_size; i++)
+  {
+    window_sum += _window->data[i];
+  }
+  _window_gain = window_sum > 0 ? _window_size / window_sum : 1;
+
+  _onset = NULL;
+  if (_stages & CHAIN_ONSET)
+  {
+    _onset = new OnsetDetector("mkl", _window_size, _hop_size, _samplerate);
+    _onset->set_threshold(0.3);
+    _onset->set_silence(-70.0);
+    _onset->set_minioi_ms(250);
+  }
+
+  _tempo = NULL;
+  if ((_stages & CHAIN_TEMPO) && (_stages & CHAIN_ONSET))
+  {
+    _tempo = new TempoTracker(_hop_size, _samplerate);
+  }
+
+  _pitch = NULL;
+  if (_stages & CHAIN_PITCH)
+  {
+    _pitch = new PitchDetector(_window_size, _samplerate);
+  }
+
+  _envelope = NULL;
+  _envelope_steps = config.envelope_steps;
+  if (_stages & CHAIN_ENVELOPE)
+  {
+    _envelope = new EnvelopeFollower(_samplerate, config.envelope_crossover,
+                                     config.envelope_crossovers,
+                                     config.envelope_attack_ms, config.envelope_release_ms);
+  }
+
+  // The FFT stops being needed once the last stage using it is shed
+  if (_stages & CHAIN_ONSET)
+  {
+    _fft_level = SHED_ONSET;
+  }
+  else if (_stages & (CHAIN_SPECTRUM | CHAIN_CHROMA | CHAIN_MEL))
+  {
+    _fft_level = SHED_SPECTRUM;
+  }
+  else
+  {
+    _fft_level = SHED_PITCH;
+  }
+  for (int i = 0; i < NUM_SHED_LEVELS; i++)
+  {
+    _cost[i] = 0;
+  }
+}
+
+
+Analyzer::~Analyzer()
+{
+  delete _onset;
+  delete _tempo;
+  delete _pitch;
+  delete _envelope;
+  del_aubio_fft(_fft);
+  del_cvec(_grain);
+  delete _binner;
+  delete _chroma;
+  delete _mel;
+  del_fvec(_window);
+  del_fvec(_windowed);
+}
+
+
+void Analyzer::set_load(float load, unsigned int shed)
+{
+  _has_load = true;
+  _load = load;
+  _shed = shed;
+}
+
+
+float Analyzer::stage_load(unsigned int level) const
+{
+  return _cost[level] * 1e-6f * _samplerate / _hop_size;
+}
+
+
+void Analyzer::process(const SlidingWindow& history, unsigned int nframes,
+                       jack_nframes_t time, jack_time_t captured)
+{
+  unsigned int offset = 0;
+
+  while (nframes - offset >= _to_next_hop)
+  {
+    // The hop ends offset samples into this chunk
+    offset += _to_next_hop;
+    _to_next_hop = _hop_size;
+
+    unsigned int age = nframes - offset;
+    process_hop(history.data(_window_size, age), history.data(_hop_size, age),
+                time + offset, captured + (jack_time_t)offset * 1000000 / _samplerate);
+  }
+
+  _to_next_hop -= nframes - offset;
+}
+
+
+// frame is the window ending with the hop, both straight out of the history
+void Analyzer::process_hop(const sample_t *frame, const sample_t *hop,
+                           jack_nframes_t end_time, jack_time_t captured)
+{
+  jack_time_t start = Stats::now();
+
+  // What this hop runs, given the shed level
+  bool ran[NUM_SHED_LEVELS];
+  ran[SHED_NONE] = false;
+  ran[SHED_PITCH] = _pitch != NULL && _shed < SHED_PITCH;
+  ran[SHED_SPECTRUM] = (_stages & (CHAIN_SPECTRUM | CHAIN_CHROMA | CHAIN_MEL))
+                       && (_shed < SHED_SPECTRUM || _hops % SHED_SPECTRUM_DECIMATION == 0);
+  ran[SHED_ONSET] = _onset != NULL
+                    && (_shed < SHED_ONSET || _hops % SHED_ONSET_DECIMATION == 0);
+  bool fft = ran[SHED_PITCH] || ran[SHED_SPECTRUM] || ran[SHED_ONSET];
+  _hops++;
+  _spectrum_frames += _hop_size;
+
+  if (fft)
+  {
+    _window_kernel(frame, _window->data, _windowed->data, _window_size);
+    aubio_fft_do(_fft, _windowed, _grain);
+  }
+
+  AnalysisFrame *result = _queue.acquire();
+  if (result == NULL)
+  {
+    result = &_scratch;
+  }
+
+  result->channel = _channel;
+  result->samplerate = _samplerate;
+  result->time = end_time;
+  result->bands = _binner->bands();
+  result->captured = captured;
+  result->stamps[STAMP_START] = start;
+  result->stamps[STAMP_FFT] = Stats::now();
+
+  result->has_spectrum = false;
+  if (ran[SHED_SPECTRUM] && (_stages & CHAIN_SPECTRUM))
+  {
+    _binner->apply(_grain->norm, result->spectrum);
+    for (unsigned int i = 0; i < result->bands; i++)
+    {
+      result->spectrum[i] *= _window_gain;
+    }
+    result->has_spectrum = _gate.update(result->spectrum, result->bands, _spectrum_frames);
+    _spectrum_frames = 0;
+  }
+
+  // Sent on every hop they run on; at a dozen or two bands they are cheap
+  // enough not to need gating
+  result->has_chroma = ran[SHED_SPECTRUM] && _chroma != NULL;
+  if (result->has_chroma)
+  {
+    _chroma->apply(_grain->norm, result->chroma);
+    for (unsigned int i = 0; i < CHROMA_BINS; i++)
+    {
+      result->chroma[i] *= _window_gain;
+    }
+  }
+  result->has_mel = ran[SHED_SPECTRUM] && _mel != NULL;
+  if (result->has_mel)
+  {
+    result->mel_bands = _mel->bands();
+    _mel->apply(_grain->norm, result->mel);
+    for (unsigned int i = 0; i < result->mel_bands; i++)
+    {
+      result->mel[i] *= _window_gain;
+    }
+  }
+  result->stamps[STAMP_SPECTRUM] = Stats::now();
+
+  result->has_pitch = ran[SHED_PITCH];
+  result->pitch = 0;
+  result->confidence = 0;
+  if (result->has_pitch)
+  {
+    result->pitch = _pitch->detect(_grain);
+    result->confidence = _pitch->confidence();
+  }
+  result->stamps[STAMP_PITCH] = Stats::now();
+
+  result->onset = false;
+  if (ran[SHED_ONSET])
+  {
+    result->onset = _onset->detect(_grain, _level_kernel(hop, _hop_size));
+  }
+  else if (_onset)
+  {
+    _onset->skip();
+  }
+  result->stamps[STAMP_ONSET] = Stats::now();
+
+  // A skipped hop repeats the last novelty, which keeps the beat grid
+  // steady
+  result->has_tempo = false;
+  if (_tempo)
+  {
+    _tempo->process(_onset->novelty());
+    result->has_tempo = _tempo->bpm() > 0;
+    result->bpm = _tempo->bpm();
+    result->tempo_confidence = _tempo->confidence();
+    result->beat_phase = _tempo->phase();
+    for (int i = 0; i < TEMPO_PREDICTED_BEATS; i++)
+    {
+      result->next_beats[i] = end_time + (jack_nframes_t)(_tempo->beat_in(i) + 0.5);
+    }
+  }
+  result->stamps[STAMP_TEMPO] = Stats::now();
+
+  result->has_envelope = _envelope != NULL;
+  if (result->has_envelope)
+  {
+    result->envelope_bands = _envelope->bands();
+    result->envelope_steps = _envelope_steps;
+    result->envelope_step_frames = _hop_size / _envelope_steps;
+    _envelope->process(hop, _hop_size, _envelope_steps, result->envelopes);
+  }
+  result->stamps[STAMP_ENVELOPE] = Stats::now();
+
+  result->has_load = _has_load;
+  result->load = _load;
+  result->shed_level = _shed;
+
+  // A stage is only measured on hops it ran on, so a decimated stage's cost
+  // is still that of running it on every hop
+  float cost[NUM_SHED_LEVELS];
+  cost[SHED_NONE] = 0;
+  cost[SHED_PITCH] = result->stamps[STAMP_PITCH] - result->stamps[STAMP_SPECTRUM];
+  cost[SHED_SPECTRUM] = result->stamps[STAMP_SPECTRUM] - result->stamps[STAMP_FFT];
+  cost[SHED_ONSET] = result->stamps[STAMP_ONSET] - result->stamps[STAMP_PITCH];
+  cost[_fft_level] += result->stamps[STAMP_FFT] - start;
+  for (int i = SHED_PITCH; i < NUM_SHED_LEVELS; i++)
+  {
+    if (ran[i])
+    {
+      _cost[i] += STAGE_COST_SMOOTHING * (cost[i] - _cost[i]);
+    }
+  }
+
+  if (result == &_scratch)
+  {
+    _queue.count_dropped();
+  }
+  else
+  {
+    _queue.publish(result);
+  }
+}
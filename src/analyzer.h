@@ -0,0 +1,211 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _ANALYZER_H
+#define _ANALYZER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QDebug>
+
+// TODO: Make this less dumb by requiring Win32 to have aubio.h in the same place?
+#ifdef __MINGW32__
+#include <aubio.h>
+#else
+#include <aubio/aubio.h>
+#endif
+
+// Largest chunk handed to Analyzer::process() by the analysis thread
+#define BUF_SIZE 1024
+
+#define DEFAULT_WINDOW_SIZE 1024
+#define DEFAULT_HOP_SIZE 1024
+#define DEFAULT_WINDOW_TYPE "hanningz"
+
+// Analysis stages, as a bit mask
+#define CHAIN_SPECTRUM 0x01
+#define CHAIN_PITCH 0x02
+#define CHAIN_ONSET 0x04
+#define CHAIN_ENVELOPE 0x08
+// Beat tracking, which runs on the onset detection function and so only
+// with CHAIN_ONSET
+#define CHAIN_TEMPO 0x10
+// Chroma and mel bands, binned from the same FFT as the spectrum and shed
+// along with it
+#define CHAIN_CHROMA 0x20
+#define CHAIN_MEL 0x40
+#define CHAIN_ALL (CHAIN_SPECTRUM | CHAIN_PITCH | CHAIN_ONSET | CHAIN_TEMPO)
+
+#include "audio_source.h"
+#include "analysis_frame.h"
+#include "frame_queue.h"
+#include "sliding_window.h"
+#include "spectrum.h"
+#include "spectrum_gate.h"
+#include "onset_detector.h"
+#include "pitch_detector.h"
+#include "envelope_follower.h"
+#include "tempo_tracker.h"
+#include "load_budget.h"
+#include "frame_kernels.h"
+#include "stats.h"
+
+
+struct AnalyzerConfig
+{
+  AnalyzerConfig();
+
+  // Analysis frame length (a power of two) and the number of new samples
+  // between frames.  A hop shorter than the window gives overlapping frames
+  // and more frequent onset/pitch decisions.
+  unsigned int window_size;
+  unsigned int hop_size;
+
+  // Any window name aubio knows, e.g. "ones", "hanning", "hanningz",
+  // "hamming", "blackman", "blackman_harris"
+  const char *window_type;
+
+  // Which stages this chain runs (CHAIN_*)
+  unsigned int stages;
+
+  // When to send a spectrum: on a change of at least spectrum_threshold dB
+  // RMS, at most spectrum_max_rate and at least spectrum_min_rate times a
+  // second (see SpectrumGate)
+  float spectrum_threshold;
+  float spectrum_min_rate;
+  float spectrum_max_rate;
+
+  // Spectrum layout: up to MAX_BANDS bands log-spaced between fmin and fmax
+  // Hz, or the legacy FireMix layout if bands is 0
+  unsigned int bands;
+  float fmin;
+  float fmax;
+
+  // Mel bands (CHAIN_MEL), up to MAX_MEL_BANDS between fmin and fmax Hz
+  unsigned int mel_bands;
+
+  // Envelope followers (CHAIN_ENVELOPE): one band below the first
+  // crossover, between each pair and above the last; steps per hop, which
+  // must divide the hop; and attack and release times
+  unsigned int envelope_crossovers;
+  float envelope_crossover[MAX_ENVELOPE_BANDS - 1];
+  unsigned int envelope_steps;
+  float envelope_attack_ms;
+  float envelope_release_ms;
+};
+
+
+// Runs an analysis chain (spectrum, chroma, mel bands, pitch, onset, tempo,
+// band envelopes, or some of them) over one channel.  Each hop computes a single windowed FFT, which the
+// stages share, and publishes the results together as one AnalysisFrame on
+// the analyzer's queue.  A channel can have several chains with different
+// windows and hops, e.g. a short one for onsets and a long one for spectrum
+// and pitch; they all read from the channel's one SlidingWindow.  Under
+// load, stages are shed as a LoadBudget directs, and the FFT is skipped on
+// hops where no stage is left to use it.  This is never called from the
+// JACK process callback; see AnalysisThread.
+class Analyzer : public QObject
+{
+  Q_OBJECT
+
+public:
+  Analyzer(int channel, int samplerate, const AnalyzerConfig& config);
+  ~Analyzer();
+
+  // Called after each chunk of nframes samples is pushed to history, which
+  // must hold at least window_size() + nframes samples; analysis runs once
+  // per complete hop.  time is the frame time of the chunk's first sample
+  // and captured when it was captured, by Stats::now().
+  void process(const SlidingWindow& history, unsigned int nframes,
+               jack_nframes_t time, jack_time_t captured);
+
+  int channel(void) const { return _channel; }
+  unsigned int window_size(void) const { return _window_size; }
+
+  // The current load and shed level (SHED_*), applied from the next hop on
+  // and sent with every frame.  Not called for offline input, which is
+  // never shed.
+  void set_load(float load, unsigned int shed);
+
+  // Load, as a fraction of real time, of the stages shed at level when they
+  // run on every hop, as last measured
+  float stage_load(unsigned int level) const;
+
+  // One frame per hop is published here, for a FrameSender to pick up
+  FrameQueue *queue(void) { return &_queue; }
+
+private:
+  void process_hop(const sample_t *frame, const sample_t *hop,
+                   jack_nframes_t end_time, jack_time_t captured);
+
+  typedef void (*WindowKernel)(const sample_t *frame, const smpl_t *window, smpl_t *out,
+                               unsigned int size);
+  typedef smpl_t (*LevelKernel)(const sample_t *samples, unsigned int size);
+
+  int _channel;
+  unsigned int _window_size;
+  unsigned int _hop_size;
+  int _samplerate;
+  unsigned int _stages;
+
+  // Samples still to come before the next hop is complete
+  unsigned int _to_next_hop;
+
+  fvec_t *_window;
+  fvec_t *_windowed;
+  // For the window and the hop, chosen by their lengths
+  WindowKernel _window_kernel;
+  LevelKernel _level_kernel;
+
+  aubio_fft_t *_fft;
+  cvec_t *_grain;
+
+  SpectrumBinner *_binner;
+  SpectrumBinner *_chroma;
+  SpectrumBinner *_mel;
+  // Undoes the window's attenuation so spectrum levels don't depend on it
+  float _window_gain;
+  SpectrumGate _gate;
+
+  OnsetDetector *_onset;
+  TempoTracker *_tempo;
+  PitchDetector *_pitch;
+  EnvelopeFollower *_envelope;
+  unsigned int _envelope_steps;
+
+  bool _has_load;
+  float _load;
+  unsigned int _shed;
+  unsigned int _hops;
+  // Frames since the spectrum was last binned
+  unsigned int _spectrum_frames;
+  // Which level the FFT is saved at, and average microseconds per hop of
+  // each level's stages
+  unsigned int _fft_level;
+  float _cost[NUM_SHED_LEVELS];
+
+  FrameQueue _queue;
+  // Filled in instead of a pooled frame, and thrown away, when the pool is
+  // empty; the detectors still have to see every hop
+  AnalysisFrame _scratch;
+};
+
+#endif
@@ -0,0 +1,67 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _AUDIO_SOURCE_H
+#define _AUDIO_SOURCE_H
+
+#include <jack/jack.h>
+
+typedef jack_default_audio_sample_t sample_t;
+
+
+// Upper bound on input channels, so per-channel state can live in arrays
+#define MAX_CHANNELS 16
+
+
+// Something the analysis thread can pull samples from, one buffer per
+// channel.
+//
+// Realtime sources (JACK) never block: read() returns 0 when nothing is
+// buffered yet, and data that could not be buffered is dropped and counted.
+// Offline sources (files, stdin) block on I/O instead, so they are analysed
+// as fast as the CPU allows and never drop anything.
+class AudioSource
+{
+public:
+  virtual ~AudioSource() {}
+
+  virtual int samplerate(void) const = 0;
+  virtual unsigned int channels(void) const = 0;
+  virtual bool is_realtime(void) const = 0;
+
+  // Reads up to max_frames frames, the same number for every channel, into
+  // bufs[0 .. channels() - 1].  Returns the number of frames read, 0 if none
+  // are available yet, or -1 at the end of the stream.  *time is set to the
+  // frame time of the first frame read: the JACK frame clock for JACK, the
+  // sample position for offline sources.  Like the JACK clock it wraps.
+  virtual int read(sample_t **bufs, unsigned int max_frames, jack_nframes_t *time) = 0;
+
+  // When the frame at the given frame time was captured, by Stats::now().
+  // Only meaningful for frames just returned by read().
+  virtual jack_time_t capture_usecs(jack_nframes_t time) const = 0;
+
+  // Periods (and frames) discarded because the reader fell behind
+  virtual int overflows(void) const { return 0; }
+  virtual int dropped_frames(void) const { return 0; }
+};
+
+#endif
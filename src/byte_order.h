@@ -0,0 +1,99 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _BYTE_ORDER_H
+#define _BYTE_ORDER_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Little-endian field access for the wire formats.  Each put_ writes at p and
+// returns the position after the field; each get_ does the same for reading.
+
+static inline char *put_u16(char *p, uint16_t v)
+{
+    p[0] = (char)(v & 0xff);
+    p[1] = (char)(v >> 8);
+    return p + 2;
+}
+
+
+static inline char *put_u32(char *p, uint32_t v)
+{
+    p[0] = (char)(v & 0xff);
+    p[1] = (char)((v >> 8) & 0xff);
+    p[2] = (char)((v >> 16) & 0xff);
+    p[3] = (char)(v >> 24);
+    return p + 4;
+}
+
+
+static inline char *put_u64(char *p, uint64_t v)
+{
+    p = put_u32(p, (uint32_t)v);
+    return put_u32(p, (uint32_t)(v >> 32));
+}
+
+
+static inline char *put_float(char *p, float v)
+{
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return put_u32(p, bits);
+}
+
+
+static inline const char *get_u16(const char *p, uint16_t *v)
+{
+    const unsigned char *u = (const unsigned char *)p;
+    *v = u[0] | (u[1] << 8);
+    return p + 2;
+}
+
+
+static inline const char *get_u32(const char *p, uint32_t *v)
+{
+    const unsigned char *u = (const unsigned char *)p;
+    *v = u[0] | (u[1] << 8) | (u[2] << 16) | ((uint32_t)u[3] << 24);
+    return p + 4;
+}
+
+
+static inline const char *get_u64(const char *p, uint64_t *v)
+{
+    uint32_t lo, hi;
+    p = get_u32(p, &lo);
+    p = get_u32(p, &hi);
+    *v = lo | ((uint64_t)hi << 32);
+    return p;
+}
+
+
+static inline const char *get_float(const char *p, float *v)
+{
+    uint32_t bits;
+    p = get_u32(p, &bits);
+    memcpy(v, &bits, sizeof(bits));
+    return p;
+}
+
+#endif
@@ -0,0 +1,164 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <math.h>
+
+#include "envelope_follower.h"
+
+// Q of the low-pass and high-pass bands (Butterworth)
+#define ENVELOPE_EDGE_Q 0.7071f
+
+// Added to every sample so that the filters' state never decays into
+// denormals, which are very slow on x86, during silence
+#define ENVELOPE_DENORMAL_GUARD 1e-20f
+
+
+EnvelopeFollower::EnvelopeFollower(int samplerate, const float *crossovers,
+                                   unsigned int num_crossovers,
+                                   float attack_ms, float release_ms)
+    : _samplerate(samplerate), _attack_ms(attack_ms), _release_ms(release_ms),
+      _step_frames(0), _attack(0), _release(0), _step_kernel(NULL)
+{
+  if (num_crossovers > MAX_ENVELOPE_BANDS - 1)
+  {
+    num_crossovers = MAX_ENVELOPE_BANDS - 1;
+  }
+  _bands = num_crossovers + 1;
+
+  for (unsigned int b = 0; b < MAX_ENVELOPE_BANDS; b++)
+  {
+    _b0[b] = _b1[b] = _b2[b] = _a1[b] = _a2[b] = 0;
+    _z1[b] = _z2[b] = 0;
+    _envelope[b] = 0;
+    if (b >= _bands)
+    {
+      continue;
+    }
+    if (num_crossovers == 0)
+    {
+      // A single band is the whole signal
+      _b0[b] = 1;
+      continue;
+    }
+
+    // Low-pass below the first crossover, high-pass above the last and
+    // band-pass centred (geometrically) between the others
+    float lo = b > 0 ? crossovers[b - 1] : 0;
+    float hi = b < num_crossovers ? crossovers[b] : 0;
+    float f0 = lo == 0 ? hi : hi == 0 ? lo : sqrtf(lo * hi);
+    float q = lo == 0 || hi == 0 ? ENVELOPE_EDGE_Q : f0 / (hi - lo);
+
+    float w0 = 2 * M_PI * f0 / samplerate;
+    float cosw = cosf(w0);
+    float alpha = sinf(w0) / (2 * q);
+    float a0 = 1 + alpha;
+
+    if (lo == 0)
+    {
+      _b0[b] = _b2[b] = (1 - cosw) / 2 / a0;
+      _b1[b] = (1 - cosw) / a0;
+    }
+    else if (hi == 0)
+    {
+      _b0[b] = _b2[b] = (1 + cosw) / 2 / a0;
+      _b1[b] = -(1 + cosw) / a0;
+    }
+    else
+    {
+      _b0[b] = alpha / a0;
+      _b1[b] = 0;
+      _b2[b] = -alpha / a0;
+    }
+    _a1[b] = -2 * cosw / a0;
+    _a2[b] = (1 - alpha) / a0;
+  }
+}
+
+
+void EnvelopeFollower::set_step(unsigned int step_frames)
+{
+  _step_frames = step_frames;
+  float step_ms = 1000.0f * step_frames / _samplerate;
+  _attack = _attack_ms > 0 ? expf(-step_ms / _attack_ms) : 0;
+  _release = _release_ms > 0 ? expf(-step_ms / _release_ms) : 0;
+
+  static const StepKernel kernels[NUM_KERNEL_SIZES] =
+      KERNEL_TABLE(&EnvelopeFollower::filter_step);
+  _step_kernel = kernels[Kernels::index(step_frames)];
+}
+
+
+template <unsigned int N>
+void EnvelopeFollower::filter_step(const sample_t *in, unsigned int step_frames,
+                                   float *sum, float *peak)
+{
+  const unsigned int n = N ? N : step_frames;
+  for (unsigned int i = 0; i < n; i++)
+  {
+    float x = in[i] + ENVELOPE_DENORMAL_GUARD;
+    for (unsigned int b = 0; b < MAX_ENVELOPE_BANDS; b++)
+    {
+      float y = _b0[b] * x + _z1[b];
+      _z1[b] = _b1[b] * x - _a1[b] * y + _z2[b];
+      _z2[b] = _b2[b] * x - _a2[b] * y;
+      sum[b] += y * y;
+      float a = fabsf(y);
+      peak[b] = a > peak[b] ? a : peak[b];
+    }
+  }
+}
+
+
+void EnvelopeFollower::process(const sample_t *samples, unsigned int nframes,
+                               unsigned int steps, EnvelopeLevels levels[][MAX_ENVELOPE_BANDS])
+{
+  unsigned int step_frames = nframes / steps;
+  if (step_frames != _step_frames)
+  {
+    set_step(step_frames);
+  }
+
+  for (unsigned int s = 0; s < steps; s++)
+  {
+    const sample_t *in = samples + s * step_frames;
+    float sum[MAX_ENVELOPE_BANDS];
+    float peak[MAX_ENVELOPE_BANDS];
+    for (unsigned int b = 0; b < MAX_ENVELOPE_BANDS; b++)
+    {
+      sum[b] = 0;
+      peak[b] = 0;
+    }
+
+    (this->*_step_kernel)(in, step_frames, sum, peak);
+
+    for (unsigned int b = 0; b < _bands; b++)
+    {
+      float rms = sqrtf(sum[b] / step_frames);
+      float coef = rms > _envelope[b] ? _attack : _release;
+      _envelope[b] = rms + coef * (_envelope[b] - rms);
+
+      levels[s][b].envelope = _envelope[b];
+      levels[s][b].peak = peak[b];
+      levels[s][b].rms = rms;
+    }
+  }
+}
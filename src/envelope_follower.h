@@ -0,0 +1,91 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _ENVELOPE_FOLLOWER_H
+#define _ENVELOPE_FOLLOWER_H
+
+#include "analysis_frame.h"
+#include "frame_kernels.h"
+
+#define ENVELOPE_DEFAULT_ATTACK_MS 5.0f
+#define ENVELOPE_DEFAULT_RELEASE_MS 150.0f
+
+
+// Splits a channel into a few bands with crossovers at given frequencies
+// (bass below the first, highs above the last) and follows each band's
+// level over short steps: peak, RMS, and an envelope of the RMS with
+// separate attack and release times.
+//
+// Each band is a single biquad (low-pass, band-pass or high-pass).  The
+// filters are laid out as arrays over MAX_ENVELOPE_BANDS, unused bands
+// having all-zero coefficients, so the per-sample loop over bands is a fixed
+// length the compiler can vectorize, and the loop over a step's samples is
+// specialized for the step length (see frame_kernels.h).  That is a few
+// dozen flops per sample in all, far less than the FFT.
+class EnvelopeFollower
+{
+public:
+  EnvelopeFollower(int samplerate, const float *crossovers, unsigned int num_crossovers,
+                   float attack_ms, float release_ms);
+
+  unsigned int bands(void) const { return _bands; }
+
+  // Filters nframes samples, split into steps equal steps, and writes each
+  // step's levels to levels[step][0 .. bands() - 1]
+  void process(const sample_t *samples, unsigned int nframes, unsigned int steps,
+               EnvelopeLevels levels[][MAX_ENVELOPE_BANDS]);
+
+private:
+  typedef void (EnvelopeFollower::*StepKernel)(const sample_t *in, unsigned int step_frames,
+                                                float *sum, float *peak);
+
+  void set_step(unsigned int step_frames);
+
+  // Runs N samples (step_frames if N is 0) through the filters, adding up
+  // each band's energy and peak
+  template <unsigned int N>
+  void filter_step(const sample_t *in, unsigned int step_frames, float *sum, float *peak);
+
+  int _samplerate;
+  unsigned int _bands;
+  float _attack_ms;
+  float _release_ms;
+
+  // Attack and release coefficients for the current step length
+  unsigned int _step_frames;
+  float _attack;
+  float _release;
+  StepKernel _step_kernel;
+
+  // Transposed direct form II biquads, normalized so a0 = 1
+  float _b0[MAX_ENVELOPE_BANDS];
+  float _b1[MAX_ENVELOPE_BANDS];
+  float _b2[MAX_ENVELOPE_BANDS];
+  float _a1[MAX_ENVELOPE_BANDS];
+  float _a2[MAX_ENVELOPE_BANDS];
+  float _z1[MAX_ENVELOPE_BANDS];
+  float _z2[MAX_ENVELOPE_BANDS];
+
+  float _envelope[MAX_ENVELOPE_BANDS];
+};
+
+#endif
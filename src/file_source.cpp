@@ -0,0 +1,305 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <string.h>
+
+#include <QtCore/QDebug>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#include "file_source.h"
+#include "stats.h"
+
+#define WAVE_FORMAT_PCM 0x0001
+#define WAVE_FORMAT_IEEE_FLOAT 0x0003
+#define WAVE_FORMAT_EXTENSIBLE 0xfffe
+
+
+static unsigned int le16(const unsigned char *p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+
+static unsigned long le32(const unsigned char *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+
+FileSource::FileSource(const char *path, int raw_samplerate,
+                       bool split_channels, unsigned int raw_channels)
+{
+  _samplerate = raw_samplerate;
+  _channels = split_channels ? raw_channels : 1;
+  _split = split_channels;
+  _format = FORMAT_FLOAT;
+  _bytes_per_sample = sizeof(float);
+  _position = 0;
+  _read_usecs = 0;
+  _bounded = false;
+  _data_left = 0;
+  _raw = NULL;
+  _raw_size = 0;
+
+  if (strcmp(path, "-") == 0)
+  {
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    _file = stdin;
+    _owns_file = false;
+  }
+  else
+  {
+    _file = fopen(path, "rb");
+    _owns_file = true;
+  }
+
+  if (_file == NULL)
+  {
+    qDebug() << "Cannot open input file" << path;
+    return;
+  }
+
+  if (raw_samplerate <= 0 && !read_wav_header())
+  {
+    qDebug() << "Not a supported WAV file:" << path;
+    if (_owns_file)
+    {
+      fclose(_file);
+    }
+    _file = NULL;
+    return;
+  }
+
+  if (_split && _channels > MAX_CHANNELS)
+  {
+    qDebug("Only the first %d of %d channels will be analysed", MAX_CHANNELS, _channels);
+  }
+
+  qDebug("Reading %s: %d Hz, %d channel(s), %d-bit %s", path, _samplerate,
+         _channels, _bytes_per_sample * 8,
+         _format == FORMAT_FLOAT ? "float" : "PCM");
+}
+
+
+FileSource::~FileSource()
+{
+  if (_file && _owns_file)
+  {
+    fclose(_file);
+  }
+  delete[] _raw;
+}
+
+
+unsigned int FileSource::channels(void) const
+{
+  if (!_split)
+  {
+    return 1;
+  }
+  return _channels < MAX_CHANNELS ? _channels : MAX_CHANNELS;
+}
+
+
+// Walks the RIFF chunks up to the start of the sample data
+bool FileSource::read_wav_header(void)
+{
+  unsigned char hdr[12];
+  unsigned char chunk[8];
+  unsigned char fmt[40];
+  bool have_fmt = false;
+
+  if (fread(hdr, 1, sizeof(hdr), _file) != sizeof(hdr)
+      || memcmp(hdr, "RIFF", 4) || memcmp(hdr + 8, "WAVE", 4))
+  {
+    return false;
+  }
+
+  while (fread(chunk, 1, sizeof(chunk), _file) == sizeof(chunk))
+  {
+    unsigned long size = le32(chunk + 4);
+
+    if (memcmp(chunk, "fmt ", 4) == 0)
+    {
+      unsigned long n = size < sizeof(fmt) ? size : sizeof(fmt);
+      if (size < 16 || fread(fmt, 1, n, _file) != n)
+      {
+        return false;
+      }
+      // Skip the rest of an oversized fmt chunk, plus the pad byte
+      for (unsigned long i = n; i < size + (size & 1); i++)
+      {
+        fgetc(_file);
+      }
+
+      unsigned int tag = le16(fmt);
+      if (tag == WAVE_FORMAT_EXTENSIBLE && n >= 26)
+      {
+        tag = le16(fmt + 24);
+      }
+
+      _channels = le16(fmt + 2);
+      _samplerate = le32(fmt + 4);
+      _bytes_per_sample = le16(fmt + 14) / 8;
+
+      if (tag == WAVE_FORMAT_PCM && _bytes_per_sample >= 1 && _bytes_per_sample <= 4)
+      {
+        _format = FORMAT_PCM;
+      }
+      else if (tag == WAVE_FORMAT_IEEE_FLOAT
+               && (_bytes_per_sample == 4 || _bytes_per_sample == 8))
+      {
+        _format = FORMAT_FLOAT;
+      }
+      else
+      {
+        qDebug("Unsupported WAV encoding %#x, %d bits", tag, _bytes_per_sample * 8);
+        return false;
+      }
+      have_fmt = _channels > 0 && _samplerate > 0;
+    }
+    else if (memcmp(chunk, "data", 4) == 0)
+    {
+      // Streamed WAVs (e.g. from a pipe) often leave the size unset
+      _bounded = size != 0 && size != 0xffffffffUL;
+      _data_left = size;
+      return have_fmt;
+    }
+    else
+    {
+      for (unsigned long i = 0; i < size + (size & 1); i++)
+      {
+        if (fgetc(_file) == EOF)
+        {
+          return false;
+        }
+      }
+    }
+  }
+
+  return false;
+}
+
+
+float FileSource::decode(const unsigned char *p) const
+{
+  if (_format == FORMAT_FLOAT)
+  {
+    if (_bytes_per_sample == 8)
+    {
+      double d;
+      memcpy(&d, p, sizeof(d));
+      return (float)d;
+    }
+    float f;
+    memcpy(&f, p, sizeof(f));
+    return f;
+  }
+
+  switch (_bytes_per_sample)
+  {
+    case 1:
+      return (p[0] - 128) / 128.0f;
+    case 2:
+      return (short)le16(p) / 32768.0f;
+    case 3:
+      return (int)((p[0] << 8) | (p[1] << 16) | ((unsigned int)p[2] << 24)) / 2147483648.0f;
+    default:
+      return (int)le32(p) / 2147483648.0f;
+  }
+}
+
+
+int FileSource::read(sample_t **bufs, unsigned int max_frames, jack_nframes_t *time)
+{
+  unsigned int frame_bytes = _bytes_per_sample * _channels;
+  unsigned long want = (unsigned long)max_frames * frame_bytes;
+
+  if (_file == NULL)
+  {
+    return -1;
+  }
+
+  if (_bounded && want > _data_left)
+  {
+    want = _data_left - _data_left % frame_bytes;
+  }
+
+  if (want > _raw_size)
+  {
+    delete[] _raw;
+    _raw = new unsigned char[want];
+    _raw_size = want;
+  }
+
+  if (want == 0)
+  {
+    return -1;
+  }
+
+  unsigned int frames = fread(_raw, frame_bytes, want / frame_bytes, _file);
+  if (frames == 0)
+  {
+    return -1;
+  }
+  if (_bounded)
+  {
+    _data_left -= frames * frame_bytes;
+  }
+
+  const unsigned char *p = _raw;
+  for (unsigned int i = 0; i < frames; i++)
+  {
+    if (_split)
+    {
+      for (int c = 0; c < _channels; c++)
+      {
+        if (c < MAX_CHANNELS)
+        {
+          bufs[c][i] = decode(p);
+        }
+        p += _bytes_per_sample;
+      }
+    }
+    else
+    {
+      float sum = 0;
+      for (int c = 0; c < _channels; c++)
+      {
+        sum += decode(p);
+        p += _bytes_per_sample;
+      }
+      bufs[0][i] = sum / _channels;
+    }
+  }
+
+  *time = _position;
+  _position += frames;
+  _read_usecs = Stats::now();
+  return frames;
+}
@@ -0,0 +1,81 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _FILE_SOURCE_H
+#define _FILE_SOURCE_H
+
+#include <stdio.h>
+
+#include "audio_source.h"
+
+
+// Offline audio source reading a WAV file, or headerless 32-bit float samples,
+// from a file or stdin.  Multi-channel input is either mixed down to mono or
+// delivered as separate channels.
+class FileSource : public AudioSource
+{
+public:
+  // path may be "-" for stdin.  A raw_samplerate > 0 selects headerless
+  // native-endian float input at that rate; otherwise a WAV header is read.
+  // With split_channels the file's channels are kept apart; raw input then
+  // has raw_channels interleaved channels.
+  FileSource(const char *path, int raw_samplerate = 0,
+             bool split_channels = false, unsigned int raw_channels = 1);
+  ~FileSource();
+
+  bool is_open(void) const { return _file != NULL; }
+
+  int samplerate(void) const { return _samplerate; }
+  unsigned int channels(void) const;
+  bool is_realtime(void) const { return false; }
+  int read(sample_t **bufs, unsigned int max_frames, jack_nframes_t *time);
+  // Frames count as captured when they are read
+  jack_time_t capture_usecs(jack_nframes_t time) const { return _read_usecs; }
+
+private:
+  enum Format { FORMAT_PCM, FORMAT_FLOAT };
+
+  bool read_wav_header(void);
+  float decode(const unsigned char *p) const;
+
+  FILE *_file;
+  bool _owns_file;
+
+  int _samplerate;
+  int _channels;
+  bool _split;
+  Format _format;
+  int _bytes_per_sample;
+
+  // Frames read so far, which stands in for the JACK frame time
+  jack_nframes_t _position;
+  jack_time_t _read_usecs;
+
+  // Bytes of sample data left in the file, if the header said so
+  bool _bounded;
+  unsigned long _data_left;
+
+  unsigned char *_raw;
+  unsigned int _raw_size;
+};
+
+#endif
@@ -0,0 +1,114 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _FRAME_KERNELS_H
+#define _FRAME_KERNELS_H
+
+#include <math.h>
+
+// TODO: Make this less dumb by requiring Win32 to have aubio.h in the same place?
+#ifdef __MINGW32__
+#include <aubio.h>
+#else
+#include <aubio/aubio.h>
+#endif
+
+#include "analysis_frame.h"
+
+// The per-hop loops over a window, hop or envelope step are compiled once
+// for each power-of-two length from KERNEL_MIN_SIZE to KERNEL_MAX_SIZE, so
+// that each has a fixed trip count the compiler can unroll and vectorize,
+// and once more for any length.  The analysis picks one at startup for the
+// lengths given on the command line.
+#define KERNEL_MIN_SIZE 256
+#define KERNEL_MAX_SIZE 8192
+#define NUM_KERNEL_SIZES 7
+
+// A kernel's instantiations, in the order Kernels::index() counts them: the
+// generic one (N = 0), then each specialized length
+#define KERNEL_TABLE(kernel) \
+  { kernel<0>, kernel<256>, kernel<512>, kernel<1024>, kernel<2048>, kernel<4096>, \
+    kernel<8192> }
+
+// Partial sums kept by the reduction kernels, so that they vectorize
+// without reassociating floating point
+#define KERNEL_LANES 8
+
+
+class Kernels
+{
+public:
+  // Where the kernel for size is in a KERNEL_TABLE: 0, the generic one,
+  // unless size is a power of two with a specialized one
+  static unsigned int index(unsigned int size);
+
+  // Makes index() pick the generic kernels from now on (--generic-kernels)
+  static void set_generic(bool generic) { _generic = generic; }
+
+private:
+  static bool _generic;
+};
+
+
+// Multiplies N samples of frame by the window into out, which must not
+// overlap them; size samples if N is 0
+template <unsigned int N>
+void window_kernel(const sample_t *frame, const smpl_t *window, smpl_t * __restrict out,
+                   unsigned int size)
+{
+  const unsigned int n = N ? N : size;
+  for (unsigned int i = 0; i < n; i++)
+  {
+    out[i] = frame[i] * window[i];
+  }
+}
+
+
+// Level of N samples (size if N is 0) in dB SPL, as aubio_db_spl()
+template <unsigned int N>
+smpl_t level_kernel(const sample_t *samples, unsigned int size)
+{
+  const unsigned int n = N ? N : size;
+  const unsigned int whole = n - n % KERNEL_LANES;
+  smpl_t lanes[KERNEL_LANES] = { 0 };
+
+  for (unsigned int i = 0; i < whole; i += KERNEL_LANES)
+  {
+    for (unsigned int k = 0; k < KERNEL_LANES; k++)
+    {
+      lanes[k] += samples[i + k] * samples[i + k];
+    }
+  }
+
+  smpl_t energy = 0;
+  for (unsigned int k = 0; k < KERNEL_LANES; k++)
+  {
+    energy += lanes[k];
+  }
+  for (unsigned int i = whole; i < n; i++)
+  {
+    energy += samples[i] * samples[i];
+  }
+  return 10 * log10f(energy / n);
+}
+
+#endif
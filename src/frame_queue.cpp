@@ -0,0 +1,101 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "frame_queue.h"
+
+
+FrameQueue::FrameQueue(unsigned int frames)
+    : _blocking(false), _available(frames)
+{
+  // One spare slot, since a ring buffer holds one byte less than its size
+  size_t size = (frames + 1) * sizeof(AnalysisFrame *);
+
+  _frames = new AnalysisFrame[frames];
+  _free = jack_ringbuffer_create(size);
+  _ready = jack_ringbuffer_create(size);
+
+  for (unsigned int i = 0; i < frames; i++)
+  {
+    push(_free, &_frames[i]);
+  }
+}
+
+
+FrameQueue::~FrameQueue()
+{
+  jack_ringbuffer_free(_free);
+  jack_ringbuffer_free(_ready);
+  delete[] _frames;
+}
+
+
+AnalysisFrame *FrameQueue::pop(jack_ringbuffer_t *ring)
+{
+  AnalysisFrame *frame;
+
+  if (jack_ringbuffer_read_space(ring) < sizeof(frame))
+  {
+    return NULL;
+  }
+  jack_ringbuffer_read(ring, (char *)&frame, sizeof(frame));
+  return frame;
+}
+
+
+// Never fails: the rings have room for every frame in the pool
+void FrameQueue::push(jack_ringbuffer_t *ring, AnalysisFrame *frame)
+{
+  jack_ringbuffer_write(ring, (const char *)&frame, sizeof(frame));
+}
+
+
+AnalysisFrame *FrameQueue::acquire(void)
+{
+  if (_blocking)
+  {
+    _available.acquire();
+  }
+
+  return pop(_free);
+}
+
+
+void FrameQueue::publish(AnalysisFrame *frame)
+{
+  push(_ready, frame);
+}
+
+
+AnalysisFrame *FrameQueue::take(void)
+{
+  return pop(_ready);
+}
+
+
+void FrameQueue::release(AnalysisFrame *frame)
+{
+  push(_free, frame);
+  if (_blocking)
+  {
+    _available.release();
+  }
+}
@@ -0,0 +1,84 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _FRAME_QUEUE_H
+#define _FRAME_QUEUE_H
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QSemaphore>
+
+#include <jack/ringbuffer.h>
+
+#include "analysis_frame.h"
+
+// Frames in each analyzer's pool: how far the sender may fall behind before
+// frames are dropped
+#define FRAME_POOL_SIZE 32
+
+
+// A fixed pool of AnalysisFrames handed from one producer (an Analyzer) to
+// one consumer (the FrameSender) and back again.  Both directions are
+// lock-free single-producer/single-consumer ring buffers of frame pointers,
+// and the frames themselves are allocated once, so nothing is allocated or
+// copied per hop.
+//
+//   producer: acquire() -> fill in -> publish()
+//   consumer: take() -> serialize -> release()
+class FrameQueue
+{
+public:
+  FrameQueue(unsigned int frames = FRAME_POOL_SIZE);
+  ~FrameQueue();
+
+  // Offline sources would rather wait for the consumer than lose frames:
+  // in blocking mode acquire() waits for a free frame instead of failing.
+  // Set before the queue is used.
+  void set_blocking(bool blocking) { _blocking = blocking; }
+
+  // Producer side.  Unless blocking, acquire() returns NULL when every frame
+  // is still with the consumer; the caller should then drop its results and
+  // call count_dropped().
+  AnalysisFrame *acquire(void);
+  void publish(AnalysisFrame *frame);
+  void count_dropped(void) { _dropped.fetchAndAddRelaxed(1); }
+
+  // Consumer side.  take() returns NULL when nothing has been published.
+  AnalysisFrame *take(void);
+  void release(AnalysisFrame *frame);
+
+  // Frames dropped because the pool was exhausted
+  int dropped(void) const { return _dropped; }
+
+private:
+  static AnalysisFrame *pop(jack_ringbuffer_t *ring);
+  static void push(jack_ringbuffer_t *ring, AnalysisFrame *frame);
+
+  AnalysisFrame *_frames;
+  jack_ringbuffer_t *_free;
+  jack_ringbuffer_t *_ready;
+  bool _blocking;
+  // Counts the frames in _free, for blocking mode
+  QSemaphore _available;
+  QAtomicInt _dropped;
+};
+
+#endif
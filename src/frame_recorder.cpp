@@ -0,0 +1,90 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <string.h>
+
+#include "byte_order.h"
+#include "frame_recorder.h"
+
+
+FrameRecorder::FrameRecorder(const char *path, SpectrumCodec::Encoding encoding,
+                             FrameSink *next)
+    : _codec(encoding, false), _next(next), _flushed_ms(0)
+{
+    for (int c = 0; c < MAX_CHANNELS; c++) {
+        _sequence[c] = 0;
+    }
+
+    if (_next != NULL) {
+        _next->setParent(this);
+    }
+
+    _file = fopen(path, "wb");
+    if (_file == NULL) {
+        qDebug() << "Cannot open recording file" << path;
+        return;
+    }
+
+    char header[RECORDING_HEADER_SIZE];
+    memcpy(header, RECORDING_MAGIC, 8);
+    put_u32(put_u32(header + 8, RECORDING_VERSION), 0);
+    if (fwrite(header, sizeof(header), 1, _file) != 1) {
+        qDebug() << "Cannot write recording file" << path;
+        fclose(_file);
+        _file = NULL;
+        return;
+    }
+
+    _timer.start();
+}
+
+
+FrameRecorder::~FrameRecorder()
+{
+    if (_file != NULL) {
+        fclose(_file);
+    }
+}
+
+
+bool FrameRecorder::transmit_frame(const AnalysisFrame *frame)
+{
+    bool ok = true;
+
+    if (_file != NULL) {
+        int len = Networking::encode_frame(_buffer + RECORD_HEADER_SIZE,
+                                           _sequence[frame->channel]++, *frame, &_codec);
+        char *p = put_u32(_buffer, len);
+        put_u64(p, _timer.nsecsElapsed() / 1000);
+        ok = fwrite(_buffer, RECORD_HEADER_SIZE + len, 1, _file) == 1;
+
+        if (_timer.elapsed() - _flushed_ms >= RECORDING_FLUSH_MS) {
+            fflush(_file);
+            _flushed_ms = _timer.elapsed();
+        }
+    }
+
+    if (_next != NULL && !_next->transmit_frame(frame)) {
+        ok = false;
+    }
+    return ok;
+}
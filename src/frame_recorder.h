@@ -0,0 +1,67 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _FRAME_RECORDER_H
+#define _FRAME_RECORDER_H
+
+#include <stdio.h>
+
+#include <QtCore/QElapsedTimer>
+
+#include "frame_sink.h"
+#include "recording.h"
+
+// Longest a crash can lose of a recording
+#define RECORDING_FLUSH_MS 1000
+
+
+// Records every frame into a recording file (see recording.h) on its way to
+// another sink, so that a show can be replayed later with firemix-replay.
+// Writes go through stdio's buffer and are flushed about once a second, so
+// they cost the sender thread little more than a copy.
+class FrameRecorder : public FrameSink
+{
+    Q_OBJECT
+
+public:
+    // Spectra are recorded in the given encoding.  next, if not NULL, gets
+    // every frame after it is recorded, and becomes the recorder's child.
+    FrameRecorder(const char *path, SpectrumCodec::Encoding encoding, FrameSink *next);
+    ~FrameRecorder();
+
+    bool is_open(void) const { return _file != NULL; }
+
+    bool transmit_frame(const AnalysisFrame *frame);
+
+private:
+    FILE *_file;
+    SpectrumCodec _codec;
+    FrameSink *_next;
+    uint32_t _sequence[MAX_CHANNELS];
+
+    QElapsedTimer _timer;
+    qint64 _flushed_ms;
+
+    char _buffer[RECORD_HEADER_SIZE + MAX_DATAGRAM_SIZE];
+};
+
+#endif
@@ -0,0 +1,126 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "frame_sender.h"
+
+
+FrameSender::FrameSender(FrameQueue **queues, unsigned int count, FrameSink *sink,
+                         unsigned int stats_interval)
+    : _sink(sink), _stats_interval((jack_time_t)stats_interval * 1000000),
+      _count(count), _next_queue(0), _finishing(false)
+{
+  for (unsigned int c = 0; c < _count; c++)
+  {
+    _queues[c] = queues[c];
+  }
+}
+
+
+FrameSender::~FrameSender()
+{
+  finish();
+  wait();
+}
+
+
+void FrameSender::finish(void)
+{
+  _finishing = true;
+}
+
+
+// Round-robin over the queues, so a busy channel can't starve the others
+AnalysisFrame *FrameSender::next(FrameQueue **queue)
+{
+  for (unsigned int i = 0; i < _count; i++)
+  {
+    FrameQueue *q = _queues[_next_queue];
+    _next_queue = (_next_queue + 1) % _count;
+
+    AnalysisFrame *frame = q->take();
+    if (frame != NULL)
+    {
+      *queue = q;
+      return frame;
+    }
+  }
+
+  return NULL;
+}
+
+
+int FrameSender::dropped(void) const
+{
+  int dropped = 0;
+  for (unsigned int c = 0; c < _count; c++)
+  {
+    dropped += _queues[c]->dropped();
+  }
+  return dropped;
+}
+
+
+void FrameSender::run(void)
+{
+  jack_time_t next_report = Stats::now() + _stats_interval;
+
+  for (;;)
+  {
+    // Sampled before looking at the queues, so that once finishing, one
+    // last pass over them is guaranteed to see every frame
+    bool finishing = _finishing;
+
+    if (_stats_interval > 0 && Stats::now() >= next_report)
+    {
+      _stats.report(dropped());
+      next_report += _stats_interval;
+    }
+
+    FrameQueue *queue;
+    AnalysisFrame *frame = next(&queue);
+    if (frame == NULL)
+    {
+      if (finishing)
+      {
+        break;
+      }
+      usleep(SENDER_IDLE_USEC);
+      continue;
+    }
+
+    frame->stamps[STAMP_TAKEN] = Stats::now();
+    bool sent = _sink->transmit_frame(frame);
+    frame->stamps[STAMP_SENT] = Stats::now();
+
+    _stats.record(*frame, sent);
+    queue->release(frame);
+  }
+
+  if (_stats_interval > 0)
+  {
+    _stats.report(dropped());
+  }
+  else if (dropped() > 0)
+  {
+    qDebug("Sender fell behind: %d frames dropped", dropped());
+  }
+}
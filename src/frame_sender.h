@@ -0,0 +1,73 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _FRAME_SENDER_H
+#define _FRAME_SENDER_H
+
+#include <QtCore/QThread>
+#include <QtCore/QDebug>
+
+#include "frame_queue.h"
+#include "frame_sink.h"
+#include "stats.h"
+
+// How long the sender sleeps when every queue is empty
+#define SENDER_IDLE_USEC 500
+
+
+// Takes finished AnalysisFrames off the analyzers' queues and hands them to
+// a FrameSink on its own thread, so serialization and socket writes never
+// hold up the analysis workers.  Each frame goes back to its pool once the
+// sink returns.  The sender also keeps the latency Stats, and logs them
+// every stats_interval seconds (never if 0) and when it finishes.
+class FrameSender : public QThread
+{
+  Q_OBJECT
+
+public:
+  // One queue per Analyzer
+  FrameSender(FrameQueue **queues, unsigned int count, FrameSink *sink,
+              unsigned int stats_interval);
+  ~FrameSender();
+
+public slots:
+  // Sends whatever is still queued, then stops the thread.  Call once no
+  // more frames will be published.
+  void finish(void);
+
+protected:
+  void run(void);
+
+private:
+  AnalysisFrame *next(FrameQueue **queue);
+  int dropped(void) const;
+
+  FrameQueue *_queues[MAX_CHANNELS * MAX_CHAINS];
+  FrameSink *_sink;
+  Stats _stats;
+  jack_time_t _stats_interval;
+  unsigned int _count;
+  unsigned int _next_queue;
+  volatile bool _finishing;
+};
+
+#endif
@@ -0,0 +1,122 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <string.h>
+
+#include "frame_writer.h"
+
+
+FrameWriter::FrameWriter(const char *path)
+{
+    if (strcmp(path, "-") == 0) {
+        _file = stdout;
+        _owns_file = false;
+    } else {
+        _file = fopen(path, "w");
+        _owns_file = true;
+    }
+
+    if (_file == NULL) {
+        qDebug() << "Cannot open output file" << path;
+    }
+}
+
+
+FrameWriter::~FrameWriter()
+{
+    if (_file == NULL) {
+        return;
+    }
+
+    if (_owns_file) {
+        fclose(_file);
+    } else {
+        fflush(_file);
+    }
+}
+
+
+bool FrameWriter::transmit_frame(const AnalysisFrame *frame)
+{
+    if (frame->has_spectrum) {
+        fprintf(_file, "fft %d %u %u", frame->channel, frame->time, frame->bands);
+        for (unsigned int i = 0; i < frame->bands; i++) {
+            fprintf(_file, " %g", frame->spectrum[i]);
+        }
+        fputc('\n', _file);
+    }
+
+    if (frame->has_chroma) {
+        fprintf(_file, "chroma %d %u", frame->channel, frame->time);
+        for (unsigned int i = 0; i < CHROMA_BINS; i++) {
+            fprintf(_file, " %g", frame->chroma[i]);
+        }
+        fputc('\n', _file);
+    }
+
+    if (frame->has_mel) {
+        fprintf(_file, "mel %d %u %u", frame->channel, frame->time, frame->mel_bands);
+        for (unsigned int i = 0; i < frame->mel_bands; i++) {
+            fprintf(_file, " %g", frame->mel[i]);
+        }
+        fputc('\n', _file);
+    }
+
+    if (frame->has_pitch) {
+        fprintf(_file, "pitch %d %u %g %g\n", frame->channel, frame->time,
+                frame->pitch, frame->confidence);
+    }
+
+    if (frame->onset) {
+        fprintf(_file, "onset %d %u\n", frame->channel, frame->time);
+    }
+
+    if (frame->has_tempo) {
+        fprintf(_file, "tempo %d %u %g %g %g", frame->channel, frame->time, frame->bpm,
+                frame->tempo_confidence, frame->beat_phase);
+        for (int i = 0; i < TEMPO_PREDICTED_BEATS; i++) {
+            fprintf(_file, " %u", frame->next_beats[i]);
+        }
+        fputc('\n', _file);
+    }
+
+    if (frame->has_load) {
+        fprintf(_file, "load %d %u %g %u\n", frame->channel, frame->time, frame->load,
+                frame->shed_level);
+    }
+
+    // One line per step, stamped with the time it ends
+    if (frame->has_envelope) {
+        for (unsigned int s = 0; s < frame->envelope_steps; s++) {
+            jack_nframes_t time = frame->time
+                - (frame->envelope_steps - 1 - s) * frame->envelope_step_frames;
+            fprintf(_file, "envelope %d %u %u", frame->channel, time, frame->envelope_bands);
+            for (unsigned int b = 0; b < frame->envelope_bands; b++) {
+                const EnvelopeLevels& levels = frame->envelopes[s][b];
+                fprintf(_file, " %g %g %g", levels.envelope, levels.peak, levels.rms);
+            }
+            fputc('\n', _file);
+        }
+    }
+
+    return !ferror(_file);
+}
@@ -0,0 +1,65 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _FRAME_WRITER_H
+#define _FRAME_WRITER_H
+
+#include <stdio.h>
+
+#include <QtCore/QDebug>
+
+#include "frame_sink.h"
+
+
+// Drop-in replacement for Networking that writes the analysis output to a
+// text file (or stdout) instead of sending datagrams, one message per line:
+//
+//   fft <channel> <time> <len> <value> ...
+//   chroma <channel> <time> <C level> <C# level> ... <B level>
+//   mel <channel> <time> <len> <value> ...
+//   pitch <channel> <time> <hz> <confidence>
+//   onset <channel> <time>
+//   tempo <channel> <time> <bpm> <confidence> <phase> <next beat time> ...
+//   load <channel> <time> <load> <shed level>    (live input only)
+//   envelope <channel> <time> <bands> <envelope> <peak> <rms> ...
+//
+// where time is the frame time just past the hop, or for envelopes, just
+// past the step.
+class FrameWriter : public FrameSink
+{
+    Q_OBJECT
+
+public:
+    // path may be "-" for stdout
+    FrameWriter(const char *path);
+    ~FrameWriter();
+
+    bool is_open(void) const { return _file != NULL; }
+
+    bool transmit_frame(const AnalysisFrame *frame);
+
+private:
+    FILE *_file;
+    bool _owns_file;
+};
+
+#endif
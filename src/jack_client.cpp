@@ -20,11 +20,16 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
+#include <stdio.h>
+#include <string.h>
+
 #include "jack_client.h"
+#include "stats.h"
+#include "realtime.h"
 
 
-JackClient::JackClient(unsigned int fft_send_interval)
-    : _fft_send_interval(fft_send_interval)
+JackClient::JackClient(unsigned int channels)
+    : _channels(channels)
 {
   const char **ports;
   const char *client_name = "firemix-audio-processor";
@@ -33,20 +38,19 @@ JackClient::JackClient(unsigned int fft_send_interval)
   jack_status_t status;
 
   _active = false;
+  _samplerate = 0;
 
-  _fft = new_aubio_fft(FFT_SIZE);
-  _grain = new_cvec(FFT_SIZE);
-
-  _ibuf = NULL;
-  _ibuf = new_fvec(HOP_SIZE);
-
-  if (!_ibuf)
+  for (unsigned int c = 0; c < _channels; c++)
   {
-    qDebug() << "Error allocating buffer";
+    _input_ports[c] = NULL;
+    _ringbuffers[c] = jack_ringbuffer_create(RINGBUFFER_SIZE * sizeof(sample_t));
+    jack_ringbuffer_mlock(_ringbuffers[c]);
   }
+  _markers = jack_ringbuffer_create(MARKER_RINGBUFFER_SIZE * sizeof(PeriodMarker));
+  jack_ringbuffer_mlock(_markers);
+  _period_time = 0;
+  _period_left = 0;
 
-  _onset_list = new_fvec(1);
-  
   _client = jack_client_open(client_name, options, &status, server_name);
 
   if (_client == NULL)
@@ -73,31 +77,28 @@ JackClient::JackClient(unsigned int fft_send_interval)
 
   _samplerate = jack_get_sample_rate(_client);
 
-  char _onset_mode[4] = "mkl";
-  //char _onset_mode[4] = "hfc";
-  //char _onset_mode[9] = "specflux";
-  smpl_t threshold = 0.3;
-  smpl_t silence = -70.0;
-  _onset = new_aubio_onset(_onset_mode, BUF_SIZE, HOP_SIZE, _samplerate);
-  aubio_onset_set_threshold(_onset, threshold);
-  aubio_onset_set_silence(_onset, silence);
-  aubio_onset_set_minioi_ms(_onset, 250);
-
-  char _pitch_mode[7] = "yinfft";
-  _pitch = new_aubio_pitch(_pitch_mode, BUF_SIZE, HOP_SIZE, _samplerate);
-  _pitch_value = new_fvec(1);
-  char _pitch_unit[3] = "Hz";
-  aubio_pitch_set_unit(_pitch, _pitch_unit);
-
   jack_set_process_callback(_client, _process, this);
   jack_on_shutdown(_client, _jack_client_shutdown, this);
 
-  _input_port = jack_port_register(_client, "input", JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
-
-  if (_input_port == NULL)
+  for (unsigned int c = 0; c < _channels; c++)
   {
-      qDebug() << "No JACK ports available";
-      return;
+    char port_name[16];
+    if (_channels == 1)
+    {
+      strcpy(port_name, "input");
+    }
+    else
+    {
+      sprintf(port_name, "input_%u", c + 1);
+    }
+
+    _input_ports[c] = jack_port_register(_client, port_name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+
+    if (_input_ports[c] == NULL)
+    {
+        qDebug() << "No JACK ports available";
+        return;
+    }
   }
 
   if (jack_activate(_client))
@@ -105,6 +106,10 @@ JackClient::JackClient(unsigned int fft_send_interval)
       qDebug() << "Cannot activate JACK client.";
       return;
   }
+  _active = true;
+
+  // Without capture ports, or a connection to one, the client still runs
+  // and its inputs can be connected by hand
 
   ports = jack_get_ports(_client, NULL, NULL, JackPortIsPhysical | JackPortIsOutput);
 
@@ -114,31 +119,36 @@ JackClient::JackClient(unsigned int fft_send_interval)
       return;
   }
 
-  if (jack_connect(_client, ports[0], jack_port_name(_input_port)))
+  // Channel n listens to the n-th capture port; any beyond the number of
+  // capture ports are left for the user to connect
+  for (unsigned int c = 0; c < _channels && ports[c] != NULL; c++)
   {
-      qDebug() << "Cannot connect input port.";
-      return;
+    if (jack_connect(_client, ports[c], jack_port_name(_input_ports[c])))
+    {
+        qDebug() << "Cannot connect input port" << c + 1;
+        free(ports);
+        return;
+    }
   }
 
-  qDebug("Registered JACK input port.  Listening at %d kHz", _samplerate);
+  qDebug("Registered %u JACK input port(s).  Listening at %d kHz", _channels, _samplerate);
 
   free (ports);
-  _active = true;
 }
 
 
 JackClient::~JackClient()
 {
-  qDebug() << "Shutting down JACK client";
-  jack_client_close(_client);
-  del_aubio_onset(_onset);
-  del_aubio_fft(_fft);
-  del_aubio_pitch(_pitch);
-  del_cvec(_grain);
-  del_fvec(_pitch_value);
-  del_fvec(_ibuf);
-  del_fvec(_onset_list);
-  aubio_cleanup();
+  if (_client != NULL)
+  {
+    qDebug() << "Shutting down JACK client";
+    jack_client_close(_client);
+  }
+  for (unsigned int c = 0; c < _channels; c++)
+  {
+    jack_ringbuffer_free(_ringbuffers[c]);
+  }
+  jack_ringbuffer_free(_markers);
 }
 
 
@@ -161,164 +171,85 @@ int JackClient::_process(jack_nframes_t nframes, void* arg) {
 }
 
 
+// Runs on the JACK realtime thread: no analysis, allocation, locking or
+// logging here (an RT_CHECKS build aborts on allocation or locking).  If
+// the analysis thread has fallen behind, the whole period is dropped on every
+// channel, so the channels stay sample-aligned, and counted rather than
+// blocking the JACK graph.
 int JackClient::process(jack_nframes_t nframes) { 
-  static unsigned int pos = 0;
-  static unsigned int delay = 0;
-  jack_default_audio_sample_t *in;
-
-  in = (jack_default_audio_sample_t*)jack_port_get_buffer(_input_port, nframes);
+  Realtime::begin_checked(RT_CHECK_ALLOC | RT_CHECK_LOCK);
 
-  //qDebug("Wanted %d frames and got %d", BUF_SIZE, nframes);
+  size_t len = sizeof(sample_t) * nframes;
+  bool full = jack_ringbuffer_write_space(_markers) < sizeof(PeriodMarker);
 
-  if(nframes < BUF_SIZE)
+  for (unsigned int c = 0; c < _channels && !full; c++)
   {
-      qDebug("Warning: wanted %d frames but got %d", BUF_SIZE, nframes);
-      memset(_buffer, 0, sizeof(_buffer));
-      memcpy(_buffer, in, sizeof(sample_t) * nframes);
+    full = jack_ringbuffer_write_space(_ringbuffers[c]) < len;
   }
-  else
+
+  if (full)
   {
-      memcpy(_buffer, in, sizeof(sample_t) * BUF_SIZE);
+    _overflows.fetchAndAddRelaxed(1);
+    _dropped_frames.fetchAndAddRelaxed(nframes);
+    Realtime::end_checked();
+    return 0;
   }
 
-  for (unsigned int i = 0; i < nframes; i++)
+  for (unsigned int c = 0; c < _channels; c++)
   {
-    _ibuf->data[pos] = _buffer[i];
-    if (pos == HOP_SIZE-1)
-    {
-      aubio_fft_do(_fft, _ibuf, _grain);
+    jack_default_audio_sample_t *in;
+    in = (jack_default_audio_sample_t*)jack_port_get_buffer(_input_ports[c], nframes);
+    jack_ringbuffer_write(_ringbuffers[c], (const char *)in, len);
+  }
 
-      if (delay > _fft_send_interval)
-      {
-        const int logged_size = 256;
-        float logged_buffer[logged_size];
-
-        const int bucket_indexes[] = {
-            1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2,
-            3, 3, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4,
-            5, 5, 5, 5, 5, 5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 6,
-            7, 7, 7, 7, 7, 7, 7, 7, 8, 8, 8, 8, 8, 8, 8, 8,
-            9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9,
-            10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
-            11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
-            12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
-            13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13,
-            14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
-            15, 15, 15, 15, 15, 15, 15, 15, 16, 16, 16, 16, 16, 16, 16, 16,
-            17, 17, 17, 17, 17, 17, 17, 17, 18, 18, 18, 18, 18, 18, 18, 18,
-            19, 19, 19, 19, 19, 19, 19, 20, 20, 20, 20, 20, 20, 21, 21, 21,
-            21, 21, 22, 22, 22, 22, 23, 23, 23, 24, 24, 25, 26, 27, 28, 29,
-            30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45,
-            50, 60, 70, 80, 90, 100, 110, 120, 130, 140, 150, 160, 170, 180, 200, 220, 256
-        };
-        const int bucket_lerp[] = {
-            1, 2, 3, 4, 5, 6, 7, 8, 1, 2, 3, 4, 5, 6, 7, 8,
-            1, 2, 3, 4, 5, 6, 7, 8, 1, 2, 3, 4, 5, 6, 7, 8,
-            1, 2, 3, 4, 5, 6, 7, 8, 1, 2, 3, 4, 5, 6, 7, 8,
-            1, 2, 3, 4, 5, 6, 7, 8, 1, 2, 3, 4, 5, 6, 7, 8,
-            1, 2, 2, 3, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 9,
-            1, 2, 2, 3, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 9,
-            1, 2, 2, 3, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 9,
-            1, 2, 2, 3, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 9,
-            1, 2, 2, 3, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 9,
-            1, 2, 2, 3, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 9,
-            1, 2, 3, 4, 5, 6, 7, 8, 1, 2, 3, 4, 5, 6, 7, 8,
-            1, 2, 3, 4, 5, 6, 7, 8, 1, 2, 3, 4, 5, 6, 7, 8,
-            5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
-            5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
-            5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
-            5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5
-        };
-
-        const float adjust_volume[] = {
-            4, 4, 3, 3, 3, 3, 3, 3, 3, 2, 1, 1, 1, 1, 1, 1,
-            2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
-            3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
-            4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
-            5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
-            5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
-            5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
-            5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
-            6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
-            7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
-            8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
-            9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9,
-            10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
-            11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
-            12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
-            9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 5
-
-//            1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-//            2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
-//            3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
-//            4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
-//            5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
-//            6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
-//            7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
-//            8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
-//            9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9,
-//            10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
-//            11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
-//            12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
-//            13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13,
-//            14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
-//            15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
-//            10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10
-        };
-
-        for (int i = 0; i < logged_size; i++)
-        {
-            if (bucket_indexes[i] == bucket_indexes[i+1])
-            {
-                float lerp = bucket_lerp[i] / 10.0;
-                logged_buffer[i] = _grain->norm[bucket_indexes[i]] * (1.0 - lerp) + _grain->norm[bucket_indexes[i]+1] * (lerp);
-                //qDebug("lerp %d : lerp %f from %f to %f is %f", i, lerp, _grain->norm[bucket_indexes[i]], _grain->norm[bucket_indexes[i]+1], logged_buffer[i]);
-            }
-            else
-            {
-                logged_buffer[i] = 0;
-                for (int j = bucket_indexes[i]; (j <= bucket_indexes[i+1]); j++)
-                {
-                    logged_buffer[i] += _grain->norm[j];
-                }
-            }
-            logged_buffer[i] *= adjust_volume[i] / 16.0;
-            //qDebug("fft %d : currently %d, bucket size %f", i, current, bucket_size);
-        }
-        //qDebug("Used %d frames, bucket size is %f", current, bucket_size);
-
-        emit fft_data(logged_size, logged_buffer);
-        delay = 0;
-      }
-      else
-      {
-        delay += nframes;
-      }
-      
-      aubio_pitch_do(_pitch, _ibuf, _pitch_value);
-      smpl_t confidence = aubio_pitch_get_confidence(_pitch);
-      smpl_t pitch_found = fvec_get_sample(_pitch_value, 0);
-      
-      if (confidence > 0.9) {
-        //qDebug("Pitch detected %f confidence %f", pitch_found, confidence);
-      }
-      emit pitch_data(pitch_found, confidence);
+  // Written last, so a marker the reader sees always has its samples behind it
+  PeriodMarker marker;
+  marker.time = jack_last_frame_time(_client);
+  marker.nframes = nframes;
+  jack_ringbuffer_write(_markers, (const char *)&marker, sizeof(marker));
 
-      //if (_grain->norm[0] > 0.1) {
-      //  cvec_print(_grain);
-      //}
+  Realtime::end_checked();
+  return 0;
+}
 
-      aubio_onset_do(_onset, _ibuf, _onset_list);
 
-      if (_onset_list->data[0] != 0)
-      {
-        emit onset_detected();
-        break;
-      }
-      pos = -1;
+// Called from the analysis thread.  Reads never straddle two periods, since
+// a dropped period between them would make the frame times discontinuous.
+int JackClient::read(sample_t **bufs, unsigned int max_frames, jack_nframes_t *time)
+{
+  if (_period_left == 0)
+  {
+    PeriodMarker marker;
+    if (jack_ringbuffer_read_space(_markers) < sizeof(marker))
+    {
+      return 0;
     }
-    pos++;
+    jack_ringbuffer_read(_markers, (char *)&marker, sizeof(marker));
+    _period_time = marker.time;
+    _period_left = marker.nframes;
   }
 
-  return 0;
+  unsigned int avail = max_frames < _period_left ? max_frames : _period_left;
+
+  for (unsigned int c = 0; c < _channels; c++)
+  {
+    jack_ringbuffer_read(_ringbuffers[c], (char *)bufs[c], avail * sizeof(sample_t));
+  }
+
+  *time = _period_time;
+  _period_time += avail;
+  _period_left -= avail;
+  return avail;
+}
+
+
+// JACK's clock is converted to Stats::now() through the frame's age, which
+// both clocks agree on
+jack_time_t JackClient::capture_usecs(jack_nframes_t time) const
+{
+  jack_time_t captured = jack_frames_to_time(_client, time);
+  jack_time_t now = jack_get_time();
+  jack_time_t age = now > captured ? now - captured : 0;
+
+  return Stats::now() - age;
 }
@@ -27,31 +27,29 @@
 
 #include <QtCore/QObject>
 #include <QtCore/QDebug>
+#include <QtCore/QAtomicInt>
 
 #include <jack/jack.h>
 #include <jack/midiport.h>
 #include <jack/ringbuffer.h>
 
-// TODO: Make this less dumb by requiring Win32 to have aubio.h in the same place?
-#ifdef __MINGW32__
-#include <aubio.h>
-#else
-#include <aubio/aubio.h>
-#endif
+#include "audio_source.h"
 
-#define FFT_SIZE 1024
-#define BUF_SIZE 1024
-#define HOP_SIZE 1024
+// Capacity of each channel's ring buffer between the process callback and
+// the analysis thread, in samples.  Must be a power of two.
+#define RINGBUFFER_SIZE 65536
 
-typedef jack_default_audio_sample_t sample_t;
+// Capacity of the ring buffer of period markers, enough for a full sample
+// ring buffer of 32-frame periods
+#define MARKER_RINGBUFFER_SIZE (RINGBUFFER_SIZE / 32)
 
 
-class JackClient : public QObject
+class JackClient : public QObject, public AudioSource
 {
   Q_OBJECT
 
 public:
-  JackClient(unsigned int _send_interval);
+  JackClient(unsigned int channels = 1);
   ~JackClient();
 
   static void _jack_client_shutdown(void* arg);
@@ -60,34 +58,47 @@ public:
   static int _process(jack_nframes_t nframes, void* arg);
   int process(jack_nframes_t nframes);
 
-signals:
-    void onset_detected(void);
-    void fft_data(int len, float *data);
-    void pitch_data(float pitch, float confidence);
+  // Whether the client opened, registered its ports and was activated; if
+  // not, the reason has been logged
+  bool is_open(void) const { return _active; }
 
-private:
-  unsigned int _fft_send_interval;
+  int samplerate(void) const { return _samplerate; }
+  unsigned int channels(void) const { return _channels; }
+  bool is_realtime(void) const { return true; }
+  int read(sample_t **bufs, unsigned int max_frames, jack_nframes_t *time);
+  jack_time_t capture_usecs(jack_nframes_t time) const;
+
+  // Number of periods (and frames) the process callback had to discard
+  // because the analysis thread was not keeping up.
+  int overflows(void) const { return _overflows; }
+  int dropped_frames(void) const { return _dropped_frames; }
 
-  jack_port_t *_input_port;
+private:
+  // Queued by the process callback after each period's samples, so the
+  // reader knows when every frame was captured even across dropped periods
+  struct PeriodMarker
+  {
+    jack_nframes_t time;
+    jack_nframes_t nframes;
+  };
+
+  unsigned int _channels;
+  jack_port_t *_input_ports[MAX_CHANNELS];
   jack_port_t *_output_port;
   jack_client_t *_client;
 
   bool _active;
-  sample_t _buffer[BUF_SIZE];
   int _samplerate;
 
-  fvec_t *_ibuf;
-
-  aubio_onset_t *_onset;
-  fvec_t *_onset_list;
+  jack_ringbuffer_t *_ringbuffers[MAX_CHANNELS];
+  jack_ringbuffer_t *_markers;
 
-  aubio_fft_t *_fft;
-  cvec_t *_grain;
-  
-  aubio_pitch_t *_pitch;
-  fvec_t *_pitch_value;
-  fvec_t *_pitch_confidence;
+  // Reader side: the period being read, and where in it the next frame is
+  jack_nframes_t _period_time;
+  jack_nframes_t _period_left;
 
+  QAtomicInt _overflows;
+  QAtomicInt _dropped_frames;
 };
 
 #endif
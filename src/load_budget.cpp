@@ -0,0 +1,104 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "load_budget.h"
+
+
+// Share of a shed level's stage load that shedding it saves
+static const float shed_saving[NUM_SHED_LEVELS] = {
+  0,
+  1,
+  1 - 1.0f / SHED_SPECTRUM_DECIMATION,
+  1 - 1.0f / SHED_ONSET_DECIMATION
+};
+
+
+LoadBudget::LoadBudget(int samplerate, float budget)
+    : _samplerate(samplerate), _budget(budget), _load(0), _level(SHED_NONE),
+      _since_change(0), _restorable(0)
+{
+}
+
+
+bool LoadBudget::update(jack_time_t busy, unsigned int nframes, bool overflowed,
+                        const float *stage_load)
+{
+  if (nframes == 0)
+  {
+    return false;
+  }
+
+  double duration = (double)nframes / _samplerate;
+  float load = busy / (duration * 1e6);
+  double weight = duration / LOAD_SMOOTHING_SECONDS;
+  if (weight > 1)
+  {
+    weight = 1;
+  }
+  _load += weight * (load - _load);
+  _since_change += nframes;
+
+  if (_budget <= 0)
+  {
+    return false;
+  }
+
+  // Dropped audio means the load was too high, whatever the average says
+  if ((_load > _budget || overflowed) && _level < NUM_SHED_LEVELS - 1
+      && _since_change >= (unsigned int)(LOAD_SHED_SECONDS * _samplerate))
+  {
+    _level++;
+    _since_change = 0;
+    _restorable = 0;
+    return true;
+  }
+
+  if (_level > SHED_NONE
+      && _load + stage_load[_level] * shed_saving[_level] < _budget * LOAD_RESTORE_MARGIN)
+  {
+    _restorable += nframes;
+  }
+  else
+  {
+    _restorable = 0;
+  }
+
+  if (_restorable >= (unsigned int)(LOAD_RESTORE_SECONDS * _samplerate))
+  {
+    _level--;
+    _since_change = 0;
+    _restorable = 0;
+    return true;
+  }
+
+  return false;
+}
+
+
+const char *LoadBudget::level_name(unsigned int level)
+{
+  static const char *names[NUM_SHED_LEVELS] = {
+    "none", "pitch", "pitch and spectrum rate", "pitch, spectrum rate and onset rate"
+  };
+
+  return level < NUM_SHED_LEVELS ? names[level] : "?";
+}
@@ -0,0 +1,92 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _LOAD_BUDGET_H
+#define _LOAD_BUDGET_H
+
+#include <jack/jack.h>
+
+// Share of real time the analysis may take before stages are shed
+// (--dsp-budget)
+#define LOAD_DEFAULT_BUDGET 0.7f
+// Time constant of the load average, in seconds
+#define LOAD_SMOOTHING_SECONDS 0.5
+// Least time between shedding one level and the next, so that the first
+// has a chance to show in the load
+#define LOAD_SHED_SECONDS 0.5
+// How long a shed stage must look affordable before it comes back
+#define LOAD_RESTORE_SECONDS 3
+// and how far inside the budget the load must then stay
+#define LOAD_RESTORE_MARGIN 0.8f
+
+// Shed levels, each shedding what the ones before it do as well: pitch
+// detection; then spectra, chroma and mel bands, binned (and their FFT
+// done) on one hop in SHED_SPECTRUM_DECIMATION; then onset detection, on one
+// hop in SHED_ONSET_DECIMATION.  Tempo and envelopes are cheap and never
+// shed.
+#define SHED_NONE 0
+#define SHED_PITCH 1
+#define SHED_SPECTRUM 2
+#define SHED_ONSET 3
+#define NUM_SHED_LEVELS 4
+#define SHED_SPECTRUM_DECIMATION 4
+#define SHED_ONSET_DECIMATION 2
+
+
+// Keeps the analysis inside a share of real time by shedding its less
+// important stages first.  The analysis thread reports how long each round
+// of analysis took, together with what each level's stages cost when they
+// last ran in full; the budget raises the shed level while the load is over
+// budget, and lowers it again once the load has left room for the stages
+// being brought back for a while.  Loads are fractions of real time on the
+// analysis thread's critical path: 1 is a round taking as long as its audio.
+class LoadBudget
+{
+public:
+  // A budget of 0 measures the load without ever shedding anything
+  LoadBudget(int samplerate, float budget);
+
+  // Called after each round, which took busy microseconds for nframes
+  // samples; overflowed if the source dropped audio meanwhile.
+  // stage_load[level] is the load of the stages that level sheds, when run
+  // on every hop.  Returns true if the level changed.
+  bool update(jack_time_t busy, unsigned int nframes, bool overflowed,
+              const float *stage_load);
+
+  float load(void) const { return _load; }
+  unsigned int level(void) const { return _level; }
+
+  static const char *level_name(unsigned int level);
+
+private:
+  int _samplerate;
+  float _budget;
+  float _load;
+  unsigned int _level;
+
+  // Frames since the level last changed, and for which the load has looked
+  // low enough to bring the last level shed back
+  unsigned int _since_change;
+  unsigned int _restorable;
+};
+
+#endif
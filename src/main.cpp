@@ -20,44 +20,640 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include <QtCore/QCoreApplication>
 #include <QHostInfo>
 
 #include "jack_client.h"
+#include "file_source.h"
+#include "analyzer.h"
+#include "analysis_thread.h"
+#include "worker_pool.h"
+#include "realtime.h"
+#include "frame_sender.h"
 #include "networking.h"
+#include "frame_writer.h"
+#include "frame_recorder.h"
+#ifndef _WIN32
+#include "shm_publisher.h"
+#endif
+
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options] [host]\n"
+            "\n"
+            "Analyses audio from JACK and sends the results to host (default\n"
+            "localhost) on UDP port %d.\n"
+            "\n"
+            "Options:\n"
+            "  --input FILE    analyse a WAV file ('-' for stdin) instead of JACK,\n"
+            "                  as fast as possible\n"
+            "  --raw RATE      input is headerless 32-bit float at RATE Hz\n"
+            "  --drop-frames   with --input, drop frames the sender can't keep up\n"
+            "                  with, as for JACK, instead of waiting for it\n"
+            "  --channels N    analyse N channels separately: N JACK input ports,\n"
+            "                  or each channel of the input file (up to %d)\n"
+            "  --workers N     analysis threads to spread the channels over\n"
+            "                  (default: one per channel, up to the core count)\n"
+            "  --realtime      lock all memory into RAM and run the analysis\n"
+            "                  threads with realtime priority %d; fails if the\n"
+            "                  memory can't be locked\n"
+            "  --rt-priority N realtime priority for the analysis threads, below\n"
+            "                  JACK's (implies --realtime)\n"
+            "  --cpus N,...    pin the analysis thread and its workers to these\n"
+            "                  CPUs, one each in turn\n"
+            "  --dsp-budget PCT\n"
+            "                  when analysis takes more than PCT%% of real time,\n"
+            "                  shed pitch, then spectrum rate, then onset rate\n"
+            "                  until it fits (default %.0f, 0 to never shed)\n"
+            "  --output FILE   write results as text to FILE ('-' for stdout)\n"
+            "                  instead of sending them over UDP\n"
+#ifndef _WIN32
+            "  --shm NAME      publish v2 frames to the shared memory ring\n"
+            "                  /dev/shm/NAME instead of sending them over UDP\n"
+#endif
+            "  --record FILE   also record every frame to FILE, for firemix-replay;\n"
+            "                  spectra are kept in the --spectrum-encoding\n"
+            "  --window N      analysis frame length, a power of two (default %d)\n"
+            "  --hop N         samples between frames, at most the window length\n"
+            "                  (default %d)\n"
+            "  --onset-window N\n"
+            "                  detect onsets in a separate chain with this shorter\n"
+            "                  window, leaving --window to spectrum and pitch\n"
+            "  --onset-hop N   samples between onset frames (default the onset\n"
+            "                  window)\n"
+            "  --no-tempo      don't track the tempo and predict beats\n"
+            "  --envelopes HZ,...\n"
+            "                  follow the level of bands split at these crossover\n"
+            "                  frequencies (e.g. 250,4000), sent with every onset\n"
+            "                  frame\n"
+            "  --envelope-steps N\n"
+            "                  envelope levels per hop (default 1)\n"
+            "  --envelope-attack MS, --envelope-release MS\n"
+            "                  envelope time constants (default %.0f and %.0f)\n"
+            "  --window-type T window function: ones, hanning, hanningz, hamming,\n"
+            "                  blackman, ... (default %s)\n"
+            "  --generic-kernels\n"
+            "                  use the generic per-sample loops even for window, hop\n"
+            "                  and envelope step lengths with specialized ones\n"
+            "  --bands N       send N log-spaced spectrum bands instead of the\n"
+            "                  legacy 256-bucket layout\n"
+            "  --fmin HZ       lowest spectrum band edge (default %.0f)\n"
+            "  --fmax HZ       highest spectrum band edge (default %.0f)\n"
+            "  --chroma        also send the level of each of the 12 pitch classes\n"
+            "  --mel N         also send N mel bands between --fmin and --fmax\n"
+            "  --spectrum-threshold DB\n"
+            "                  send a spectrum when it has changed by DB dB RMS\n"
+            "                  since the last one sent (default %.1f, 0 for every\n"
+            "                  hop)\n"
+            "  --spectrum-min-rate HZ\n"
+            "                  send at least HZ spectra per second even when nothing\n"
+            "                  changes (default %.0f, 0 for no keepalive)\n"
+            "  --spectrum-max-rate HZ\n"
+            "                  send at most HZ spectra per second, transients\n"
+            "                  excepted (default %.0f, 0 for no limit)\n"
+            "  --protocol P    v2 (default): one datagram per channel per hop with\n"
+            "                  sequence number and frame time; legacy: separate\n"
+            "                  fft, onset and pitch datagrams\n"
+            "  --spectrum-encoding E\n"
+            "                  v2 spectrum encoding: float, log16 or log8 (default\n"
+            "                  float for localhost, log8 for remote hosts)\n"
+            "  --delta         delta-code log16/log8 spectra against the previous\n"
+            "                  frame\n"
+            "  --subscriber HOST[:PORT][,OPTION...]\n"
+            "                  also send to HOST; may be repeated.  Options:\n"
+            "                  streams=spectrum+pitch+onset+tempo+envelope+chroma\n"
+            "                  +mel,\n"
+            "                  channels=0+1+...,\n"
+            "                  rate=HZ (most spectra per second), protocol=P,\n"
+            "                  encoding=E, delta\n"
+            "  --listen PORT   accept subscribe messages on UDP port PORT\n"
+            "                  (usually %d)\n"
+            "  --stats S       log latency and drop statistics every S seconds, 0\n"
+            "                  to disable (default %d)\n",
+            argv0, TRANSMIT_PORT, MAX_CHANNELS, RT_DEFAULT_PRIORITY,
+            LOAD_DEFAULT_BUDGET * 100,
+            DEFAULT_WINDOW_SIZE, DEFAULT_HOP_SIZE,
+            ENVELOPE_DEFAULT_ATTACK_MS, ENVELOPE_DEFAULT_RELEASE_MS,
+            DEFAULT_WINDOW_TYPE, SPECTRUM_DEFAULT_FMIN, SPECTRUM_DEFAULT_FMAX,
+            SPECTRUM_GATE_DEFAULT_THRESHOLD_DB, SPECTRUM_GATE_DEFAULT_MIN_RATE,
+            SPECTRUM_GATE_DEFAULT_MAX_RATE, SUBSCRIBE_PORT, DEFAULT_STATS_INTERVAL);
+}
+
+
+static bool resolve(const QString& host, QHostAddress *address)
+{
+    QHostInfo host_info = QHostInfo::fromName(host);
+    if (host_info.error() != QHostInfo::NoError || host_info.addresses().empty()) {
+        fprintf(stderr, "Could not resolve host: %s: %s\n", host.toUtf8().constData(),
+                host_info.errorString().toUtf8().constData());
+        return false;
+    }
+    *address = host_info.addresses().first();
+    return true;
+}
+
+
+// Parses a --subscriber argument, HOST[:PORT][,OPTION...], on top of the
+// settings given by the other options
+static bool parse_subscriber(const char *spec, bool encoding_set,
+                             Networking::Subscriber *subscriber)
+{
+    QStringList fields = QString(spec).split(",");
+    QString host = fields.takeFirst();
+
+    int colon = host.indexOf(":");
+    if (colon >= 0 && colon == host.lastIndexOf(":")) {
+        bool ok;
+        subscriber->port = host.mid(colon + 1).toUShort(&ok);
+        if (!ok) {
+            return false;
+        }
+        host = host.left(colon);
+    }
+    if (!resolve(host, &subscriber->address)) {
+        return false;
+    }
+
+    // Keep spectra to a quarter of their float size over the network
+    if (!encoding_set && subscriber->address != QHostAddress(QHostAddress::LocalHost)
+        && subscriber->address != QHostAddress(QHostAddress::LocalHostIPv6))
+    {
+        subscriber->encoding = SpectrumCodec::ENCODING_LOG8;
+    }
+
+    for (int i = 0; i < fields.size(); i++) {
+        QString name = fields[i].section("=", 0, 0);
+        QString value = fields[i].section("=", 1);
+        bool ok = true;
+
+        if (name == "streams") {
+            QStringList streams = value.split("+");
+            subscriber->streams = 0;
+            for (int j = 0; j < streams.size() && ok; j++) {
+                if (streams[j] == "spectrum") {
+                    subscriber->streams |= STREAM_SPECTRUM;
+                } else if (streams[j] == "pitch") {
+                    subscriber->streams |= STREAM_PITCH;
+                } else if (streams[j] == "onset") {
+                    subscriber->streams |= STREAM_ONSET;
+                } else if (streams[j] == "envelope") {
+                    subscriber->streams |= STREAM_ENVELOPE;
+                } else if (streams[j] == "tempo") {
+                    subscriber->streams |= STREAM_TEMPO;
+                } else if (streams[j] == "chroma") {
+                    subscriber->streams |= STREAM_CHROMA;
+                } else if (streams[j] == "mel") {
+                    subscriber->streams |= STREAM_MEL;
+                } else {
+                    ok = false;
+                }
+            }
+        } else if (name == "channels") {
+            QStringList channels = value.split("+");
+            subscriber->channels = 0;
+            for (int j = 0; j < channels.size() && ok; j++) {
+                unsigned int c = channels[j].toUInt(&ok);
+                ok = ok && c < MAX_CHANNELS;
+                subscriber->channels |= 1 << c;
+            }
+        } else if (name == "rate") {
+            subscriber->spectrum_rate = value.toUInt(&ok);
+        } else if (name == "protocol" && value == "legacy") {
+            subscriber->protocol = Networking::PROTOCOL_LEGACY;
+        } else if (name == "protocol" && value == "v2") {
+            subscriber->protocol = Networking::PROTOCOL_V2;
+        } else if (name == "encoding") {
+            ok = SpectrumCodec::parse_encoding(value.toUtf8().constData(),
+                                               &subscriber->encoding);
+        } else if (name == "delta") {
+            subscriber->delta = true;
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            fprintf(stderr, "Bad subscriber option: %s\n", fields[i].toUtf8().constData());
+            return false;
+        }
+    }
+
+    return true;
+}
 
 
 int main(int argc, char** argv)
 {
     QCoreApplication app(argc, argv);
 
-    QHostAddress dest_addr;
-    unsigned int fft_send_interval = 1024;
-    if (argc > 1) {
-        QHostInfo host_info = QHostInfo::fromName(argv[1]);
-        if (host_info.error() != QHostInfo::NoError
-            || host_info.addresses().empty())
+    const char *host = NULL;
+    const char *input_path = NULL;
+    const char *output_path = NULL;
+    const char *shm_name = NULL;
+    const char *record_path = NULL;
+    int raw_samplerate = 0;
+    bool drop_frames = false;
+    unsigned int channels = 1;
+    unsigned int workers = 0;
+    Networking::Protocol protocol = Networking::PROTOCOL_V2;
+    SpectrumCodec::Encoding encoding = SpectrumCodec::ENCODING_FLOAT;
+    bool encoding_set = false;
+    bool delta = false;
+    int stats_interval = DEFAULT_STATS_INTERVAL;
+    const char *subscriber_specs[MAX_SUBSCRIBERS];
+    int subscriber_count = 0;
+    int listen_port = 0;
+    AnalyzerConfig config;
+    AnalyzerConfig onset_config;
+    bool onset_chain = false;
+    bool onset_hop_set = false;
+    bool envelopes = false;
+    RealtimeConfig realtime;
+    float dsp_budget = LOAD_DEFAULT_BUDGET;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            input_path = argv[++i];
+        } else if (strcmp(argv[i], "--raw") == 0 && i + 1 < argc) {
+            raw_samplerate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--drop-frames") == 0) {
+            drop_frames = true;
+        } else if (strcmp(argv[i], "--channels") == 0 && i + 1 < argc) {
+            channels = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--realtime") == 0) {
+            realtime.lock_memory = true;
+            if (realtime.priority == 0) {
+                realtime.priority = RT_DEFAULT_PRIORITY;
+            }
+        } else if (strcmp(argv[i], "--rt-priority") == 0 && i + 1 < argc) {
+            realtime.lock_memory = true;
+            realtime.priority = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cpus") == 0 && i + 1 < argc) {
+            QStringList cpus = QString(argv[++i]).split(",");
+            if (cpus.size() > RT_MAX_CPUS) {
+                usage(argv[0]);
+                return 1;
+            }
+            realtime.num_cpus = cpus.size();
+            for (int k = 0; k < cpus.size(); k++) {
+                realtime.cpus[k] = cpus[k].toInt();
+            }
+        } else if (strcmp(argv[i], "--dsp-budget") == 0 && i + 1 < argc) {
+            dsp_budget = atof(argv[++i]) / 100;
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+#ifndef _WIN32
+        } else if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+            shm_name = argv[++i];
+#endif
+        } else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            config.window_size = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--hop") == 0 && i + 1 < argc) {
+            config.hop_size = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--onset-window") == 0 && i + 1 < argc) {
+            onset_config.window_size = atoi(argv[++i]);
+            onset_chain = true;
+        } else if (strcmp(argv[i], "--onset-hop") == 0 && i + 1 < argc) {
+            onset_config.hop_size = atoi(argv[++i]);
+            onset_hop_set = true;
+        } else if (strcmp(argv[i], "--no-tempo") == 0) {
+            config.stages &= ~CHAIN_TEMPO;
+        } else if (strcmp(argv[i], "--envelopes") == 0 && i + 1 < argc) {
+            QStringList crossovers = QString(argv[++i]).split(",");
+            if (crossovers.size() > MAX_ENVELOPE_BANDS - 1) {
+                usage(argv[0]);
+                return 1;
+            }
+            config.envelope_crossovers = crossovers.size();
+            for (int k = 0; k < crossovers.size(); k++) {
+                bool ok;
+                config.envelope_crossover[k] = crossovers[k].toFloat(&ok);
+                float previous = k > 0 ? config.envelope_crossover[k - 1] : 0;
+                if (!ok || config.envelope_crossover[k] <= previous) {
+                    fprintf(stderr, "Envelope crossovers must be ascending frequencies "
+                            "above 0 Hz\n");
+                    return 1;
+                }
+            }
+            envelopes = true;
+        } else if (strcmp(argv[i], "--envelope-steps") == 0 && i + 1 < argc) {
+            config.envelope_steps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--envelope-attack") == 0 && i + 1 < argc) {
+            config.envelope_attack_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--envelope-release") == 0 && i + 1 < argc) {
+            config.envelope_release_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--generic-kernels") == 0) {
+            Kernels::set_generic(true);
+        } else if (strcmp(argv[i], "--window-type") == 0 && i + 1 < argc) {
+            config.window_type = argv[++i];
+        } else if (strcmp(argv[i], "--bands") == 0 && i + 1 < argc) {
+            config.bands = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fmin") == 0 && i + 1 < argc) {
+            config.fmin = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--fmax") == 0 && i + 1 < argc) {
+            config.fmax = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--chroma") == 0) {
+            config.stages |= CHAIN_CHROMA;
+        } else if (strcmp(argv[i], "--mel") == 0 && i + 1 < argc) {
+            config.mel_bands = atoi(argv[++i]);
+            config.stages |= CHAIN_MEL;
+        } else if (strcmp(argv[i], "--spectrum-threshold") == 0 && i + 1 < argc) {
+            config.spectrum_threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--spectrum-min-rate") == 0 && i + 1 < argc) {
+            config.spectrum_min_rate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--spectrum-max-rate") == 0 && i + 1 < argc) {
+            config.spectrum_max_rate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--protocol") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            if (strcmp(name, "legacy") == 0) {
+                protocol = Networking::PROTOCOL_LEGACY;
+            } else if (strcmp(name, "v2") == 0) {
+                protocol = Networking::PROTOCOL_V2;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--spectrum-encoding") == 0 && i + 1 < argc) {
+            if (!SpectrumCodec::parse_encoding(argv[++i], &encoding)) {
+                usage(argv[0]);
+                return 1;
+            }
+            encoding_set = true;
+        } else if (strcmp(argv[i], "--delta") == 0) {
+            delta = true;
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            stats_interval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--subscriber") == 0 && i + 1 < argc
+                   && subscriber_count < MAX_SUBSCRIBERS) {
+            subscriber_specs[subscriber_count++] = argv[++i];
+        } else if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc) {
+            listen_port = atoi(argv[++i]);
+        } else if (strncmp(argv[i], "--", 2) == 0 || host != NULL) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            host = argv[i];
+        }
+    }
+
+    // With --onset-window, a second chain per channel takes over the onsets
+    unsigned int chains = 1;
+    AnalyzerConfig chain_configs[MAX_CHAINS];
+    chain_configs[0] = config;
+    if (onset_chain) {
+        if (!onset_hop_set) {
+            onset_config.hop_size = onset_config.window_size;
+        }
+        onset_config.window_type = config.window_type;
+        onset_config.stages = CHAIN_ONSET | (config.stages & CHAIN_TEMPO);
+        chain_configs[0].stages &= ~(CHAIN_ONSET | CHAIN_TEMPO);
+        chain_configs[chains++] = onset_config;
+    }
+
+    // Envelopes ride along with the onset chain if there is one, since its
+    // hop is usually the shortest
+    if (envelopes) {
+        AnalyzerConfig& chain = chain_configs[chains - 1];
+        chain.envelope_crossovers = config.envelope_crossovers;
+        for (unsigned int k = 0; k < config.envelope_crossovers; k++) {
+            chain.envelope_crossover[k] = config.envelope_crossover[k];
+        }
+        chain.envelope_steps = config.envelope_steps;
+        chain.envelope_attack_ms = config.envelope_attack_ms;
+        chain.envelope_release_ms = config.envelope_release_ms;
+        chain.stages |= CHAIN_ENVELOPE;
+
+        if (chain.envelope_steps < 1 || chain.envelope_steps > MAX_ENVELOPE_STEPS
+            || chain.hop_size % chain.envelope_steps != 0)
+        {
+            fprintf(stderr, "Envelope steps must divide the hop, and be at most %d\n",
+                    MAX_ENVELOPE_STEPS);
+            return 1;
+        }
+    }
+
+    for (unsigned int k = 0; k < chains; k++) {
+        const AnalyzerConfig& chain = chain_configs[k];
+        if (chain.window_size < 32 || (chain.window_size & (chain.window_size - 1))
+            || chain.hop_size == 0 || chain.hop_size > chain.window_size)
         {
-            qFatal("Could not resolve host: %s: %s", argv[1],
-                   host_info.errorString().toUtf8().constData());
-            exit(1);
+            fprintf(stderr, "Window must be a power of two >= 32 and hop between 1 "
+                    "and the window length\n");
+            return 1;
         }
-        dest_addr = host_info.addresses().first();
-        // Increase the FFT send interval when sending data over the network
-        fft_send_interval *= 4;
+    }
+
+    if (config.bands > MAX_BANDS) {
+        fprintf(stderr, "At most %d spectrum bands are supported\n", MAX_BANDS);
+        return 1;
+    }
+
+    if (config.fmin <= 0 || config.fmax <= config.fmin) {
+        fprintf(stderr, "The lowest band edge must be above 0 Hz and below the highest\n");
+        return 1;
+    }
+
+    if ((config.stages & CHAIN_MEL)
+        && (config.mel_bands < 1 || config.mel_bands > MAX_MEL_BANDS))
+    {
+        fprintf(stderr, "Between 1 and %d mel bands are supported\n", MAX_MEL_BANDS);
+        return 1;
+    }
+
+    if (channels < 1 || channels > MAX_CHANNELS) {
+        fprintf(stderr, "Between 1 and %d channels are supported\n", MAX_CHANNELS);
+        return 1;
+    }
+
+    if (realtime.lock_memory && (realtime.priority < 1 || realtime.priority > 99)) {
+        fprintf(stderr, "Realtime priority must be between 1 and 99\n");
+        return 1;
+    }
+
+    for (unsigned int k = 0; k < realtime.num_cpus; k++) {
+        if (realtime.cpus[k] < 0 || realtime.cpus[k] >= QThread::idealThreadCount()) {
+            fprintf(stderr, "CPUs must be between 0 and %d\n",
+                    QThread::idealThreadCount() - 1);
+            return 1;
+        }
+    }
+
+    // Subscribers given on the command line: host, then --subscriber.  With
+    // neither, nor --listen, send to localhost as always.
+    Networking::Subscriber subscribers[MAX_SUBSCRIBERS + 1];
+    int subscribers_given = 0;
+    Networking::Subscriber defaults;
+    defaults.protocol = protocol;
+    defaults.encoding = encoding;
+    defaults.delta = delta;
+    if (protocol == Networking::PROTOCOL_LEGACY && (encoding_set || delta)) {
+        qDebug() << "The legacy protocol always sends float spectra";
+    }
+
+    if (host != NULL) {
+        subscribers[subscribers_given] = defaults;
+        if (!parse_subscriber(host, encoding_set, &subscribers[subscribers_given])) {
+            return 1;
+        }
+        subscribers_given++;
+    } else if (subscriber_count == 0 && listen_port == 0) {
+        subscribers[subscribers_given++] = defaults;
+    }
+    for (int i = 0; i < subscriber_count; i++) {
+        subscribers[subscribers_given] = defaults;
+        if (!parse_subscriber(subscriber_specs[i], encoding_set,
+                              &subscribers[subscribers_given]))
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        subscribers_given++;
+    }
+
+    // A test build that can't catch what it is built to catch would pass
+    // silently
+    if (!Realtime::test_checks()) {
+        return 1;
+    }
+
+    // Locked before JACK and the analysis threads start, so that their
+    // buffers and stacks are locked too
+    if (realtime.lock_memory && !Realtime::lock_memory()) {
+        fprintf(stderr, "Could not lock memory for --realtime\n");
+        return 1;
+    }
+
+    AudioSource *source;
+    if (input_path != NULL) {
+        FileSource *file_source = new FileSource(input_path, raw_samplerate,
+                                                 channels > 1, channels);
+        if (!file_source->is_open()) {
+            delete file_source;
+            return 1;
+        }
+        source = file_source;
     } else {
-        dest_addr = QHostAddress::LocalHost;
+        JackClient *jack_client = new JackClient(channels);
+        if (!jack_client->is_open()) {
+            delete jack_client;
+            return 1;
+        }
+        source = jack_client;
     }
 
-    qDebug() << "Sending FFT data to" << dest_addr << "port" << TRANSMIT_PORT
-             << "interval" << fft_send_interval;
+    // Only now that the sample rate is known
+    float nyquist = source->samplerate() / 2.0;
+    if (envelopes && config.envelope_crossover[config.envelope_crossovers - 1] >= nyquist) {
+        fprintf(stderr, "Envelope crossovers must be below %g Hz, half the sample rate\n",
+                nyquist);
+        delete source;
+        return 1;
+    }
+
+    FrameSink *sink;
+    if (output_path != NULL) {
+        FrameWriter *writer = new FrameWriter(output_path);
+        if (!writer->is_open()) {
+            delete writer;
+            delete source;
+            return 1;
+        }
+        sink = writer;
+#ifndef _WIN32
+    } else if (shm_name != NULL) {
+        ShmPublisher *publisher = new ShmPublisher(shm_name, source->channels());
+        if (!publisher->is_open()) {
+            delete publisher;
+            delete source;
+            return 1;
+        }
+        sink = publisher;
+#endif
+    } else {
+        Networking *networking = new Networking();
+        for (int i = 0; i < subscribers_given; i++) {
+            networking->add_subscriber(subscribers[i]);
+        }
+        if (listen_port != 0 && !networking->listen(listen_port)) {
+            delete networking;
+            delete source;
+            return 1;
+        }
+        sink = networking;
+    }
+
+    if (record_path != NULL) {
+        FrameRecorder *recorder = new FrameRecorder(record_path, encoding, sink);
+        if (!recorder->is_open()) {
+            delete recorder;
+            delete source;
+            return 1;
+        }
+        sink = recorder;
+    }
 
-    JackClient jc(fft_send_interval);
-    Networking net(dest_addr, TRANSMIT_PORT);
+    channels = source->channels();
+    if (workers == 0) {
+        workers = QThread::idealThreadCount();
+    }
+    if (workers > channels * chains) {
+        workers = channels * chains;
+    }
+
+    // Chain by chain, so that a channel's chains land on different workers
+    unsigned int count = channels * chains;
+    Analyzer *analyzers[MAX_CHANNELS * MAX_CHAINS];
+    FrameQueue *queues[MAX_CHANNELS * MAX_CHAINS];
+    for (unsigned int i = 0; i < count; i++) {
+        analyzers[i] = new Analyzer(i % channels, source->samplerate(),
+                                    chain_configs[i / channels]);
+        queues[i] = analyzers[i]->queue();
+        queues[i]->set_blocking(!source->is_realtime() && !drop_frames);
+    }
+    AnalysisThread *analysis = new AnalysisThread(source, analyzers, count, workers,
+                                                  realtime, dsp_budget);
+    FrameSender *sender = new FrameSender(queues, count, sink,
+                                          stats_interval > 0 ? stats_interval : 0);
+    if (realtime.lock_memory) {
+        sender->setStackSize(RT_STACK_SIZE);
+    }
+
+    // The analyzers publish their frames to the sender through lock-free
+    // queues.  The sender hands each one to the sink directly, on its own
+    // thread, and then returns it to its pool.
+    sink->moveToThread(sender);
 
-    QObject::connect(&jc, SIGNAL(onset_detected()), &net, SLOT(transmit_onset()));
-    QObject::connect(&jc, SIGNAL(fft_data(int, float*)), &net, SLOT(transmit_fft_data(int, float*)));
-    QObject::connect(&jc, SIGNAL(pitch_data(float,float)), &net, SLOT(transmit_pitch_data(float,float)));
+    for (unsigned int i = 0; i < count; i++) {
+        analyzers[i]->moveToThread(analysis);
+    }
+
+    // Offline sources end by themselves; quit once they have been analysed
+    // and everything has been sent
+    QObject::connect(analysis, SIGNAL(finished()), sender, SLOT(finish()));
+    QObject::connect(sender, SIGNAL(finished()), &app, SLOT(quit()));
+
+    sender->start();
+    analysis->start();
+    int ret = app.exec();
+
+    delete analysis;
+    delete sender;
+    for (unsigned int i = 0; i < count; i++) {
+        delete analyzers[i];
+    }
+    // Frees FFTW's plans and wisdom, so only once no analyzer holds a plan
+    aubio_cleanup();
+    delete sink;
+    delete source;
 
-    return app.exec();
+    return ret;
 }
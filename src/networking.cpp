@@ -20,18 +20,54 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
+#include <string.h>
+
 #include "networking.h"
+#include "byte_order.h"
+
+
+Networking::Subscriber::Subscriber()
+    : address(QHostAddress::LocalHost), port(TRANSMIT_PORT), protocol(PROTOCOL_V2),
+      encoding(SpectrumCodec::ENCODING_FLOAT), delta(false), streams(STREAM_ALL),
+      channels((1 << MAX_CHANNELS) - 1), spectrum_rate(0)
+{
+}
+
+
+Networking::Stream::Stream(const Subscriber& subscriber)
+    : protocol(subscriber.protocol), streams(subscriber.streams),
+      spectrum_rate(subscriber.spectrum_rate),
+      codec(subscriber.encoding, subscriber.delta), users(0)
+{
+    for (int c = 0; c < MAX_CHANNELS; c++) {
+        sequence[c] = 0;
+        spectrum_time[c] = 0;
+        spectrum_sent[c] = false;
+    }
+}
 
 
-Networking::Networking(const QHostAddress& dest_addr, uint16_t port_num)
-    : _dest_addr(dest_addr), _port_num(port_num)
+bool Networking::Stream::matches(const Subscriber& subscriber) const
+{
+    return subscriber.protocol == protocol && subscriber.streams == streams
+        && subscriber.spectrum_rate == spectrum_rate
+        && subscriber.encoding == codec.encoding() && subscriber.delta == codec.delta();
+}
+
+
+Networking::Networking()
+    : _subscription_count(0), _listening(false)
 {
     _socket = new QUdpSocket(this);
+    _clock.start();
 }
 
 
 Networking::~Networking()
 {
+    while (_subscription_count > 0) {
+        unsubscribe(_subscription_count - 1);
+    }
 }
 
 
@@ -47,36 +83,554 @@ bool Networking::close(void)
 }
 
 
-void Networking::transmit_onset()
+// The legacy messages are in host byte order, as they always have been
+int Networking::encode_onset(char *buf, int channel)
+{
+    buf[0] = MSG_ONSET;
+    buf[1] = (char)channel;
+    return 2;
+}
+
+
+int Networking::encode_fft_data(char *buf, int channel, int len, const float *data)
+{
+    buf[0] = MSG_FFT;
+    buf[1] = (char)len;
+    buf[2] = (char)((len & 0xff00) >> 8);
+    memcpy(buf + 3, data, len * sizeof(float));
+    buf[3 + len * sizeof(float)] = (char)channel;
+    return 3 + len * sizeof(float) + 1;
+}
+
+
+int Networking::encode_pitch_data(char *buf, int channel, float pitch, float confidence)
+{
+    buf[0] = MSG_PITCH;
+    memcpy(buf + 1, &pitch, sizeof(float));
+    memcpy(buf + 1 + sizeof(float), &confidence, sizeof(float));
+    buf[1 + 2 * sizeof(float)] = (char)channel;
+    return 1 + 2 * sizeof(float) + 1;
+}
+
+
+int Networking::encode_frame(char *buf, uint32_t sequence, const AnalysisFrame& frame,
+                             SpectrumCodec *codec, unsigned int streams)
+{
+    bool onset = frame.onset && (streams & STREAM_ONSET);
+    bool pitch = frame.has_pitch && (streams & STREAM_PITCH);
+    bool envelope = frame.has_envelope && (streams & STREAM_ENVELOPE);
+    bool tempo = frame.has_tempo && (streams & STREAM_TEMPO);
+    unsigned int chroma = frame.has_chroma && (streams & STREAM_CHROMA) ? CHROMA_BINS : 0;
+    unsigned int mel = frame.has_mel && (streams & STREAM_MEL) ? frame.mel_bands : 0;
+    unsigned int bands = frame.has_spectrum && (streams & STREAM_SPECTRUM) ? frame.bands : 0;
+    SpectrumCodec::Encoding encoding = codec ? codec->encoding() : SpectrumCodec::ENCODING_FLOAT;
+    char *spectrum = buf + FRAME_HEADER_SIZE;
+    int spectrum_len = 0;
+    bool delta = false;
+
+    if (envelope) {
+        char *e = spectrum;
+        *e++ = (char)frame.envelope_bands;
+        *e++ = (char)frame.envelope_steps;
+        e = put_u16(e, frame.envelope_step_frames);
+        for (unsigned int s = 0; s < frame.envelope_steps; s++) {
+            for (unsigned int b = 0; b < frame.envelope_bands; b++) {
+                e = put_float(e, frame.envelopes[s][b].envelope);
+                e = put_float(e, frame.envelopes[s][b].peak);
+                e = put_float(e, frame.envelopes[s][b].rms);
+            }
+        }
+        spectrum = e;
+    }
+
+    if (tempo) {
+        char *t = spectrum;
+        t = put_float(t, frame.bpm);
+        t = put_float(t, frame.tempo_confidence);
+        t = put_float(t, frame.beat_phase);
+        for (int i = 0; i < TEMPO_PREDICTED_BEATS; i++) {
+            t = put_u32(t, frame.next_beats[i]);
+        }
+        spectrum = t;
+    }
+
+    if (frame.has_load) {
+        char *l = spectrum;
+        float load = frame.load * 1000 + 0.5f;
+        l = put_u16(l, load < 65535 ? (uint16_t)load : 65535);
+        *l++ = (char)frame.shed_level;
+        *l++ = 0;
+        spectrum = l;
+    }
+
+    if (chroma || mel) {
+        char *f = spectrum;
+        *f++ = (char)chroma;
+        *f++ = (char)mel;
+        *f++ = (char)encoding;
+        *f++ = 0;
+        f += SpectrumCodec::encode_levels(f, encoding, frame.chroma, chroma);
+        f += SpectrumCodec::encode_levels(f, encoding, frame.mel, mel);
+        spectrum = f;
+    }
+
+    if (bands && codec) {
+        spectrum_len = codec->encode(spectrum, frame.channel, sequence,
+                                     frame.spectrum, bands, &delta);
+    } else if (bands) {
+        spectrum_len = SpectrumCodec::encode_float(spectrum, frame.spectrum, bands);
+    }
+
+    char *p = buf;
+    *p++ = (char)MSG_FRAME;
+    *p++ = PROTOCOL_VERSION;
+    *p++ = (char)frame.channel;
+    *p++ = (onset ? FRAME_FLAG_ONSET : 0) | (bands ? FRAME_FLAG_SPECTRUM : 0)
+           | (delta ? FRAME_FLAG_DELTA : 0) | (pitch ? FRAME_FLAG_PITCH : 0)
+           | (envelope ? FRAME_FLAG_ENVELOPE : 0) | (tempo ? FRAME_FLAG_TEMPO : 0)
+           | (frame.has_load ? FRAME_FLAG_LOAD : 0)
+           | (chroma || mel ? FRAME_FLAG_FEATURES : 0);
+    p = put_u32(p, sequence);
+    p = put_u32(p, frame.time);
+    p = put_u32(p, frame.samplerate);
+    p = put_float(p, pitch ? frame.pitch : 0);
+    p = put_float(p, pitch ? frame.confidence : 0);
+    p = put_u16(p, bands);
+    *p++ = (char)encoding;
+    *p++ = 0;
+
+    return spectrum - buf + spectrum_len;
+}
+
+
+bool Networking::decode_frame(const char *buf, int len, uint32_t *sequence,
+                              AnalysisFrame *frame, SpectrumCodec *codec)
 {
-    QByteArray dgram;
-    dgram.resize(1);
-    dgram[0] = MSG_ONSET;
-    //qDebug() << "beat";
-    _socket->writeDatagram(dgram, _dest_addr, _port_num);
+    if (len < FRAME_HEADER_SIZE || (unsigned char)buf[0] != MSG_FRAME
+        || buf[1] != PROTOCOL_VERSION)
+    {
+        return false;
+    }
+
+    const char *p = buf + 2;
+    uint8_t flags, encoding;
+    uint32_t time, samplerate;
+    uint16_t bands;
+
+    frame->channel = (unsigned char)*p++;
+    flags = (unsigned char)*p++;
+    p = get_u32(p, sequence);
+    p = get_u32(p, &time);
+    p = get_u32(p, &samplerate);
+    p = get_float(p, &frame->pitch);
+    p = get_float(p, &frame->confidence);
+    p = get_u16(p, &bands);
+    encoding = (unsigned char)*p++;
+    p++;
+
+    if (frame->channel >= MAX_CHANNELS || bands > MAX_BANDS) {
+        return false;
+    }
+
+    frame->time = time;
+    frame->samplerate = samplerate;
+    frame->onset = (flags & FRAME_FLAG_ONSET) != 0;
+    frame->has_pitch = (flags & FRAME_FLAG_PITCH) != 0;
+    frame->has_spectrum = (flags & FRAME_FLAG_SPECTRUM) != 0 && bands > 0;
+    frame->bands = bands;
+
+    frame->has_envelope = (flags & FRAME_FLAG_ENVELOPE) != 0;
+    if (frame->has_envelope) {
+        if (buf + len - p < ENVELOPE_HEADER_SIZE) {
+            return false;
+        }
+        uint16_t step_frames;
+        frame->envelope_bands = (unsigned char)*p++;
+        frame->envelope_steps = (unsigned char)*p++;
+        p = get_u16(p, &step_frames);
+        frame->envelope_step_frames = step_frames;
+
+        int size = frame->envelope_steps * frame->envelope_bands * 3 * sizeof(float);
+        if (frame->envelope_bands > MAX_ENVELOPE_BANDS
+            || frame->envelope_steps > MAX_ENVELOPE_STEPS || buf + len - p < size)
+        {
+            return false;
+        }
+        for (unsigned int s = 0; s < frame->envelope_steps; s++) {
+            for (unsigned int b = 0; b < frame->envelope_bands; b++) {
+                p = get_float(p, &frame->envelopes[s][b].envelope);
+                p = get_float(p, &frame->envelopes[s][b].peak);
+                p = get_float(p, &frame->envelopes[s][b].rms);
+            }
+        }
+    }
+
+    frame->has_tempo = (flags & FRAME_FLAG_TEMPO) != 0;
+    if (frame->has_tempo) {
+        if (buf + len - p < TEMPO_SECTION_SIZE) {
+            return false;
+        }
+        p = get_float(p, &frame->bpm);
+        p = get_float(p, &frame->tempo_confidence);
+        p = get_float(p, &frame->beat_phase);
+        for (int i = 0; i < TEMPO_PREDICTED_BEATS; i++) {
+            uint32_t beat;
+            p = get_u32(p, &beat);
+            frame->next_beats[i] = beat;
+        }
+    }
+
+    frame->has_load = (flags & FRAME_FLAG_LOAD) != 0;
+    if (frame->has_load) {
+        if (buf + len - p < LOAD_SECTION_SIZE) {
+            return false;
+        }
+        uint16_t load;
+        p = get_u16(p, &load);
+        frame->load = load / 1000.0f;
+        frame->shed_level = (unsigned char)*p++;
+        p++;
+    }
+
+    frame->has_chroma = false;
+    frame->has_mel = false;
+    if (flags & FRAME_FLAG_FEATURES) {
+        if (buf + len - p < FEATURES_HEADER_SIZE) {
+            return false;
+        }
+        unsigned int chroma = (unsigned char)*p++;
+        unsigned int mel = (unsigned char)*p++;
+        SpectrumCodec::Encoding features = (SpectrumCodec::Encoding)(unsigned char)*p++;
+        p++;
+        if ((chroma != 0 && chroma != CHROMA_BINS) || mel > MAX_MEL_BANDS) {
+            return false;
+        }
+
+        int used = SpectrumCodec::decode_levels(p, buf + len - p, features,
+                                                frame->chroma, chroma);
+        if (used < 0) {
+            return false;
+        }
+        p += used;
+        used = SpectrumCodec::decode_levels(p, buf + len - p, features, frame->mel, mel);
+        if (used < 0) {
+            return false;
+        }
+        p += used;
+        frame->has_chroma = chroma > 0;
+        frame->has_mel = mel > 0;
+        frame->mel_bands = mel;
+    }
+
+    if (frame->has_spectrum) {
+        int used;
+        if (codec) {
+            used = codec->decode(p, buf + len - p, (SpectrumCodec::Encoding)encoding,
+                                 (flags & FRAME_FLAG_DELTA) != 0, frame->channel,
+                                 *sequence, frame->spectrum, bands);
+        } else if (encoding == SpectrumCodec::ENCODING_FLOAT) {
+            used = SpectrumCodec::decode_float(p, buf + len - p, frame->spectrum, bands);
+        } else {
+            used = -1;
+        }
+        frame->has_spectrum = used >= 0;
+    }
+
+    return true;
 }
 
-void Networking::transmit_fft_data(int len, float *data)
+
+int Networking::encode_subscribe(char *buf, const Subscriber& subscriber)
 {
-    QByteArray dgram;
-    dgram.resize(3 + len * sizeof(float));
-    dgram[0] = MSG_FFT;
-    dgram[1] = (char)len;
-    dgram[2] = (char)((len & 0xff00) >> 8);
-    memcpy(dgram.data() + 3, data, len * sizeof(float));
-    _socket->writeDatagram(dgram, _dest_addr, _port_num);
+    char *p = buf;
+    *p++ = (char)MSG_SUBSCRIBE;
+    *p++ = PROTOCOL_VERSION;
+    *p++ = (char)(subscriber.streams & STREAM_ALL);
+    *p++ = (char)subscriber.protocol;
+    *p++ = (char)subscriber.encoding;
+    *p++ = subscriber.delta ? SUBSCRIBE_FLAG_DELTA : 0;
+    p = put_u16(p, subscriber.channels);
+    p = put_u16(p, subscriber.spectrum_rate);
+    p = put_u16(p, subscriber.port);
+    return SUBSCRIBE_SIZE;
 }
 
 
-void Networking::transmit_pitch_data(float pitch, float confidence)
+bool Networking::decode_subscribe(const char *buf, int len, Subscriber *subscriber)
 {
-    QByteArray dgram;
-    dgram.resize(1 + 2 * sizeof(float));
-    float *ptr = (float *)(dgram.data() + 1);
+    if (len < SUBSCRIBE_SIZE || (unsigned char)buf[0] != MSG_SUBSCRIBE
+        || buf[1] != PROTOCOL_VERSION)
+    {
+        return false;
+    }
+
+    const char *p = buf + 2;
+    uint8_t streams = (unsigned char)*p++;
+    uint8_t protocol = (unsigned char)*p++;
+    uint8_t encoding = (unsigned char)*p++;
+    uint8_t flags = (unsigned char)*p++;
+    uint16_t channels, spectrum_rate, port;
+    p = get_u16(p, &channels);
+    p = get_u16(p, &spectrum_rate);
+    p = get_u16(p, &port);
 
-    dgram[0] = MSG_PITCH;
-    *ptr++ = pitch;
-    *ptr = confidence;
+    if (protocol > PROTOCOL_V2 || encoding > SpectrumCodec::ENCODING_LOG8) {
+        return false;
+    }
+
+    subscriber->streams = streams & STREAM_ALL;
+    subscriber->protocol = (Protocol)protocol;
+    subscriber->encoding = (SpectrumCodec::Encoding)encoding;
+    subscriber->delta = (flags & SUBSCRIBE_FLAG_DELTA) != 0;
+    subscriber->channels = channels;
+    subscriber->spectrum_rate = spectrum_rate;
+    subscriber->port = port;
+    return true;
+}
+
+
+bool Networking::listen(uint16_t port)
+{
+    if (!_socket->bind(QHostAddress::Any, port)) {
+        qDebug() << "Could not listen for subscribers on port" << port << ":"
+                 << _socket->errorString();
+        return false;
+    }
+    _listening = true;
+    return true;
+}
+
+
+bool Networking::add_subscriber(const Subscriber& subscriber)
+{
+    return subscribe(subscriber, 0);
+}
+
+
+bool Networking::subscribe(const Subscriber& subscriber, qint64 expires)
+{
+    if (_subscription_count == MAX_SUBSCRIBERS) {
+        qDebug() << "Too many subscribers, ignoring" << subscriber.address.toString();
+        return false;
+    }
+
+    Subscriber normalized = subscriber;
+    if (normalized.protocol == PROTOCOL_LEGACY) {
+        normalized.encoding = SpectrumCodec::ENCODING_FLOAT;
+        normalized.delta = false;
+    }
+
+    // Share the stream of any subscriber that wants the same datagrams
+    Stream *stream = NULL;
+    for (int i = 0; i < _subscription_count && stream == NULL; i++) {
+        if (_subscriptions[i].stream->matches(normalized)) {
+            stream = _subscriptions[i].stream;
+        }
+    }
+    if (stream == NULL) {
+        stream = new Stream(normalized);
+    }
+    stream->users++;
+
+    Subscription& subscription = _subscriptions[_subscription_count++];
+    subscription.subscriber = normalized;
+    subscription.stream = stream;
+    subscription.expires = expires;
+
+    qDebug() << "Sending to" << normalized.address.toString() << "port" << normalized.port;
+    return true;
+}
+
+
+void Networking::unsubscribe(int index)
+{
+    Stream *stream = _subscriptions[index].stream;
+    if (--stream->users == 0) {
+        delete stream;
+    }
+    _subscriptions[index] = _subscriptions[--_subscription_count];
+}
+
+
+int Networking::find_subscription(const QHostAddress& address, uint16_t port) const
+{
+    for (int i = 0; i < _subscription_count; i++) {
+        if (_subscriptions[i].subscriber.address == address
+            && _subscriptions[i].subscriber.port == port)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+void Networking::poll_subscriptions(void)
+{
+    char buf[SUBSCRIBE_SIZE];
+
+    while (_socket->hasPendingDatagrams()) {
+        // Qt 4 allocates for every QHostAddress, so only once there is a
+        // message; this runs on every hop
+        QHostAddress address;
+        uint16_t port;
+        int len = _socket->readDatagram(buf, sizeof(buf), &address, &port);
+        Subscriber subscriber;
+        if (len < 0 || !decode_subscribe(buf, len, &subscriber)) {
+            continue;
+        }
+        subscriber.address = address;
+        if (subscriber.port == 0) {
+            subscriber.port = port;
+        }
+
+        int index = find_subscription(subscriber.address, subscriber.port);
+        if (index >= 0 && _subscriptions[index].expires == 0) {
+            // Subscribers given up front stay as they are
+            continue;
+        }
+
+        if (subscriber.streams == 0) {
+            if (index >= 0) {
+                qDebug() << "Unsubscribed" << address.toString() << "port" << subscriber.port;
+                unsubscribe(index);
+            }
+            continue;
+        }
+
+        qint64 expires = _clock.elapsed() + SUBSCRIPTION_TIMEOUT * 1000;
+        if (index >= 0 && _subscriptions[index].stream->matches(subscriber)) {
+            // Renewal; keep the stream so sequence numbers carry on
+            _subscriptions[index].subscriber.channels = subscriber.channels;
+            _subscriptions[index].expires = expires;
+            continue;
+        }
+        if (index >= 0) {
+            unsubscribe(index);
+        }
+        subscribe(subscriber, expires);
+    }
+}
+
+
+void Networking::expire_subscriptions(void)
+{
+    qint64 now = _clock.elapsed();
+    for (int i = _subscription_count - 1; i >= 0; i--) {
+        if (_subscriptions[i].expires != 0 && _subscriptions[i].expires < now) {
+            qDebug() << "Subscription from" << _subscriptions[i].subscriber.address.toString()
+                     << "port" << _subscriptions[i].subscriber.port << "expired";
+            unsubscribe(i);
+        }
+    }
+}
+
+
+// Sends the datagram in _buffer to each of the stream's subscribers that
+// wants the channel
+bool Networking::send(Stream *stream, int channel, int len)
+{
+    bool ok = true;
+    for (int i = 0; i < _subscription_count; i++) {
+        const Subscription& subscription = _subscriptions[i];
+        if (subscription.stream == stream
+            && (subscription.subscriber.channels & (1 << channel)))
+        {
+            ok &= _socket->writeDatagram(_buffer, len, subscription.subscriber.address,
+                                         subscription.subscriber.port) == len;
+        }
+    }
+    return ok;
+}
+
+
+bool Networking::transmit_stream(Stream *stream, const AnalysisFrame *frame)
+{
+    const int c = frame->channel;
+
+    bool wanted = false;
+    for (int i = 0; i < _subscription_count && !wanted; i++) {
+        wanted = _subscriptions[i].stream == stream
+                 && (_subscriptions[i].subscriber.channels & (1 << c));
+    }
+    if (!wanted) {
+        return true;
+    }
+
+    unsigned int streams = stream->streams;
+    if (!frame->has_spectrum
+        || (stream->spectrum_rate > 0 && stream->spectrum_sent[c]
+            && frame->time - stream->spectrum_time[c]
+               < frame->samplerate / stream->spectrum_rate))
+    {
+        streams &= ~STREAM_SPECTRUM;
+    }
+    if (!frame->onset) {
+        streams &= ~STREAM_ONSET;
+    }
+    if (!frame->has_pitch) {
+        streams &= ~STREAM_PITCH;
+    }
+    if (stream->protocol == PROTOCOL_LEGACY) {
+        // The legacy protocol has no messages for envelopes, tempo or features
+        streams &= ~(STREAM_ENVELOPE | STREAM_TEMPO | STREAM_CHROMA | STREAM_MEL);
+    }
+    if (!frame->has_envelope) {
+        streams &= ~STREAM_ENVELOPE;
+    }
+    if (!frame->has_tempo) {
+        streams &= ~STREAM_TEMPO;
+    }
+    if (!frame->has_chroma) {
+        streams &= ~STREAM_CHROMA;
+    }
+    if (!frame->has_mel) {
+        streams &= ~STREAM_MEL;
+    }
+    if (streams == 0) {
+        return true;
+    }
+    if (streams & STREAM_SPECTRUM) {
+        stream->spectrum_time[c] = frame->time;
+        stream->spectrum_sent[c] = true;
+    }
+
+    if (stream->protocol == PROTOCOL_V2) {
+        int len = encode_frame(_buffer, stream->sequence[c]++, *frame, &stream->codec, streams);
+        return send(stream, c, len);
+    }
+
+    bool ok = true;
+    if (streams & STREAM_SPECTRUM) {
+        ok &= send(stream, c, encode_fft_data(_buffer, c, frame->bands, frame->spectrum));
+    }
+    if (streams & STREAM_PITCH) {
+        ok &= send(stream, c, encode_pitch_data(_buffer, c, frame->pitch, frame->confidence));
+    }
+    if (streams & STREAM_ONSET) {
+        ok &= send(stream, c, encode_onset(_buffer, c));
+    }
+    return ok;
+}
+
+
+bool Networking::transmit_frame(const AnalysisFrame *frame)
+{
+    if (_listening) {
+        poll_subscriptions();
+    }
+    expire_subscriptions();
 
-    _socket->writeDatagram(dgram, _dest_addr, _port_num);
+    bool ok = true;
+    for (int i = 0; i < _subscription_count; i++) {
+        // Each stream once, however many subscribers share it
+        bool first = true;
+        for (int j = 0; j < i && first; j++) {
+            first = _subscriptions[j].stream != _subscriptions[i].stream;
+        }
+        if (first) {
+            ok &= transmit_stream(_subscriptions[i].stream, frame);
+        }
+    }
+    return ok;
 }
@@ -27,35 +27,241 @@
 
 #include <QtCore/QObject>
 #include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
 #include <QtNetwork/QUdpSocket>
 
+#include "analysis_frame.h"
+#include "frame_sink.h"
+#include "spectrum_codec.h"
+
 #define TRANSMIT_PORT 3010
 
+// Legacy protocol: one datagram per result, the channel as a trailing byte
+//
+//   MSG_FFT    len (u16) float[len] channel
+//   MSG_ONSET  channel
+//   MSG_PITCH  pitch (float) confidence (float) channel
 #define MSG_FFT 0x66
 #define MSG_ONSET 0x77
 #define MSG_PITCH 0x88
 
+// Protocol v2: one datagram per channel per hop, all fields little-endian
+//
+//   offset  size
+//   0       1     MSG_FRAME
+//   1       1     protocol version (2)
+//   2       1     channel
+//   3       1     flags (FRAME_FLAG_*)
+//   4       4     sequence number, counting hops per channel from 0 (u32)
+//   8       4     frame time just past the hop (u32, wraps)
+//   12      4     sample rate (u32)
+//   16      4     pitch in Hz, 0 unless FRAME_FLAG_PITCH (float)
+//   20      4     pitch confidence, 0 unless FRAME_FLAG_PITCH (float)
+//   24      2     number of spectrum bands that follow, 0 if none (u16)
+//   26      1     spectrum encoding (SpectrumCodec::Encoding, 0 = float)
+//   27      1     reserved, 0
+//   28            with FRAME_FLAG_ENVELOPE, the band envelopes:
+//                   1  number of bands B
+//                   1  number of steps S
+//                   2  frames per step (u16)
+//                   S * B * 12  per step, oldest first, and per band:
+//                               envelope, peak and RMS (float each)
+//   ...           with FRAME_FLAG_TEMPO, the beat tracker's state:
+//                   4  tempo in BPM (float)
+//                   4  tempo confidence, 0 to 1 (float)
+//                   4  beat phase at the frame time, 0 on the beat (float)
+//                   16 frame times of the next 4 beats (u32 each, wrap)
+//   ...           with FRAME_FLAG_LOAD, the analysis load:
+//                   2  load in thousandths of real time (u16)
+//                   1  shed level, 0 when every stage runs (SHED_*)
+//                   1  reserved, 0
+//   ...           with FRAME_FLAG_FEATURES, the chroma and mel bands:
+//                   1  number of chroma bins C, 0 or CHROMA_BINS
+//                   1  number of mel bands M
+//                   1  encoding (SpectrumCodec::Encoding), the spectrum's
+//                   1  reserved, 0
+//                   ... C chroma bins, C first, then M mel bands, lowest
+//                       first, encoded like spectrum bands but never
+//                       delta-coded
+//   ...           spectrum bands, encoded as described in spectrum_codec.h
+//
+// A gap in the sequence numbers is a lost datagram; the frame time says how
+// old the data is and lines up with other JACK clients.
+#define MSG_FRAME 0x99
+#define PROTOCOL_VERSION 2
+#define FRAME_HEADER_SIZE 28
+#define FRAME_FLAG_ONSET 0x01
+#define FRAME_FLAG_SPECTRUM 0x02
+// The spectrum is delta-coded against an earlier frame
+#define FRAME_FLAG_DELTA 0x04
+// The frame carries a pitch; frames from an onset-only analysis chain don't
+#define FRAME_FLAG_PITCH 0x08
+#define FRAME_FLAG_ENVELOPE 0x10
+#define ENVELOPE_HEADER_SIZE 4
+#define FRAME_FLAG_TEMPO 0x20
+#define TEMPO_SECTION_SIZE (12 + 4 * TEMPO_PREDICTED_BEATS)
+// Sent with every frame from live input, whatever the streams
+#define FRAME_FLAG_LOAD 0x40
+#define LOAD_SECTION_SIZE 4
+#define FRAME_FLAG_FEATURES 0x80
+#define FEATURES_HEADER_SIZE 4
+
+// Largest datagram either protocol produces; float spectra are the largest
+// encoding
+#define MAX_DATAGRAM_SIZE (FRAME_HEADER_SIZE + ENVELOPE_HEADER_SIZE \
+                           + MAX_ENVELOPE_STEPS * MAX_ENVELOPE_BANDS * sizeof(EnvelopeLevels) \
+                           + TEMPO_SECTION_SIZE + LOAD_SECTION_SIZE \
+                           + FEATURES_HEADER_SIZE + (CHROMA_BINS + MAX_MEL_BANDS) * sizeof(float) \
+                           + MAX_BANDS * sizeof(float))
+
+// What a subscriber can ask for, as a bit mask.  Only hops carrying at least
+// one of them are sent.
+#define STREAM_SPECTRUM 0x01
+#define STREAM_PITCH 0x02
+#define STREAM_ONSET 0x04
+#define STREAM_ENVELOPE 0x08
+#define STREAM_TEMPO 0x10
+#define STREAM_CHROMA 0x20
+#define STREAM_MEL 0x40
+#define STREAM_ALL (STREAM_SPECTRUM | STREAM_PITCH | STREAM_ONSET | STREAM_ENVELOPE \
+                    | STREAM_TEMPO | STREAM_CHROMA | STREAM_MEL)
+
+// Subscribe message, sent by a receiver to the port given with --listen:
+//
+//   offset  size
+//   0       1     MSG_SUBSCRIBE
+//   1       1     protocol version (2)
+//   2       1     streams (STREAM_*), 0 to unsubscribe
+//   3       1     protocol (Networking::Protocol)
+//   4       1     spectrum encoding (SpectrumCodec::Encoding)
+//   5       1     flags (SUBSCRIBE_FLAG_*)
+//   6       2     channels, bit c set for channel c (u16)
+//   8       2     most spectra per second per channel, 0 for all (u16)
+//   10      2     port to send to, 0 for the one the message came from (u16)
+//
+// A subscription lasts SUBSCRIPTION_TIMEOUT seconds, so receivers resend
+// the message every few seconds to keep it.
+#define MSG_SUBSCRIBE 0xaa
+#define SUBSCRIBE_SIZE 12
+#define SUBSCRIBE_FLAG_DELTA 0x01
+#define SUBSCRIPTION_TIMEOUT 10
+#define SUBSCRIBE_PORT 3011
+
+#define MAX_SUBSCRIBERS 16
+
 
-class Networking : public QObject
+// Sends every frame to a set of subscribers, given up front or subscribing
+// themselves over UDP.  Subscribers asking for the same protocol, encoding,
+// streams and spectrum rate share a stream: each frame is encoded once per
+// stream, with its own sequence numbers and delta-coding state, and the
+// datagram is sent to each of the stream's subscribers.
+class Networking : public FrameSink
 {
     Q_OBJECT
 
 public:
-    Networking(const QHostAddress& dest_addr, uint16_t port_num);
+    enum Protocol { PROTOCOL_LEGACY, PROTOCOL_V2 };
+
+    struct Subscriber
+    {
+        Subscriber();
+
+        QHostAddress address;
+        uint16_t port;
+        Protocol protocol;
+        // v2 only; the legacy protocol always sends floats
+        SpectrumCodec::Encoding encoding;
+        bool delta;
+        unsigned int streams;
+        unsigned int channels;
+        unsigned int spectrum_rate;
+    };
+
+    Networking();
     ~Networking();
 
     bool open(void);
     bool close(void);
 
-public slots:
-    void transmit_onset(void);
-    void transmit_fft_data(int len, float *data);
-    void transmit_pitch_data(float pitch, float confidence);
+    // Accepts subscribe messages on port from now on
+    bool listen(uint16_t port);
+
+    // Adds a subscriber that never expires.  Returns false if there are
+    // already MAX_SUBSCRIBERS.
+    bool add_subscriber(const Subscriber& subscriber);
+
+    // Subscribe messages; see above.  decode_subscribe() leaves the address
+    // alone and the port 0 if the sender's should be used.
+    static int encode_subscribe(char *buf, const Subscriber& subscriber);
+    static bool decode_subscribe(const char *buf, int len, Subscriber *subscriber);
+
+    // Datagram construction into a caller-supplied buffer of at least
+    // MAX_DATAGRAM_SIZE bytes, separate from sending so it can be
+    // benchmarked.  Each returns the datagram length.  A v2 frame's spectrum
+    // is sent as float unless a codec is given.
+    static int encode_onset(char *buf, int channel);
+    static int encode_fft_data(char *buf, int channel, int len, const float *data);
+    static int encode_pitch_data(char *buf, int channel, float pitch, float confidence);
+    // Only the given streams are included.
+    static int encode_frame(char *buf, uint32_t sequence, const AnalysisFrame& frame,
+                            SpectrumCodec *codec = NULL, unsigned int streams = STREAM_ALL);
+
+    // Parses a v2 frame, for receivers.  Returns false if it isn't one.
+    // Without a codec only float spectra are decoded; a spectrum that can't
+    // be decoded is dropped (has_spectrum is cleared) rather than failing
+    // the frame.
+    static bool decode_frame(const char *buf, int len, uint32_t *sequence,
+                             AnalysisFrame *frame, SpectrumCodec *codec = NULL);
+
+    bool transmit_frame(const AnalysisFrame *frame);
 
 private:
+    // The state of one distinct way of sending frames
+    struct Stream
+    {
+        Stream(const Subscriber& subscriber);
+
+        // Whether a subscriber's frames can be sent on this stream
+        bool matches(const Subscriber& subscriber) const;
+
+        Protocol protocol;
+        unsigned int streams;
+        unsigned int spectrum_rate;
+        SpectrumCodec codec;
+
+        uint32_t sequence[MAX_CHANNELS];
+        // Frame time of the last spectrum sent on each channel, if any
+        jack_nframes_t spectrum_time[MAX_CHANNELS];
+        bool spectrum_sent[MAX_CHANNELS];
+        unsigned int users;
+    };
+
+    struct Subscription
+    {
+        Subscriber subscriber;
+        Stream *stream;
+        // In _clock milliseconds; 0 for subscribers that never expire
+        qint64 expires;
+    };
+
+    bool subscribe(const Subscriber& subscriber, qint64 expires);
+    void unsubscribe(int index);
+    int find_subscription(const QHostAddress& address, uint16_t port) const;
+    void poll_subscriptions(void);
+    void expire_subscriptions(void);
+
+    bool transmit_stream(Stream *stream, const AnalysisFrame *frame);
+    bool send(Stream *stream, int channel, int len);
+
+    Subscription _subscriptions[MAX_SUBSCRIBERS];
+    int _subscription_count;
+    QElapsedTimer _clock;
+
     QUdpSocket *_socket;
-    QHostAddress _dest_addr;
-    uint16_t _port_num;
+    bool _listening;
+
+    // Every datagram is built here
+    char _buffer[MAX_DATAGRAM_SIZE];
 };
 
 #endif
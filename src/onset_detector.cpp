@@ -0,0 +1,140 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <string.h>
+
+#include "onset_detector.h"
+
+
+OnsetDetector::OnsetDetector(const char *method, unsigned int window_size,
+                             unsigned int hop_size, int samplerate)
+    : _hop_size(hop_size), _samplerate(samplerate)
+{
+  char mode[32];
+  strncpy(mode, method, sizeof(mode) - 1);
+  mode[sizeof(mode) - 1] = 0;
+
+  _specdesc = new_aubio_specdesc(mode, window_size);
+  _desc = new_fvec(1);
+
+  _threshold = 0.3;
+  _silence = -70.0;
+  set_minioi_ms(20);
+
+  memset(_keep, 0, sizeof(_keep));
+  memset(_peek, 0, sizeof(_peek));
+  _total_frames = 0;
+  _last_onset = 0;
+}
+
+
+OnsetDetector::~OnsetDetector()
+{
+  del_aubio_specdesc(_specdesc);
+  del_fvec(_desc);
+}
+
+
+bool OnsetDetector::detect(const cvec_t *grain, smpl_t level_db)
+{
+  bool onset = false;
+
+  aubio_specdesc_do(_specdesc, (cvec_t *)grain, _desc);
+  smpl_t peak = pick_peak();
+
+  if (peak > 0 && level_db >= _silence)
+  {
+    // The peak picker reports a fractional position within the hop
+    unsigned int at = _total_frames + (unsigned int)(peak * _hop_size + 0.5);
+    if (_last_onset + _minioi < at)
+    {
+      _last_onset = at;
+      onset = true;
+    }
+  }
+
+  _total_frames += _hop_size;
+  return onset;
+}
+
+
+// Same as aubio_peakpicker_do: returns the interpolated position of a peak in
+// the thresholded detection function, or 0 if there is none.
+smpl_t OnsetDetector::pick_peak(void)
+{
+  // Low-pass biquad, applied forwards and backwards (filtfilt)
+  static const smpl_t b0 = 0.1600, b1 = 0.3200, b2 = 0.1600;
+  static const smpl_t a1 = -0.5949, a2 = 0.2348;
+
+  smpl_t proc[ONSET_KEEP];
+  smpl_t sorted[ONSET_KEEP];
+  smpl_t x1, x2, y1, y2, mean = 0;
+
+  memmove(_keep, _keep + 1, (ONSET_KEEP - 1) * sizeof(smpl_t));
+  _keep[ONSET_KEEP - 1] = _desc->data[0];
+
+  x1 = x2 = y1 = y2 = 0;
+  for (int i = 0; i < ONSET_KEEP; i++)
+  {
+    smpl_t y = b0 * _keep[i] + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2;
+    x2 = x1; x1 = _keep[i];
+    y2 = y1; y1 = y;
+    proc[i] = y;
+  }
+  x1 = x2 = y1 = y2 = 0;
+  for (int i = ONSET_KEEP - 1; i >= 0; i--)
+  {
+    smpl_t y = b0 * proc[i] + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2;
+    x2 = x1; x1 = proc[i];
+    y2 = y1; y1 = y;
+    proc[i] = y;
+  }
+
+  // Mean and median of the filtered window (insertion sort; it's tiny)
+  for (int i = 0; i < ONSET_KEEP; i++)
+  {
+    smpl_t v = proc[i];
+    int j = i;
+    mean += v;
+    while (j > 0 && sorted[j - 1] > v)
+    {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = v;
+  }
+  mean /= ONSET_KEEP;
+  smpl_t median = sorted[ONSET_KEEP / 2];
+
+  _peek[0] = _peek[1];
+  _peek[1] = _peek[2];
+  _peek[2] = proc[ONSET_POST] - median - mean * _threshold;
+
+  if (!(_peek[1] > _peek[0] && _peek[1] > _peek[2] && _peek[1] > 0))
+  {
+    return 0;
+  }
+
+  // Quadratic interpolation of the peak position
+  smpl_t denom = _peek[0] - 2 * _peek[1] + _peek[2];
+  return denom != 0 ? 1 + 0.5 * (_peek[0] - _peek[2]) / denom : 1;
+}
@@ -0,0 +1,91 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _ONSET_DETECTOR_H
+#define _ONSET_DETECTOR_H
+
+// TODO: Make this less dumb by requiring Win32 to have aubio.h in the same place?
+#ifdef __MINGW32__
+#include <aubio.h>
+#else
+#include <aubio/aubio.h>
+#endif
+
+// Length of the detection function history used for peak picking
+#define ONSET_KEEP 7
+// Which entry of that history is examined (aubio's win_post)
+#define ONSET_POST 5
+
+
+// Onset detection on top of a spectrum computed elsewhere, so that the FFT
+// can be shared with the other analysis stages.
+//
+// Equivalent to aubio_onset: a spectral detection function (mkl by default)
+// followed by aubio's peak picker -- a low-passed window of recent values
+// thresholded against its median and mean -- plus silence gating and a
+// minimum inter-onset interval.
+class OnsetDetector
+{
+public:
+  OnsetDetector(const char *method, unsigned int window_size,
+                unsigned int hop_size, int samplerate);
+  ~OnsetDetector();
+
+  void set_threshold(smpl_t threshold) { _threshold = threshold; }
+  void set_silence(smpl_t silence_db) { _silence = silence_db; }
+  void set_minioi_ms(smpl_t ms) { _minioi = ms * _samplerate / 1000; }
+  smpl_t silence(void) const { return _silence; }
+
+  // Call once per hop with that hop's spectrum and level in dB SPL.
+  // Returns true if an onset was detected.
+  bool detect(const cvec_t *grain, smpl_t level_db);
+
+  // Call instead of detect() for a hop that isn't examined, to keep time
+  void skip(void) { _total_frames += _hop_size; }
+
+  // Detection function value of the last hop
+  smpl_t novelty(void) const { return _desc->data[0]; }
+
+private:
+  OnsetDetector(const OnsetDetector&);
+  OnsetDetector& operator=(const OnsetDetector&);
+
+  smpl_t pick_peak(void);
+
+  unsigned int _hop_size;
+  int _samplerate;
+
+  smpl_t _threshold;
+  smpl_t _silence;
+  unsigned int _minioi;
+
+  aubio_specdesc_t *_specdesc;
+  fvec_t *_desc;
+
+  smpl_t _keep[ONSET_KEEP];
+  smpl_t _peek[3];
+
+  unsigned int _total_frames;
+  unsigned int _last_onset;
+};
+
+#endif
@@ -0,0 +1,163 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <math.h>
+
+#include "pitch_detector.h"
+
+// Outer/middle ear weighting applied to the spectrum, in dB (from aubio)
+static const smpl_t weight_freqs[] = {
+     0.,    20.,    25.,   31.5,    40.,    50.,    63.,    80.,   100.,   125.,
+   160.,   200.,   250.,   315.,   400.,   500.,   630.,   800.,  1000.,  1250.,
+  1600.,  2000.,  2500.,  3150.,  4000.,  5000.,  6300.,  8000.,  9000., 10000.,
+ 12500., 15000., 20000., 25100.
+};
+static const smpl_t weight_db[] = {
+  -75.8,  -70.1,  -60.8,  -52.1,  -44.2,  -37.5,  -31.3,  -25.6,  -20.9,  -16.5,
+  -12.6,  -9.60,  -7.00,  -4.70,  -3.00,  -1.80,  -0.80,  -0.20,  -0.00,   0.50,
+   1.60,   3.20,   5.40,   7.80,   8.10,   5.30,  -2.40,  -11.1,  -12.8,  -12.2,
+  -7.40,  -17.8,  -17.8,  -17.8
+};
+static const unsigned int num_weights = sizeof(weight_freqs) / sizeof(weight_freqs[0]);
+
+
+PitchDetector::PitchDetector(unsigned int window_size, int samplerate)
+    : _window_size(window_size), _samplerate(samplerate)
+{
+  _fft = new_aubio_fft(window_size);
+  _weight = new_fvec(window_size / 2 + 1);
+  _sqrmag = new_fvec(window_size);
+  _fftout = new_fvec(window_size);
+  _yin = new_fvec(window_size / 2 + 1);
+  _confidence = 0;
+
+  // Interpolate the weighting curve (linearly in dB) at each bin
+  unsigned int j = 1;
+  for (unsigned int i = 0; i < _weight->length; i++)
+  {
+    smpl_t freq = (smpl_t)i * samplerate / window_size;
+    smpl_t db;
+
+    while (j < num_weights - 1 && freq > weight_freqs[j])
+    {
+      j++;
+    }
+
+    if (freq >= weight_freqs[num_weights - 1])
+    {
+      db = weight_db[num_weights - 1];
+    }
+    else
+    {
+      smpl_t t = (freq - weight_freqs[j - 1]) / (weight_freqs[j] - weight_freqs[j - 1]);
+      db = weight_db[j - 1] + t * (weight_db[j] - weight_db[j - 1]);
+    }
+
+    _weight->data[i] = powf(10, db / 20);
+  }
+}
+
+
+PitchDetector::~PitchDetector()
+{
+  del_aubio_fft(_fft);
+  del_fvec(_weight);
+  del_fvec(_sqrmag);
+  del_fvec(_fftout);
+  del_fvec(_yin);
+}
+
+
+smpl_t PitchDetector::detect(const cvec_t *grain)
+{
+  unsigned int length = _window_size;
+  smpl_t sum = 0, tmp = 0;
+
+  // Weighted squared magnitude spectrum, mirrored to a full-length sequence
+  for (unsigned int l = 0; l <= length / 2; l++)
+  {
+    smpl_t sqr = grain->norm[l] * grain->norm[l] * _weight->data[l];
+    _sqrmag->data[l] = sqr;
+    if (l > 0 && l < length / 2)
+    {
+      _sqrmag->data[length - l] = sqr;
+    }
+    sum += sqr;
+  }
+  sum *= 2;
+
+  // Its transform is the autocorrelation of the (weighted) input frame
+  aubio_fft_do_complex(_fft, _sqrmag, _fftout);
+
+  // Cumulative mean normalized difference function
+  _yin->data[0] = 1;
+  unsigned int best = 0;
+  for (unsigned int tau = 1; tau < _yin->length; tau++)
+  {
+    _yin->data[tau] = sum - _fftout->data[tau];
+    tmp += _yin->data[tau];
+    _yin->data[tau] = tmp != 0 ? _yin->data[tau] * tau / tmp : 1;
+
+    if (_yin->data[tau] < _yin->data[best])
+    {
+      best = tau;
+    }
+  }
+
+  if (_yin->data[best] >= YINFFT_TOLERANCE)
+  {
+    _confidence = 0;
+    return 0;
+  }
+
+  // Guard against octave errors for short periods
+  if (best <= 35)
+  {
+    unsigned int half = best / 2;
+    if (_yin->data[half] < YINFFT_TOLERANCE)
+    {
+      best = half;
+    }
+  }
+
+  _confidence = 1 - _yin->data[best];
+
+  smpl_t period = peak_pos(best);
+  return period > 0 ? _samplerate / period : 0;
+}
+
+
+// Quadratic interpolation of the minimum around pos
+smpl_t PitchDetector::peak_pos(unsigned int pos) const
+{
+  if (pos == 0 || pos >= _yin->length - 1)
+  {
+    return pos;
+  }
+
+  smpl_t s0 = _yin->data[pos - 1];
+  smpl_t s1 = _yin->data[pos];
+  smpl_t s2 = _yin->data[pos + 1];
+  smpl_t denom = s0 - 2 * s1 + s2;
+
+  return denom != 0 ? pos + 0.5 * (s0 - s2) / denom : pos;
+}
@@ -0,0 +1,74 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _PITCH_DETECTOR_H
+#define _PITCH_DETECTOR_H
+
+// TODO: Make this less dumb by requiring Win32 to have aubio.h in the same place?
+#ifdef __MINGW32__
+#include <aubio.h>
+#else
+#include <aubio/aubio.h>
+#endif
+
+// Tolerance on the normalized difference function below which a period is
+// accepted (same as aubio's yinfft)
+#define YINFFT_TOLERANCE 0.85
+
+
+// The yinfft pitch estimator, fed from a spectrum computed elsewhere instead
+// of running its own windowed FFT on the input.
+//
+// The weighted squared magnitudes are transformed once more to get the
+// autocorrelation, which is inherent to the method; the input FFT itself is
+// shared with the other stages.
+class PitchDetector
+{
+public:
+  PitchDetector(unsigned int window_size, int samplerate);
+  ~PitchDetector();
+
+  // Returns the estimated pitch in Hz, or 0 if none was found
+  smpl_t detect(const cvec_t *grain);
+
+  // 1 - the normalized difference at the chosen period
+  smpl_t confidence(void) const { return _confidence; }
+
+private:
+  PitchDetector(const PitchDetector&);
+  PitchDetector& operator=(const PitchDetector&);
+
+  smpl_t peak_pos(unsigned int pos) const;
+
+  unsigned int _window_size;
+  int _samplerate;
+
+  aubio_fft_t *_fft;
+  fvec_t *_weight;
+  fvec_t *_sqrmag;
+  fvec_t *_fftout;
+  fvec_t *_yin;
+
+  smpl_t _confidence;
+};
+
+#endif
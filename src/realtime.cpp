@@ -0,0 +1,101 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <errno.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <QtCore/QDebug>
+
+#include "realtime.h"
+
+
+RealtimeConfig::RealtimeConfig()
+{
+  lock_memory = false;
+  priority = 0;
+  num_cpus = 0;
+}
+
+
+bool Realtime::lock_memory(void)
+{
+#ifdef __GLIBC__
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+#endif
+
+#ifndef _WIN32
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+  {
+    qDebug("Could not lock memory: %s (is the memlock limit high enough?)",
+           strerror(errno));
+    return false;
+  }
+  return true;
+#else
+  qDebug() << "Locking memory is not supported on this platform";
+  return false;
+#endif
+}
+
+
+void Realtime::configure_thread(const RealtimeConfig& config, unsigned int index)
+{
+#ifdef __linux__
+  if (config.num_cpus > 0)
+  {
+    int cpu = config.cpus[index % config.num_cpus];
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0)
+    {
+      qDebug("Could not pin analysis thread %u to CPU %d: %s", index, cpu, strerror(err));
+    }
+  }
+#endif
+
+#ifndef _WIN32
+  if (config.priority > 0)
+  {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = config.priority;
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err != 0)
+    {
+      qDebug("Could not give analysis thread %u realtime priority %d: %s "
+             "(is the rtprio limit high enough?)", index, config.priority, strerror(err));
+    }
+  }
+#endif
+}
@@ -0,0 +1,95 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _REALTIME_H
+#define _REALTIME_H
+
+// Most CPUs --cpus can list
+#define RT_MAX_CPUS 64
+// Stack for each thread started under --realtime.  Locked memory covers the
+// whole stack, so the default of several megabytes per thread would be wasted.
+#define RT_STACK_SIZE (1024 * 1024)
+// SCHED_FIFO priority used by --realtime without --rt-priority; below JACK's
+// own (usually 70 or more), so analysis never preempts the process callback
+#define RT_DEFAULT_PRIORITY 60
+
+// What Realtime::begin_checked() watches for
+#define RT_CHECK_ALLOC 0x01
+#define RT_CHECK_LOCK 0x02
+
+
+struct RealtimeConfig
+{
+  RealtimeConfig();
+
+  // Lock all memory into RAM and keep the threads' stacks small
+  bool lock_memory;
+
+  // SCHED_FIFO priority for the analysis thread and its workers, or 0 to
+  // leave them at normal priority
+  int priority;
+
+  // CPUs for the analysis thread and its workers, one each in turn; none to
+  // leave them to the scheduler
+  unsigned int num_cpus;
+  int cpus[RT_MAX_CPUS];
+};
+
+
+// Strict realtime mode (--realtime, --rt-priority, --cpus).  The buffers
+// between the JACK process callback and the sender are all allocated up
+// front; this keeps them, and everything else, from being paged out, and
+// keeps the analysis threads from being preempted or migrated.
+class Realtime
+{
+public:
+  // Locks every page the process has, and any it maps later, into RAM, and
+  // stops malloc from handing freed memory back to the system only to fault
+  // it in again.  Call before starting any threads.
+  static bool lock_memory(void);
+
+  // Applies config to the calling thread, which is analysis thread index (0
+  // for the AnalysisThread itself, then its pool's workers)
+  static void configure_thread(const RealtimeConfig& config, unsigned int index);
+
+  // In a build with RT_CHECKS (qmake CONFIG+=rtcheck), the calling thread
+  // aborts with a message if it does what checks (RT_CHECK_*) forbid before
+  // end_checked(): allocating or freeing memory through malloc() or any of
+  // its relatives, or taking or waiting on a pthread mutex, read-write lock
+  // or condition variable, a POSIX semaphore or a futex.  That catches Qt's
+  // mutexes, wait conditions and semaphores once they have to wait, but not
+  // a QMutex taken uncontended, which Qt 4 does with an atomic alone.
+  // test_checks() makes sure each check fires, in a child process, and
+  // returns false after saying which didn't.  Otherwise these compile to
+  // nothing.
+#ifdef RT_CHECKS
+  static void begin_checked(unsigned int checks);
+  static void end_checked(void);
+  static bool test_checks(void);
+#else
+  static void begin_checked(unsigned int) {}
+  static void end_checked(void) {}
+  static bool test_checks(void) { return true; }
+#endif
+};
+
+#endif
@@ -0,0 +1,125 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <string.h>
+
+#include <QtCore/QDebug>
+
+#include "byte_order.h"
+#include "recording.h"
+
+
+Recording::Recording(const char *path)
+    : _file(path), _open(false), _size(0), _pos(RECORDING_HEADER_SIZE),
+      _window(NULL), _window_offset(0), _window_size(0)
+{
+    if (!_file.open(QIODevice::ReadOnly)) {
+        qDebug() << "Cannot open recording" << path;
+        return;
+    }
+    _size = _file.size();
+
+    char header[RECORDING_HEADER_SIZE];
+    uint32_t version;
+    if (_file.read(header, sizeof(header)) != sizeof(header)
+        || memcmp(header, RECORDING_MAGIC, 8) != 0)
+    {
+        qDebug() << path << "is not a recording";
+        return;
+    }
+    get_u32(header + 8, &version);
+    if (version != RECORDING_VERSION) {
+        qDebug() << "Unsupported recording version" << version;
+        return;
+    }
+
+    _open = true;
+}
+
+
+Recording::~Recording()
+{
+    if (_window != NULL) {
+        _file.unmap(_window);
+    }
+}
+
+
+// Makes sure [offset, offset + length) is mapped, moving the window there
+// if it isn't
+bool Recording::map(qint64 offset, qint64 length)
+{
+    if (_window != NULL && offset >= _window_offset
+        && offset + length <= _window_offset + _window_size)
+    {
+        return true;
+    }
+
+    if (_window != NULL) {
+        _file.unmap(_window);
+        _window = NULL;
+    }
+    if (offset + length > _size) {
+        return false;
+    }
+
+    _window_offset = offset;
+    _window_size = _size - offset;
+    if (_window_size > RECORDING_MAP_WINDOW) {
+        _window_size = RECORDING_MAP_WINDOW;
+    }
+    _window = _file.map(_window_offset, _window_size);
+    if (_window == NULL) {
+        qDebug() << "Cannot map recording:" << _file.errorString();
+        return false;
+    }
+    return true;
+}
+
+
+bool Recording::next(const char **frame, int *len, uint64_t *usecs)
+{
+    if (!_open || !map(_pos, RECORD_HEADER_SIZE)) {
+        return false;
+    }
+
+    uint32_t length;
+    const char *p = (const char *)_window + (_pos - _window_offset);
+    p = get_u32(p, &length);
+    get_u64(p, usecs);
+
+    // A torn last record, or garbage
+    if (length > MAX_DATAGRAM_SIZE || !map(_pos, RECORD_HEADER_SIZE + length)) {
+        return false;
+    }
+
+    *frame = (const char *)_window + (_pos - _window_offset) + RECORD_HEADER_SIZE;
+    *len = length;
+    _pos += RECORD_HEADER_SIZE + length;
+    return true;
+}
+
+
+void Recording::rewind(void)
+{
+    _pos = RECORDING_HEADER_SIZE;
+}
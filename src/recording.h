@@ -0,0 +1,87 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _RECORDING_H
+#define _RECORDING_H
+
+#include <stdint.h>
+
+#include <QtCore/QFile>
+
+#include "networking.h"
+
+// Recording file (--record), all fields little-endian:
+//
+//   offset  size
+//   0       8     RECORDING_MAGIC
+//   8       4     format version (u32, RECORDING_VERSION)
+//   12      4     reserved, 0
+//   16            records, appended as frames are sent, each:
+//                   4  length L of the frame (u32)
+//                   8  microseconds since the recording started (u64)
+//                   L  the frame as a protocol v2 datagram (see
+//                      networking.h) with every stream and no delta coding,
+//                      so that each record decodes by itself
+//
+// A recording cut short by a crash ends at the last complete record.
+#define RECORDING_MAGIC "FMXREC\r\n"
+#define RECORDING_VERSION 1
+#define RECORDING_HEADER_SIZE 16
+#define RECORD_HEADER_SIZE 12
+
+// How much of a recording is mapped at a time
+#define RECORDING_MAP_WINDOW (64 * 1024 * 1024)
+
+
+// Reads a recording's records in order.  The file is memory-mapped a
+// window at a time, so recordings of any length can be read without
+// loading them, and each record is handed out in place.
+class Recording
+{
+public:
+    Recording(const char *path);
+    ~Recording();
+
+    bool is_open(void) const { return _open; }
+    qint64 size(void) const { return _size; }
+
+    // Points *frame at the next record's datagram, valid until the next call,
+    // and sets *len and *usecs.  Returns false at the end of the recording.
+    bool next(const char **frame, int *len, uint64_t *usecs);
+
+    // Back to the first record
+    void rewind(void);
+
+private:
+    bool map(qint64 offset, qint64 length);
+
+    QFile _file;
+    bool _open;
+    qint64 _size;
+    qint64 _pos;
+
+    uchar *_window;
+    qint64 _window_offset;
+    qint64 _window_size;
+};
+
+#endif
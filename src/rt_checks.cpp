@@ -0,0 +1,474 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Test-build hooks for Realtime::begin_checked(), linked in by qmake
+// CONFIG+=rtcheck.  glibc lets the program interpose malloc and friends
+// (which operator new uses too) and the pthread, semaphore and syscall
+// entry points, and still reach the real ones.  Nothing here may allocate
+// or lock itself.
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "realtime.h"
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void *__libc_memalign(size_t alignment, size_t size);
+extern "C" void *__libc_valloc(size_t size);
+extern "C" void *__libc_pvalloc(size_t size);
+extern "C" void __libc_free(void *ptr);
+
+typedef int (*mutex_fn)(pthread_mutex_t *mutex);
+typedef int (*mutex_timed_fn)(pthread_mutex_t *mutex, const struct timespec *timeout);
+typedef int (*rwlock_fn)(pthread_rwlock_t *lock);
+typedef int (*cond_wait_fn)(pthread_cond_t *cond, pthread_mutex_t *mutex);
+typedef int (*cond_timed_fn)(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                             const struct timespec *timeout);
+typedef int (*sem_fn)(sem_t *sem);
+typedef int (*sem_timed_fn)(sem_t *sem, const struct timespec *timeout);
+typedef long (*syscall_fn)(long number, ...);
+
+// The real functions, looked up before main() so that dlsym(), which may
+// allocate, never runs on a checked thread
+static mutex_fn real_mutex_lock = NULL;
+static mutex_fn real_mutex_trylock = NULL;
+static mutex_timed_fn real_mutex_timedlock = NULL;
+static rwlock_fn real_rwlock_rdlock = NULL;
+static rwlock_fn real_rwlock_wrlock = NULL;
+static cond_wait_fn real_cond_wait = NULL;
+static cond_timed_fn real_cond_timedwait = NULL;
+static sem_fn real_sem_wait = NULL;
+static sem_timed_fn real_sem_timedwait = NULL;
+static syscall_fn real_syscall = NULL;
+
+// What the calling thread must not do right now
+static __thread unsigned int checked = 0;
+
+
+static void resolve(void) __attribute__((constructor));
+
+static void resolve(void)
+{
+  real_mutex_lock = (mutex_fn)dlsym(RTLD_NEXT, "pthread_mutex_lock");
+  real_mutex_trylock = (mutex_fn)dlsym(RTLD_NEXT, "pthread_mutex_trylock");
+  real_mutex_timedlock = (mutex_timed_fn)dlsym(RTLD_NEXT, "pthread_mutex_timedlock");
+  real_rwlock_rdlock = (rwlock_fn)dlsym(RTLD_NEXT, "pthread_rwlock_rdlock");
+  real_rwlock_wrlock = (rwlock_fn)dlsym(RTLD_NEXT, "pthread_rwlock_wrlock");
+  real_cond_wait = (cond_wait_fn)dlsym(RTLD_NEXT, "pthread_cond_wait");
+  real_cond_timedwait = (cond_timed_fn)dlsym(RTLD_NEXT, "pthread_cond_timedwait");
+  real_sem_wait = (sem_fn)dlsym(RTLD_NEXT, "sem_wait");
+  real_sem_timedwait = (sem_timed_fn)dlsym(RTLD_NEXT, "sem_timedwait");
+  real_syscall = (syscall_fn)dlsym(RTLD_NEXT, "syscall");
+}
+
+
+void Realtime::begin_checked(unsigned int checks)
+{
+  checked = checks;
+}
+
+
+void Realtime::end_checked(void)
+{
+  checked = 0;
+}
+
+
+static void violation(const char *what)
+{
+  static const char prefix[] = "Realtime violation: ";
+  static const char suffix[] = " on a checked thread\n";
+
+  checked = 0;
+  ssize_t ignored;
+  ignored = write(2, prefix, sizeof(prefix) - 1);
+  ignored = write(2, what, strlen(what));
+  ignored = write(2, suffix, sizeof(suffix) - 1);
+  (void)ignored;
+  abort();
+}
+
+
+static inline void check(unsigned int what, const char *call)
+{
+  if (checked & what)
+  {
+    violation(call);
+  }
+}
+
+
+extern "C" void *malloc(size_t size)
+{
+  check(RT_CHECK_ALLOC, "malloc()");
+  return __libc_malloc(size);
+}
+
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+  check(RT_CHECK_ALLOC, "calloc()");
+  return __libc_calloc(n, size);
+}
+
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+  check(RT_CHECK_ALLOC, "realloc()");
+  return __libc_realloc(ptr, size);
+}
+
+
+extern "C" void *memalign(size_t alignment, size_t size)
+{
+  check(RT_CHECK_ALLOC, "memalign()");
+  return __libc_memalign(alignment, size);
+}
+
+
+extern "C" void *aligned_alloc(size_t alignment, size_t size)
+{
+  check(RT_CHECK_ALLOC, "aligned_alloc()");
+  return __libc_memalign(alignment, size);
+}
+
+
+extern "C" int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+  check(RT_CHECK_ALLOC, "posix_memalign()");
+  if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+  {
+    return EINVAL;
+  }
+  void *p = __libc_memalign(alignment, size);
+  if (p == NULL)
+  {
+    return ENOMEM;
+  }
+  *ptr = p;
+  return 0;
+}
+
+
+extern "C" void *valloc(size_t size)
+{
+  check(RT_CHECK_ALLOC, "valloc()");
+  return __libc_valloc(size);
+}
+
+
+extern "C" void *pvalloc(size_t size)
+{
+  check(RT_CHECK_ALLOC, "pvalloc()");
+  return __libc_pvalloc(size);
+}
+
+
+extern "C" void free(void *ptr)
+{
+  if (ptr != NULL)
+  {
+    check(RT_CHECK_ALLOC, "free()");
+  }
+  __libc_free(ptr);
+}
+
+
+extern "C" int pthread_mutex_lock(pthread_mutex_t *mutex)
+{
+  check(RT_CHECK_LOCK, "pthread_mutex_lock()");
+  if (real_mutex_lock == NULL)
+  {
+    resolve();
+  }
+  return real_mutex_lock(mutex);
+}
+
+
+extern "C" int pthread_mutex_trylock(pthread_mutex_t *mutex)
+{
+  check(RT_CHECK_LOCK, "pthread_mutex_trylock()");
+  if (real_mutex_trylock == NULL)
+  {
+    resolve();
+  }
+  return real_mutex_trylock(mutex);
+}
+
+
+extern "C" int pthread_mutex_timedlock(pthread_mutex_t *mutex, const struct timespec *timeout)
+{
+  check(RT_CHECK_LOCK, "pthread_mutex_timedlock()");
+  if (real_mutex_timedlock == NULL)
+  {
+    resolve();
+  }
+  return real_mutex_timedlock(mutex, timeout);
+}
+
+
+extern "C" int pthread_rwlock_rdlock(pthread_rwlock_t *lock)
+{
+  check(RT_CHECK_LOCK, "pthread_rwlock_rdlock()");
+  if (real_rwlock_rdlock == NULL)
+  {
+    resolve();
+  }
+  return real_rwlock_rdlock(lock);
+}
+
+
+extern "C" int pthread_rwlock_wrlock(pthread_rwlock_t *lock)
+{
+  check(RT_CHECK_LOCK, "pthread_rwlock_wrlock()");
+  if (real_rwlock_wrlock == NULL)
+  {
+    resolve();
+  }
+  return real_rwlock_wrlock(lock);
+}
+
+
+extern "C" int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+  check(RT_CHECK_LOCK, "pthread_cond_wait()");
+  if (real_cond_wait == NULL)
+  {
+    resolve();
+  }
+  return real_cond_wait(cond, mutex);
+}
+
+
+extern "C" int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                                      const struct timespec *timeout)
+{
+  check(RT_CHECK_LOCK, "pthread_cond_timedwait()");
+  if (real_cond_timedwait == NULL)
+  {
+    resolve();
+  }
+  return real_cond_timedwait(cond, mutex, timeout);
+}
+
+
+extern "C" int sem_wait(sem_t *sem)
+{
+  check(RT_CHECK_LOCK, "sem_wait()");
+  if (real_sem_wait == NULL)
+  {
+    resolve();
+  }
+  return real_sem_wait(sem);
+}
+
+
+extern "C" int sem_timedwait(sem_t *sem, const struct timespec *timeout)
+{
+  check(RT_CHECK_LOCK, "sem_timedwait()");
+  if (real_sem_timedwait == NULL)
+  {
+    resolve();
+  }
+  return real_sem_timedwait(sem, timeout);
+}
+
+
+// Qt 4's QMutex, QWaitCondition and QSemaphore wait on a futex directly
+// once contended.  Every system call takes at most six arguments, which
+// are passed on as they came.
+extern "C" long syscall(long number, ...)
+{
+  if (number == SYS_futex)
+  {
+    check(RT_CHECK_LOCK, "futex()");
+  }
+  if (real_syscall == NULL)
+  {
+    resolve();
+  }
+
+  va_list args;
+  va_start(args, number);
+  long a = va_arg(args, long);
+  long b = va_arg(args, long);
+  long c = va_arg(args, long);
+  long d = va_arg(args, long);
+  long e = va_arg(args, long);
+  long f = va_arg(args, long);
+  va_end(args);
+  return real_syscall(number, a, b, c, d, e, f);
+}
+
+
+// Each of these does one thing a check forbids, on a checked thread
+static void *volatile allocated;
+
+
+static void alloc_malloc(void)
+{
+  Realtime::begin_checked(RT_CHECK_ALLOC);
+  allocated = malloc(16);
+}
+
+
+static void alloc_new(void)
+{
+  Realtime::begin_checked(RT_CHECK_ALLOC);
+  allocated = new char[16];
+}
+
+
+static void alloc_free(void)
+{
+  void *p = malloc(16);
+  Realtime::begin_checked(RT_CHECK_ALLOC);
+  free(p);
+}
+
+
+static void alloc_posix_memalign(void)
+{
+  void *p;
+  Realtime::begin_checked(RT_CHECK_ALLOC);
+  if (posix_memalign(&p, 64, 16) == 0)
+  {
+    allocated = p;
+  }
+}
+
+
+static void alloc_aligned(void)
+{
+  Realtime::begin_checked(RT_CHECK_ALLOC);
+  allocated = aligned_alloc(64, 64);
+}
+
+
+static void lock_mutex(void)
+{
+  static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+  Realtime::begin_checked(RT_CHECK_LOCK);
+  pthread_mutex_lock(&mutex);
+}
+
+
+static void lock_trylock(void)
+{
+  static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+  Realtime::begin_checked(RT_CHECK_LOCK);
+  pthread_mutex_trylock(&mutex);
+}
+
+
+static void lock_cond_wait(void)
+{
+  static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+  static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+  struct timespec timeout;
+  clock_gettime(CLOCK_REALTIME, &timeout);
+  pthread_mutex_lock(&mutex);
+  Realtime::begin_checked(RT_CHECK_LOCK);
+  pthread_cond_timedwait(&cond, &mutex, &timeout);
+}
+
+
+static void lock_semaphore(void)
+{
+  static sem_t sem;
+  sem_init(&sem, 0, 1);
+  Realtime::begin_checked(RT_CHECK_LOCK);
+  sem_wait(&sem);
+}
+
+
+static void lock_futex(void)
+{
+  static int word = 0;
+  Realtime::begin_checked(RT_CHECK_LOCK);
+  syscall(SYS_futex, &word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+
+bool Realtime::test_checks(void)
+{
+  static const struct {
+    const char *name;
+    void (*run)(void);
+  } tests[] = {
+    { "malloc()", alloc_malloc },
+    { "operator new", alloc_new },
+    { "free()", alloc_free },
+    { "posix_memalign()", alloc_posix_memalign },
+    { "aligned_alloc()", alloc_aligned },
+    { "pthread_mutex_lock()", lock_mutex },
+    { "pthread_mutex_trylock()", lock_trylock },
+    { "pthread_cond_timedwait()", lock_cond_wait },
+    { "sem_wait()", lock_semaphore },
+    { "futex()", lock_futex },
+  };
+  bool ok = true;
+
+  // Each in a child process, which must abort and not get as far as exiting
+  for (unsigned int i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+  {
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+      int null = open("/dev/null", O_WRONLY);
+      dup2(null, 2);
+      tests[i].run();
+      Realtime::end_checked();
+      _exit(0);
+    }
+
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid
+        || !WIFSIGNALED(status) || WTERMSIG(status) != SIGABRT)
+    {
+      fprintf(stderr, "Realtime checks: %s on a checked thread went unnoticed\n",
+              tests[i].name);
+      ok = false;
+    }
+  }
+  return ok;
+}
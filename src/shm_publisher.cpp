@@ -0,0 +1,50 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "shm_publisher.h"
+
+
+ShmPublisher::ShmPublisher(const char *name, unsigned int channels)
+{
+    for (int c = 0; c < MAX_CHANNELS; c++) {
+        _sequence[c] = 0;
+    }
+
+    if (_ring.create(name, channels)) {
+        qDebug("Publishing frames to shared memory %s (%u slots)", name, _ring.slot_count());
+    }
+}
+
+
+ShmPublisher::~ShmPublisher()
+{
+}
+
+
+// The frame is encoded straight into its slot
+bool ShmPublisher::transmit_frame(const AnalysisFrame *frame)
+{
+    char *buf = _ring.begin_write();
+    int len = Networking::encode_frame(buf, _sequence[frame->channel]++, *frame);
+    _ring.end_write(len, frame->channel, frame->has_spectrum);
+    return true;
+}
@@ -0,0 +1,50 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _SHM_PUBLISHER_H
+#define _SHM_PUBLISHER_H
+
+#include "frame_sink.h"
+#include "shm_ring.h"
+
+
+// Drop-in replacement for Networking that publishes protocol v2 frames into
+// a shared memory ring instead of sending them, for consumers on the same
+// host.  See ShmRing for the layout.
+class ShmPublisher : public FrameSink
+{
+    Q_OBJECT
+
+public:
+    ShmPublisher(const char *name, unsigned int channels);
+    ~ShmPublisher();
+
+    bool is_open(void) const { return _ring.is_open(); }
+
+    bool transmit_frame(const AnalysisFrame *frame);
+
+private:
+    ShmRing _ring;
+    uint32_t _sequence[MAX_CHANNELS];
+};
+
+#endif
@@ -0,0 +1,235 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <QtCore/QDebug>
+
+#include "shm_ring.h"
+
+// Orders the slot generation against the frame data on both sides; the
+// reader's copy may race with the writer, the generation check catches it
+#define shm_barrier() __sync_synchronize()
+
+
+ShmRing::ShmRing()
+    : _owner(false), _header(NULL), _size(0)
+{
+    _name[0] = 0;
+}
+
+
+ShmRing::~ShmRing()
+{
+    close();
+}
+
+
+// shm_open() wants a leading slash and no others
+static void shm_path(char *path, size_t size, const char *name)
+{
+    snprintf(path, size, "/%s", name[0] == '/' ? name + 1 : name);
+}
+
+
+bool ShmRing::create(const char *name, unsigned int channels, unsigned int slot_count)
+{
+    unsigned int slot_size = (sizeof(ShmSlot) + MAX_DATAGRAM_SIZE + 63) & ~63;
+
+    close();
+    shm_path(_name, sizeof(_name), name);
+    shm_unlink(_name);
+
+    int fd = shm_open(_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        qDebug() << "Cannot create shared memory" << _name;
+        return false;
+    }
+
+    _size = SHM_HEADER_SIZE + (size_t)slot_count * slot_size;
+    void *mem = MAP_FAILED;
+    if (ftruncate(fd, _size) == 0) {
+        mem = mmap(NULL, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+
+    if (mem == MAP_FAILED) {
+        qDebug() << "Cannot map shared memory" << _name;
+        shm_unlink(_name);
+        return false;
+    }
+
+    // A fresh object is zero-filled, so every generation and counter starts
+    // at 0
+    _header = (ShmHeader *)mem;
+    _owner = true;
+    _header->version = SHM_VERSION;
+    _header->slot_count = slot_count;
+    _header->slot_size = slot_size;
+    _header->channels = channels;
+    shm_barrier();
+    _header->magic = SHM_MAGIC;
+
+    return true;
+}
+
+
+bool ShmRing::open(const char *name)
+{
+    close();
+    shm_path(_name, sizeof(_name), name);
+
+    int fd = shm_open(_name, O_RDONLY, 0);
+    if (fd < 0) {
+        qDebug() << "No shared memory named" << _name;
+        return false;
+    }
+
+    struct stat st;
+    void *mem = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= SHM_HEADER_SIZE) {
+        _size = st.st_size;
+        mem = mmap(NULL, _size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+
+    if (mem == MAP_FAILED) {
+        qDebug() << "Cannot map shared memory" << _name;
+        return false;
+    }
+
+    ShmHeader *header = (ShmHeader *)mem;
+    shm_barrier();
+    if (header->magic != SHM_MAGIC || header->version != SHM_VERSION
+        || SHM_HEADER_SIZE + (size_t)header->slot_count * header->slot_size > _size)
+    {
+        qDebug() << "Incompatible shared memory ring" << _name;
+        munmap(mem, _size);
+        return false;
+    }
+
+    _header = header;
+    return true;
+}
+
+
+void ShmRing::close(void)
+{
+    if (_header == NULL) {
+        return;
+    }
+
+    munmap(_header, _size);
+    if (_owner) {
+        shm_unlink(_name);
+    }
+    _header = NULL;
+    _owner = false;
+}
+
+
+ShmSlot *ShmRing::slot(uint32_t n) const
+{
+    return (ShmSlot *)((char *)_header + SHM_HEADER_SIZE
+                       + (size_t)(n % _header->slot_count) * _header->slot_size);
+}
+
+
+char *ShmRing::begin_write(void)
+{
+    ShmSlot *s = slot(_header->head);
+
+    s->generation = 2 * _header->head + 1;
+    shm_barrier();
+    return (char *)(s + 1);
+}
+
+
+void ShmRing::end_write(int len, int channel, bool has_spectrum)
+{
+    uint32_t n = _header->head;
+    ShmSlot *s = slot(n);
+
+    s->length = len;
+    shm_barrier();
+    s->generation = 2 * n + 2;
+    shm_barrier();
+
+    if (has_spectrum) {
+        _header->latest_spectrum[channel] = n + 1;
+    }
+    _header->head = n + 1;
+}
+
+
+uint32_t ShmRing::head(void) const
+{
+    uint32_t head = _header->head;
+    shm_barrier();
+    return head;
+}
+
+
+ShmRing::ReadResult ShmRing::read(uint32_t n, char *buf, int *len) const
+{
+    const ShmSlot *s = slot(n);
+    uint32_t expected = 2 * n + 2;
+
+    uint32_t before = s->generation;
+    shm_barrier();
+    if (before != expected) {
+        // Anything behind the wanted frame is an older one not yet replaced
+        return (int32_t)(before - expected) < 0 ? READ_NOT_READY : READ_OVERRUN;
+    }
+
+    uint32_t length = s->length;
+    if (length > MAX_DATAGRAM_SIZE) {
+        return READ_OVERRUN;
+    }
+    memcpy(buf, s + 1, length);
+
+    shm_barrier();
+    if (s->generation != before) {
+        return READ_OVERRUN;
+    }
+
+    *len = length;
+    return READ_OK;
+}
+
+
+bool ShmRing::latest_spectrum(int channel, uint32_t *n) const
+{
+    uint32_t latest = _header->latest_spectrum[channel];
+    shm_barrier();
+
+    if (latest == 0) {
+        return false;
+    }
+    *n = latest - 1;
+    return true;
+}
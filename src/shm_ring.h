@@ -0,0 +1,117 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _SHM_RING_H
+#define _SHM_RING_H
+
+#include <stdint.h>
+
+#include "audio_source.h"
+#include "networking.h"
+
+#define SHM_MAGIC 0x48534d46  // "FMSH"
+#define SHM_VERSION 1
+#define SHM_DEFAULT_SLOTS 256
+
+// Offset of the first slot, leaving the header a page of its own
+#define SHM_HEADER_SIZE 4096
+
+
+// A ring of protocol v2 frames in a POSIX shared memory object
+// (/dev/shm/<name> on Linux), for consumers on the same host.  There is one
+// writer; any number of readers map it read-only and never make a syscall
+// to read a frame.
+//
+// Frame n (counting from 0 since the ring was created) lives in slot
+// n % slot_count.  Each slot is a seqlock: its generation is 2n + 1 while frame n
+// is being written and 2n + 2 once it is complete, so a reader can tell
+// whether the slot holds the frame it wants, an older one (not written yet)
+// or a newer one (overrun), and whether it was overwritten during the copy.
+// All counters are 32 bits and wrap; compare them by difference.
+struct ShmHeader
+{
+    uint32_t magic;         // SHM_MAGIC, written last once the ring is ready
+    uint32_t version;       // SHM_VERSION
+    uint32_t slot_count;
+    uint32_t slot_size;     // bytes per slot, including ShmSlot
+    uint32_t channels;
+    uint32_t reserved[3];
+
+    // Frames published so far
+    volatile uint32_t head;
+
+    // For each channel, 1 + the number of its newest frame with a spectrum,
+    // or 0 if there is none yet
+    volatile uint32_t latest_spectrum[MAX_CHANNELS];
+};
+
+struct ShmSlot
+{
+    volatile uint32_t generation;
+    uint32_t length;        // bytes of frame data that follow
+};
+
+
+class ShmRing
+{
+public:
+    enum ReadResult { READ_OK, READ_NOT_READY, READ_OVERRUN };
+
+    ShmRing();
+    ~ShmRing();
+
+    // Writer: (re)creates the named object, so a restarted writer starts a
+    // fresh ring.  The object is removed again when the writer closes.
+    bool create(const char *name, unsigned int channels,
+                unsigned int slot_count = SHM_DEFAULT_SLOTS);
+
+    // Reader: maps an existing ring read-only
+    bool open(const char *name);
+
+    void close(void);
+    bool is_open(void) const { return _header != NULL; }
+
+    // Writer side.  Encode a frame into begin_write()'s buffer (up to
+    // MAX_DATAGRAM_SIZE bytes), then publish it with end_write().
+    char *begin_write(void);
+    void end_write(int len, int channel, bool has_spectrum);
+
+    // Reader side.  Copies frame n into buf, which must hold
+    // MAX_DATAGRAM_SIZE bytes.
+    uint32_t head(void) const;
+    unsigned int slot_count(void) const { return _header->slot_count; }
+    unsigned int channels(void) const { return _header->channels; }
+    ReadResult read(uint32_t n, char *buf, int *len) const;
+
+    // The number of channel's newest frame carrying a spectrum
+    bool latest_spectrum(int channel, uint32_t *n) const;
+
+private:
+    ShmSlot *slot(uint32_t n) const;
+
+    char _name[64];
+    bool _owner;
+    ShmHeader *_header;
+    size_t _size;
+};
+
+#endif
@@ -0,0 +1,53 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <string.h>
+
+#include "sliding_window.h"
+
+
+SlidingWindow::SlidingWindow(unsigned int size)
+    : _size(size), _pos(0)
+{
+  _buffer = new sample_t[2 * _size];
+  memset(_buffer, 0, 2 * _size * sizeof(sample_t));
+}
+
+
+SlidingWindow::~SlidingWindow()
+{
+  delete[] _buffer;
+}
+
+
+void SlidingWindow::push(const sample_t *samples, unsigned int nframes)
+{
+  for (unsigned int i = 0; i < nframes; i++)
+  {
+    _buffer[_pos] = samples[i];
+    _buffer[_pos + _size] = samples[i];
+    if (++_pos == _size)
+    {
+      _pos = 0;
+    }
+  }
+}
@@ -0,0 +1,63 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _SLIDING_WINDOW_H
+#define _SLIDING_WINDOW_H
+
+#include "audio_source.h"
+
+
+// The most recent size samples of a stream, always readable as one
+// contiguous block, oldest first.
+//
+// Every sample is written twice, size apart, into a buffer of twice the
+// window length, so advancing by a hop costs 2 * hop stores no matter how
+// large the window is and nothing ever has to be shifted or re-copied.
+// Any shorter run of the history is contiguous too, so several analysis
+// chains with different windows and hops can all read from one
+// SlidingWindow sized for the largest of them.
+class SlidingWindow
+{
+public:
+  SlidingWindow(unsigned int size);
+  ~SlidingWindow();
+
+  void push(const sample_t *samples, unsigned int nframes);
+  const sample_t *data(void) const { return _buffer + _pos; }
+  // The count samples ending age samples before the newest one; count +
+  // age must not exceed size()
+  const sample_t *data(unsigned int count, unsigned int age) const
+  {
+    return _buffer + _pos + _size - age - count;
+  }
+  unsigned int size(void) const { return _size; }
+
+private:
+  SlidingWindow(const SlidingWindow&);
+  SlidingWindow& operator=(const SlidingWindow&);
+
+  unsigned int _size;
+  unsigned int _pos;
+  sample_t *_buffer;
+};
+
+#endif
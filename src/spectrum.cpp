@@ -0,0 +1,449 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <math.h>
+#include <string.h>
+
+#include "spectrum.h"
+
+// smpl_t is float unless aubio was built in double precision
+#if !HAVE_AUBIO_DOUBLE && defined(__AVX__)
+#include <immintrin.h>
+#define SPECTRUM_AVX 1
+#elif !HAVE_AUBIO_DOUBLE && (defined(__SSE__) || defined(_M_X64))
+#include <xmmintrin.h>
+#define SPECTRUM_SSE 1
+#endif
+
+// Weight runs are padded to this many floats (one AVX register)
+#define SPECTRUM_ALIGN 8
+
+
+// Bucket layout for a 1024-point FFT: each output bucket either interpolates
+// between two adjacent bins (when its index repeats) or sums the range of bins
+// up to the next bucket's index.
+static const int bucket_indexes[] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2,
+    3, 3, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4,
+    5, 5, 5, 5, 5, 5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 6,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 8, 8, 8, 8, 8, 8, 8,
+    9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9,
+    10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
+    11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+    12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+    13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13,
+    14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+    15, 15, 15, 15, 15, 15, 15, 15, 16, 16, 16, 16, 16, 16, 16, 16,
+    17, 17, 17, 17, 17, 17, 17, 17, 18, 18, 18, 18, 18, 18, 18, 18,
+    19, 19, 19, 19, 19, 19, 19, 20, 20, 20, 20, 20, 20, 21, 21, 21,
+    21, 21, 22, 22, 22, 22, 23, 23, 23, 24, 24, 25, 26, 27, 28, 29,
+    30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45,
+    50, 60, 70, 80, 90, 100, 110, 120, 130, 140, 150, 160, 170, 180, 200, 220, 256
+};
+static const int bucket_lerp[] = {
+    1, 2, 3, 4, 5, 6, 7, 8, 1, 2, 3, 4, 5, 6, 7, 8,
+    1, 2, 3, 4, 5, 6, 7, 8, 1, 2, 3, 4, 5, 6, 7, 8,
+    1, 2, 3, 4, 5, 6, 7, 8, 1, 2, 3, 4, 5, 6, 7, 8,
+    1, 2, 3, 4, 5, 6, 7, 8, 1, 2, 3, 4, 5, 6, 7, 8,
+    1, 2, 2, 3, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 9,
+    1, 2, 2, 3, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 9,
+    1, 2, 2, 3, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 9,
+    1, 2, 2, 3, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 9,
+    1, 2, 2, 3, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 9,
+    1, 2, 2, 3, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 9,
+    1, 2, 3, 4, 5, 6, 7, 8, 1, 2, 3, 4, 5, 6, 7, 8,
+    1, 2, 3, 4, 5, 6, 7, 8, 1, 2, 3, 4, 5, 6, 7, 8,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5
+};
+
+static const float adjust_volume[] = {
+    4, 4, 3, 3, 3, 3, 3, 3, 3, 2, 1, 1, 1, 1, 1, 1,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+    9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9,
+    10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
+    11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+    12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+    9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 5
+
+//            1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+//            2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+//            3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+//            4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+//            5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+//            6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+//            7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+//            8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+//            9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9,
+//            10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
+//            11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+//            12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+//            13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13,
+//            14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+//            15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+//            10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10
+};
+
+
+SpectrumBinner::SpectrumBinner(void)
+    : _fft_size(1024), _bands(LOG_SPECTRUM_SIZE)
+{
+  for (unsigned int i = 0; i < LOG_SPECTRUM_SIZE; i++)
+  {
+    float volume = adjust_volume[i] / 16.0f;
+    int first = bucket_indexes[i];
+
+    if (bucket_indexes[i] == bucket_indexes[i+1])
+    {
+      float lerp = bucket_lerp[i] / 10.0f;
+      float w[2] = { (1.0f - lerp) * volume, lerp * volume };
+      add_run(i, first, 2, w);
+    }
+    else
+    {
+      int count = bucket_indexes[i+1] - first + 1;
+      std::vector<float> w(count, volume);
+      add_run(i, first, count, &w[0]);
+    }
+  }
+
+  pack();
+}
+
+
+SpectrumBinner::SpectrumBinner(unsigned int fft_size, int samplerate,
+                               unsigned int bands, float fmin, float fmax,
+                               float weight_lo, float weight_hi)
+    : _fft_size(fft_size), _bands(bands)
+{
+  unsigned int nbins = fft_size / 2 + 1;
+  float bin_hz = (float)samplerate / fft_size;
+  float ratio = fmax / fmin;
+
+  if (fmax > samplerate / 2.0f)
+  {
+    ratio = samplerate / 2.0f / fmin;
+  }
+
+  for (unsigned int b = 0; b < bands; b++)
+  {
+    // Band edges in (fractional) bins
+    float lo = fmin * powf(ratio, (float)b / bands) / bin_hz;
+    float hi = fmin * powf(ratio, (float)(b + 1) / bands) / bin_hz;
+    float gain = weight_lo;
+
+    if (bands > 1)
+    {
+      gain += (weight_hi - weight_lo) * b / (bands - 1);
+    }
+
+    if (hi - lo < 1.0f)
+    {
+      // Narrower than a bin: interpolate at the band centre
+      float centre = (lo + hi) / 2;
+      unsigned int first = (unsigned int)centre;
+      float frac = centre - first;
+
+      if (first + 1 >= nbins)
+      {
+        first = nbins - 2;
+        frac = 1.0f;
+      }
+
+      float w[2] = { (1.0f - frac) * gain, frac * gain };
+      add_run(b, first, 2, w);
+    }
+    else
+    {
+      // Sum the bins, weighting the edge bins by how much of each (taken as
+      // covering +/- half a bin around its centre) falls inside the band
+      unsigned int first = (unsigned int)floorf(lo + 0.5f);
+      unsigned int last = (unsigned int)ceilf(hi - 0.5f);
+
+      if (last >= nbins)
+      {
+        last = nbins - 1;
+      }
+      if (first > last)
+      {
+        first = last;
+      }
+
+      std::vector<float> w(last - first + 1);
+      for (unsigned int k = first; k <= last; k++)
+      {
+        float overlap = fminf(hi, k + 0.5f) - fmaxf(lo, k - 0.5f);
+        w[k - first] = (overlap > 0 ? overlap : 0) * gain;
+      }
+      add_run(b, first, w.size(), &w[0]);
+    }
+  }
+
+  pack();
+}
+
+
+// For mel() and chroma(), which add the runs themselves
+SpectrumBinner::SpectrumBinner(unsigned int fft_size, unsigned int bands)
+    : _fft_size(fft_size), _bands(bands)
+{
+}
+
+
+SpectrumBinner::~SpectrumBinner()
+{
+  delete[] _storage;
+}
+
+
+static float hz_to_mel(float hz)
+{
+  return 2595 * log10f(1 + hz / 700);
+}
+
+
+static float mel_to_hz(float mel)
+{
+  return 700 * (powf(10, mel / 2595) - 1);
+}
+
+
+SpectrumBinner *SpectrumBinner::mel(unsigned int fft_size, int samplerate, unsigned int bands,
+                                    float fmin, float fmax)
+{
+  SpectrumBinner *binner = new SpectrumBinner(fft_size, bands);
+  float bin_hz = (float)samplerate / fft_size;
+
+  if (fmax > samplerate / 2.0f)
+  {
+    fmax = samplerate / 2.0f;
+  }
+
+  // Band b rises from edge b to its centre at edge b + 1 and falls to zero
+  // at edge b + 2
+  float mel_lo = hz_to_mel(fmin);
+  float mel_step = (hz_to_mel(fmax) - mel_lo) / (bands + 1);
+
+  for (unsigned int b = 0; b < bands; b++)
+  {
+    binner->add_triangle(b, mel_to_hz(mel_lo + b * mel_step) / bin_hz,
+                         mel_to_hz(mel_lo + (b + 1) * mel_step) / bin_hz,
+                         mel_to_hz(mel_lo + (b + 2) * mel_step) / bin_hz);
+  }
+
+  binner->pack();
+  return binner;
+}
+
+
+SpectrumBinner *SpectrumBinner::chroma(unsigned int fft_size, int samplerate,
+                                       float fmin, float fmax)
+{
+  SpectrumBinner *binner = new SpectrumBinner(fft_size, CHROMA_BINS);
+  float bin_hz = (float)samplerate / fft_size;
+  float semitone = powf(2, 1.0f / 12);
+
+  // Notes in semitones from A4, which is pitch class 9
+  int first = (int)ceilf(12 * log2f(fmin / CHROMA_TUNING_HZ));
+  int last = (int)floorf(12 * log2f(fmax / CHROMA_TUNING_HZ));
+
+  // Each class's runs are added together, octave by octave
+  for (int c = 0; c < CHROMA_BINS; c++)
+  {
+    for (int note = first; note <= last; note++)
+    {
+      if (((note + 9) % 12 + 12) % 12 != c)
+      {
+        continue;
+      }
+
+      float centre = CHROMA_TUNING_HZ * powf(2, note / 12.0f) / bin_hz;
+      if (centre - centre / semitone < 1.0f || centre * semitone >= fft_size / 2)
+      {
+        continue;
+      }
+      binner->add_triangle(c, centre / semitone, centre, centre * semitone);
+    }
+  }
+
+  binner->pack();
+  return binner;
+}
+
+
+// Runs are added band by band while building, then packed by pack()
+void SpectrumBinner::add_run(unsigned int band, unsigned int first, unsigned int count,
+                             const float *weights)
+{
+  _band.push_back(band);
+  _first.push_back(first);
+  _count.push_back(count);
+  _offset.push_back(_staging.size());
+
+  _staging.insert(_staging.end(), weights, weights + count);
+  _staging.resize((_staging.size() + SPECTRUM_ALIGN - 1) / SPECTRUM_ALIGN * SPECTRUM_ALIGN);
+}
+
+
+// A filter rising from zero at bin lo to 1 at centre and falling to zero at
+// hi, with its weights scaled to sum to 1 so that the band is an average
+// magnitude.  One narrower than two bins interpolates at its centre instead.
+void SpectrumBinner::add_triangle(unsigned int band, float lo, float centre, float hi)
+{
+  unsigned int nbins = _fft_size / 2 + 1;
+
+  if (hi - lo < 2.0f)
+  {
+    unsigned int first = (unsigned int)centre;
+    float frac = centre - first;
+
+    if (first + 1 >= nbins)
+    {
+      first = nbins - 2;
+      frac = 1.0f;
+    }
+
+    float w[2] = { 1.0f - frac, frac };
+    add_run(band, first, 2, w);
+    return;
+  }
+
+  unsigned int first = (unsigned int)floorf(lo) + 1;
+  unsigned int last = (unsigned int)ceilf(hi) - 1;
+  if (last >= nbins)
+  {
+    last = nbins - 1;
+  }
+
+  std::vector<float> w(last - first + 1);
+  float sum = 0;
+  for (unsigned int k = first; k <= last; k++)
+  {
+    float weight = k < centre ? (k - lo) / (centre - lo) : (hi - k) / (hi - centre);
+    w[k - first] = weight > 0 ? weight : 0;
+    sum += w[k - first];
+  }
+  for (unsigned int k = 0; k < w.size(); k++)
+  {
+    w[k] /= sum;
+  }
+  add_run(band, first, w.size(), &w[0]);
+}
+
+
+void SpectrumBinner::pack(void)
+{
+  _storage = new float[_staging.size() + SPECTRUM_ALIGN];
+
+  size_t misalign = ((size_t)_storage / sizeof(float)) % SPECTRUM_ALIGN;
+  _weights = _storage + (misalign ? SPECTRUM_ALIGN - misalign : 0);
+
+  memcpy(_weights, &_staging[0], _staging.size() * sizeof(float));
+  std::vector<float>().swap(_staging);
+}
+
+
+void SpectrumBinner::apply(const smpl_t *norm, float *out) const
+{
+  for (unsigned int b = 0; b < _bands; b++)
+  {
+    out[b] = 0;
+  }
+
+  unsigned int runs = _band.size();
+  for (unsigned int r = 0; r < runs; r++)
+  {
+    const smpl_t *x = norm + _first[r];
+    const float *w = _weights + _offset[r];
+    unsigned int n = _count[r];
+    unsigned int k = 0;
+    float sum = 0;
+
+#if SPECTRUM_AVX
+    if (n >= 8)
+    {
+      __m256 acc = _mm256_setzero_ps();
+      for (; k + 8 <= n; k += 8)
+      {
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(x + k),
+                                               _mm256_load_ps(w + k)));
+      }
+      __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc),
+                            _mm256_extractf128_ps(acc, 1));
+      s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+      s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+      sum = _mm_cvtss_f32(s);
+    }
+#elif SPECTRUM_SSE
+    if (n >= 4)
+    {
+      __m128 acc = _mm_setzero_ps();
+      for (; k + 4 <= n; k += 4)
+      {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(x + k), _mm_load_ps(w + k)));
+      }
+      acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+      acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+      sum = _mm_cvtss_f32(acc);
+    }
+#endif
+
+    for (; k < n; k++)
+    {
+      sum += x[k] * w[k];
+    }
+    out[_band[r]] += sum;
+  }
+}
+
+
+void legacy_log_spectrum(const smpl_t *norm, float *logged_buffer)
+{
+  for (int i = 0; i < LOG_SPECTRUM_SIZE; i++)
+  {
+      if (bucket_indexes[i] == bucket_indexes[i+1])
+      {
+          float lerp = bucket_lerp[i] / 10.0;
+          logged_buffer[i] = norm[bucket_indexes[i]] * (1.0 - lerp) + norm[bucket_indexes[i]+1] * (lerp);
+      }
+      else
+      {
+          logged_buffer[i] = 0;
+          for (int j = bucket_indexes[i]; (j <= bucket_indexes[i+1]); j++)
+          {
+              logged_buffer[i] += norm[j];
+          }
+      }
+      logged_buffer[i] *= adjust_volume[i] / 16.0;
+  }
+}
@@ -0,0 +1,132 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _SPECTRUM_H
+#define _SPECTRUM_H
+
+// TODO: Make this less dumb by requiring Win32 to have aubio.h in the same place?
+#ifdef __MINGW32__
+#include <aubio.h>
+#else
+#include <aubio/aubio.h>
+#endif
+
+#include <vector>
+
+#include "analysis_frame.h"
+
+// Number of buckets in the legacy 1024-point layout
+#define LOG_SPECTRUM_SIZE 256
+
+// Default generated layout
+#define SPECTRUM_DEFAULT_FMIN 40.0f
+#define SPECTRUM_DEFAULT_FMAX 16000.0f
+#define SPECTRUM_DEFAULT_WEIGHT_LO 0.25f
+#define SPECTRUM_DEFAULT_WEIGHT_HI 0.75f
+
+// Notes the chroma covers, C1 to C8
+#define CHROMA_DEFAULT_FMIN 32.7f
+#define CHROMA_DEFAULT_FMAX 4186.0f
+// Pitch of A4, which fixes where the pitch classes fall
+#define CHROMA_TUNING_HZ 440.0f
+
+
+// Reduces FFT magnitudes to a smaller number of roughly logarithmically
+// spaced, weighted bands.
+//
+// The reduction is a sparse matrix built once up front: every band is a
+// weighted sum over one or more contiguous runs of bins, with the per-band
+// volume adjustment folded into the weights.  Bands narrower than one bin
+// become a linear interpolation between the two nearest bins.  apply() walks
+// the runs with SSE or AVX when the build enables them, or plain scalar code
+// otherwise.
+//
+// The same machinery gives the mel and chroma features, from mel() and
+// chroma(); each of their bands averages the magnitudes it covers.
+class SpectrumBinner
+{
+public:
+  // The hand-tuned FireMix layout: LOG_SPECTRUM_SIZE bands over a 1024-point
+  // FFT, equivalent to legacy_log_spectrum().
+  SpectrumBinner(void);
+
+  // bands log-spaced between fmin and fmax Hz, with a gain ramping from
+  // weight_lo on the lowest band to weight_hi on the highest.
+  SpectrumBinner(unsigned int fft_size, int samplerate, unsigned int bands,
+                 float fmin, float fmax,
+                 float weight_lo = SPECTRUM_DEFAULT_WEIGHT_LO,
+                 float weight_hi = SPECTRUM_DEFAULT_WEIGHT_HI);
+
+  ~SpectrumBinner();
+
+  // bands triangular filters, equally spaced in mel between fmin and fmax
+  // Hz, each overlapping its neighbours' centres
+  static SpectrumBinner *mel(unsigned int fft_size, int samplerate, unsigned int bands,
+                             float fmin, float fmax);
+
+  // CHROMA_BINS pitch classes, C first.  Each sums its notes between fmin
+  // and fmax Hz, with a triangular weight reaching a semitone either side of
+  // the note.  Notes less than a bin apart can't be told from their
+  // neighbours and are left out, so a short FFT only covers the upper
+  // octaves.
+  static SpectrumBinner *chroma(unsigned int fft_size, int samplerate,
+                                float fmin = CHROMA_DEFAULT_FMIN,
+                                float fmax = CHROMA_DEFAULT_FMAX);
+
+  unsigned int bands(void) const { return _bands; }
+  unsigned int fft_size(void) const { return _fft_size; }
+
+  // norm holds fft_size / 2 + 1 magnitudes; out receives bands() values
+  void apply(const smpl_t *norm, float *out) const;
+
+private:
+  SpectrumBinner(unsigned int fft_size, unsigned int bands);
+  SpectrumBinner(const SpectrumBinner&);
+  SpectrumBinner& operator=(const SpectrumBinner&);
+
+  void add_run(unsigned int band, unsigned int first, unsigned int count,
+               const float *weights);
+  void add_triangle(unsigned int band, float lo, float centre, float hi);
+  void pack(void);
+
+  unsigned int _fft_size;
+  unsigned int _bands;
+
+  // Per run: the band it adds to, first bin, number of bins, and offset of
+  // its weights
+  std::vector<unsigned int> _band;
+  std::vector<unsigned int> _first;
+  std::vector<unsigned int> _count;
+  std::vector<unsigned int> _offset;
+
+  // Each run's weights start on a 32-byte boundary for aligned SIMD loads
+  std::vector<float> _staging;
+  float *_storage;
+  float *_weights;
+};
+
+
+// Straight implementation of the original hard-coded bucket tables, kept as
+// the reference for SpectrumBinner's legacy layout (see bench/).
+void legacy_log_spectrum(const smpl_t *norm, float *logged_buffer);
+
+#endif
@@ -0,0 +1,298 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <math.h>
+#include <string.h>
+
+#include <QtCore/QtGlobal>
+
+#include "spectrum_codec.h"
+#include "byte_order.h"
+
+
+SpectrumCodec::SpectrumCodec(Encoding encoding, bool delta)
+    : _encoding(encoding), _delta(delta && encoding != ENCODING_FLOAT)
+{
+    for (int c = 0; c < MAX_CHANNELS; c++) {
+        _bands[c] = 0;
+        _reference[c] = 0;
+        _since_keyframe[c] = 0;
+    }
+}
+
+
+bool SpectrumCodec::parse_encoding(const char *name, Encoding *encoding)
+{
+    if (strcmp(name, "float") == 0) {
+        *encoding = ENCODING_FLOAT;
+    } else if (strcmp(name, "log16") == 0) {
+        *encoding = ENCODING_LOG16;
+    } else if (strcmp(name, "log8") == 0) {
+        *encoding = ENCODING_LOG8;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+
+unsigned int SpectrumCodec::max_code(Encoding encoding)
+{
+    return encoding == ENCODING_LOG8 ? 0xff : 0xffff;
+}
+
+
+float SpectrumCodec::step_db(Encoding encoding)
+{
+    if (encoding == ENCODING_FLOAT) {
+        return 0;
+    }
+    return (SPECTRUM_DB_CEIL - SPECTRUM_DB_FLOOR) / (max_code(encoding) - 1);
+}
+
+
+uint16_t SpectrumCodec::quantize(float value, Encoding encoding)
+{
+    if (!(value > 0)) {
+        return 0;
+    }
+
+    float db = 20 * log10f(value);
+    if (db < SPECTRUM_DB_FLOOR) {
+        return 0;
+    }
+
+    unsigned int max = max_code(encoding);
+    float code = 1 + (db - SPECTRUM_DB_FLOOR) / step_db(encoding) + 0.5f;
+    return code >= max ? max : (uint16_t)code;
+}
+
+
+float SpectrumCodec::dequantize(uint16_t code, Encoding encoding)
+{
+    if (code == 0) {
+        return 0;
+    }
+    return powf(10, (SPECTRUM_DB_FLOOR + (code - 1) * step_db(encoding)) / 20);
+}
+
+
+int SpectrumCodec::encode_float(char *buf, const float *spectrum, unsigned int bands)
+{
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    memcpy(buf, spectrum, bands * sizeof(float));
+#else
+    char *p = buf;
+    for (unsigned int i = 0; i < bands; i++) {
+        p = put_float(p, spectrum[i]);
+    }
+#endif
+    return bands * sizeof(float);
+}
+
+
+int SpectrumCodec::decode_float(const char *buf, int len, float *spectrum, unsigned int bands)
+{
+    const char *p = buf;
+
+    if (len < (int)(bands * sizeof(float))) {
+        return -1;
+    }
+    for (unsigned int i = 0; i < bands; i++) {
+        p = get_float(p, &spectrum[i]);
+    }
+    return p - buf;
+}
+
+
+int SpectrumCodec::encode_levels(char *buf, Encoding encoding, const float *values,
+                                 unsigned int count)
+{
+    char *p = buf;
+
+    if (encoding == ENCODING_FLOAT) {
+        return encode_float(buf, values, count);
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        uint16_t code = quantize(values[i], encoding);
+        if (encoding == ENCODING_LOG8) {
+            *p++ = (char)code;
+        } else {
+            p = put_u16(p, code);
+        }
+    }
+    return p - buf;
+}
+
+
+int SpectrumCodec::decode_levels(const char *buf, int len, Encoding encoding, float *values,
+                                 unsigned int count)
+{
+    const char *p = buf;
+
+    if (encoding == ENCODING_FLOAT) {
+        return decode_float(buf, len, values, count);
+    }
+    if (encoding != ENCODING_LOG16 && encoding != ENCODING_LOG8) {
+        return -1;
+    }
+
+    unsigned int width = encoding == ENCODING_LOG8 ? 1 : 2;
+    if (len < (int)(count * width)) {
+        return -1;
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        uint16_t code;
+        if (width == 1) {
+            code = (unsigned char)*p++;
+        } else {
+            p = get_u16(p, &code);
+        }
+        values[i] = dequantize(code, encoding);
+    }
+    return p - buf;
+}
+
+
+int SpectrumCodec::encode(char *buf, int channel, uint32_t sequence,
+                          const float *spectrum, unsigned int bands, bool *delta)
+{
+    char *p = buf;
+
+    *delta = false;
+
+    if (_encoding == ENCODING_FLOAT) {
+        return encode_float(buf, spectrum, bands);
+    }
+
+    uint16_t *codes = _codes[channel];
+
+    *delta = _delta && _bands[channel] == bands
+             && _since_keyframe[channel] + 1 < SPECTRUM_KEYFRAME_INTERVAL;
+
+    if (*delta) {
+        p = put_u32(p, _reference[channel]);
+        for (unsigned int i = 0; i < bands; i++) {
+            uint16_t code = quantize(spectrum[i], _encoding);
+            int32_t d = (int32_t)code - codes[i];
+            uint32_t zigzag = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+
+            while (zigzag >= 0x80) {
+                *p++ = (char)(zigzag | 0x80);
+                zigzag >>= 7;
+            }
+            *p++ = (char)zigzag;
+            codes[i] = code;
+        }
+        _since_keyframe[channel]++;
+    } else {
+        for (unsigned int i = 0; i < bands; i++) {
+            codes[i] = quantize(spectrum[i], _encoding);
+            if (_encoding == ENCODING_LOG8) {
+                *p++ = (char)codes[i];
+            } else {
+                p = put_u16(p, codes[i]);
+            }
+        }
+        _since_keyframe[channel] = 0;
+    }
+
+    _bands[channel] = bands;
+    _reference[channel] = sequence;
+    return p - buf;
+}
+
+
+int SpectrumCodec::decode(const char *buf, int len, Encoding encoding, bool delta,
+                          int channel, uint32_t sequence, float *spectrum,
+                          unsigned int bands)
+{
+    const char *p = buf;
+    const char *end = buf + len;
+
+    if (encoding == ENCODING_FLOAT) {
+        return decode_float(buf, len, spectrum, bands);
+    }
+
+    if (encoding != ENCODING_LOG16 && encoding != ENCODING_LOG8) {
+        return -1;
+    }
+
+    uint16_t *codes = _codes[channel];
+    unsigned int max = max_code(encoding);
+
+    if (delta) {
+        uint32_t reference;
+        if (len < 4 || _bands[channel] != bands) {
+            return -1;
+        }
+        p = get_u32(p, &reference);
+        if (reference != _reference[channel]) {
+            return -1;
+        }
+
+        // Decode into spectrum first, so a truncated frame leaves the
+        // reference codes alone
+        for (unsigned int i = 0; i < bands; i++) {
+            uint32_t zigzag = 0;
+            int shift = 0;
+            unsigned char byte;
+            do {
+                if (p == end || shift > 28) {
+                    return -1;
+                }
+                byte = (unsigned char)*p++;
+                zigzag |= (uint32_t)(byte & 0x7f) << shift;
+                shift += 7;
+            } while (byte & 0x80);
+
+            int32_t code = codes[i] + (int32_t)((zigzag >> 1) ^ -(zigzag & 1));
+            if (code < 0 || code > (int32_t)max) {
+                return -1;
+            }
+            spectrum[i] = code;
+        }
+        for (unsigned int i = 0; i < bands; i++) {
+            codes[i] = (uint16_t)spectrum[i];
+        }
+    } else {
+        unsigned int width = encoding == ENCODING_LOG8 ? 1 : 2;
+        if (len < (int)(bands * width)) {
+            return -1;
+        }
+        for (unsigned int i = 0; i < bands; i++) {
+            if (width == 1) {
+                codes[i] = (unsigned char)*p++;
+            } else {
+                p = get_u16(p, &codes[i]);
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < bands; i++) {
+        spectrum[i] = dequantize(codes[i], encoding);
+    }
+
+    _bands[channel] = bands;
+    _reference[channel] = sequence;
+    return p - buf;
+}
@@ -0,0 +1,113 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _SPECTRUM_CODEC_H
+#define _SPECTRUM_CODEC_H
+
+#include <stdint.h>
+
+#include "analysis_frame.h"
+
+// Range of band levels the log encodings cover; anything quieter is sent as
+// silence and anything louder is clipped
+#define SPECTRUM_DB_FLOOR -100.0f
+#define SPECTRUM_DB_CEIL 80.0f
+
+// A delta-coded channel sends a full spectrum at least this often, so a
+// receiver that lost a frame recovers
+#define SPECTRUM_KEYFRAME_INTERVAL 16
+
+
+// Encodes and decodes the spectrum part of a protocol v2 frame.
+//
+//   ENCODING_FLOAT   4 bytes per band, float
+//   ENCODING_LOG16   2 bytes per band, level in dB quantized to 16 bits
+//   ENCODING_LOG8    1 byte per band, level in dB quantized to 8 bits
+//
+// The log encodings map SPECTRUM_DB_FLOOR..SPECTRUM_DB_CEIL linearly onto
+// codes 1..max, with code 0 meaning silence, so within that range a band
+// comes back within half a step (step_db()) of what was sent.
+//
+// With delta coding a log-encoded spectrum may instead be sent relative to
+// the channel's previous spectrum: the reference frame's sequence number
+// (u32) followed by the difference of each band's code from the reference,
+// zigzag-encoded as a LEB128 varint.  Quiet or steady bands then take a
+// single byte.  The codes themselves are exact, so there is no drift.
+//
+// A codec keeps per-channel state: the encoder the codes it last sent, the
+// decoder the codes it last received.  Use one per stream and direction.
+class SpectrumCodec
+{
+public:
+    enum Encoding { ENCODING_FLOAT = 0, ENCODING_LOG16 = 1, ENCODING_LOG8 = 2 };
+
+    SpectrumCodec(Encoding encoding = ENCODING_FLOAT, bool delta = false);
+
+    Encoding encoding(void) const { return _encoding; }
+    bool delta(void) const { return _delta; }
+
+    // Parses "float", "log16" or "log8"
+    static bool parse_encoding(const char *name, Encoding *encoding);
+
+    // Quantization step of an encoding in dB, 0 for float
+    static float step_db(Encoding encoding);
+
+    // ENCODING_FLOAT needs no state; these are used for it whatever the
+    // codec's own encoding
+    static int encode_float(char *buf, const float *spectrum, unsigned int bands);
+    static int decode_float(const char *buf, int len, float *spectrum, unsigned int bands);
+
+    // A short vector of levels, such as the chroma and mel features, in any
+    // encoding but never delta-coded, so these need no state either
+    static int encode_levels(char *buf, Encoding encoding, const float *values,
+                             unsigned int count);
+    static int decode_levels(const char *buf, int len, Encoding encoding, float *values,
+                             unsigned int count);
+
+    // Writes the spectrum payload of frame sequence on channel to buf and
+    // returns its length.  *delta is set if it was delta-coded.
+    int encode(char *buf, int channel, uint32_t sequence,
+               const float *spectrum, unsigned int bands, bool *delta);
+
+    // Reads a payload of len bytes into spectrum.  Returns the number of
+    // bytes used, or -1 if it is malformed or is a delta against a frame
+    // this decoder hasn't seen.
+    int decode(const char *buf, int len, Encoding encoding, bool delta,
+               int channel, uint32_t sequence, float *spectrum, unsigned int bands);
+
+private:
+    static unsigned int max_code(Encoding encoding);
+    static uint16_t quantize(float value, Encoding encoding);
+    static float dequantize(uint16_t code, Encoding encoding);
+
+    Encoding _encoding;
+    bool _delta;
+
+    // Per channel: the last spectrum's codes and band count, its frame's
+    // sequence number, and spectra since the last full one
+    uint16_t _codes[MAX_CHANNELS][MAX_BANDS];
+    unsigned int _bands[MAX_CHANNELS];
+    uint32_t _reference[MAX_CHANNELS];
+    unsigned int _since_keyframe[MAX_CHANNELS];
+};
+
+#endif
@@ -0,0 +1,94 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <math.h>
+
+#include "spectrum_gate.h"
+
+
+static unsigned int interval(int samplerate, float rate)
+{
+  return rate > 0 ? (unsigned int)(samplerate / rate) : 0;
+}
+
+
+SpectrumGate::SpectrumGate(int samplerate, float threshold_db, float min_rate, float max_rate)
+    : _threshold_db(threshold_db),
+      _min_interval(interval(samplerate, max_rate)),
+      _max_interval(interval(samplerate, min_rate)),
+      _since_sent(0), _sent_any(false), _change(0), _bands(0)
+{
+}
+
+
+bool SpectrumGate::update(const float *spectrum, unsigned int bands, unsigned int hop_frames)
+{
+  _since_sent += hop_frames;
+
+  float db[MAX_BANDS];
+  float sum = 0;
+  for (unsigned int i = 0; i < bands; i++)
+  {
+    db[i] = spectrum[i] > 0 ? 20 * log10f(spectrum[i]) : SPECTRUM_GATE_FLOOR_DB;
+    if (db[i] < SPECTRUM_GATE_FLOOR_DB)
+    {
+      db[i] = SPECTRUM_GATE_FLOOR_DB;
+    }
+    if (bands == _bands)
+    {
+      float d = db[i] - _sent_db[i];
+      sum += d * d;
+    }
+  }
+  _change = bands > 0 ? sqrtf(sum / bands) : 0;
+
+  bool send;
+  if (!_sent_any || bands != _bands)
+  {
+    send = true;
+  }
+  else if (_max_interval > 0 && _since_sent >= _max_interval)
+  {
+    // Keepalive
+    send = true;
+  }
+  else if (_since_sent < _min_interval)
+  {
+    send = _change >= _threshold_db * SPECTRUM_GATE_TRANSIENT_FACTOR && _threshold_db > 0;
+  }
+  else
+  {
+    send = _change >= _threshold_db;
+  }
+
+  if (send)
+  {
+    for (unsigned int i = 0; i < bands; i++)
+    {
+      _sent_db[i] = db[i];
+    }
+    _bands = bands;
+    _sent_any = true;
+    _since_sent = 0;
+  }
+  return send;
+}
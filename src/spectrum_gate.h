@@ -0,0 +1,74 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _SPECTRUM_GATE_H
+#define _SPECTRUM_GATE_H
+
+#include "analysis_frame.h"
+
+#define SPECTRUM_GATE_DEFAULT_THRESHOLD_DB 1.0f
+#define SPECTRUM_GATE_DEFAULT_MIN_RATE 1.0f
+#define SPECTRUM_GATE_DEFAULT_MAX_RATE 60.0f
+
+// Bands are compared in dB with anything quieter than this counted as this,
+// so noise in silent bands never looks like a change
+#define SPECTRUM_GATE_FLOOR_DB -90.0f
+
+// A change this many times the threshold is a transient and is sent even
+// if it comes sooner than the maximum rate allows
+#define SPECTRUM_GATE_TRANSIENT_FACTOR 4
+
+
+// Decides which hops' spectra are worth sending.  A spectrum goes out when
+// its RMS difference in dB from the last one sent reaches the threshold,
+// but no more than max_rate times a second, except for transients, and at
+// least min_rate times a second as a keepalive, however steady the input.
+// A rate of 0 lifts that limit; a threshold of 0 sends every hop the
+// maximum rate allows.
+class SpectrumGate
+{
+public:
+  SpectrumGate(int samplerate, float threshold_db, float min_rate, float max_rate);
+
+  // Called for every hop, hop_frames after the previous one.  Returns true
+  // if this spectrum should be sent, and then compares later ones with it.
+  bool update(const float *spectrum, unsigned int bands, unsigned int hop_frames);
+
+  // RMS change in dB measured by the last update()
+  float change(void) const { return _change; }
+
+private:
+  float _threshold_db;
+  // Frames between sends: at least _min_interval, unless 0, and at most
+  // _max_interval, unless 0
+  unsigned int _min_interval;
+  unsigned int _max_interval;
+
+  unsigned int _since_sent;
+  bool _sent_any;
+  float _change;
+
+  unsigned int _bands;
+  float _sent_db[MAX_BANDS];
+};
+
+#endif
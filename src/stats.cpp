@@ -0,0 +1,180 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <stdio.h>
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QDebug>
+
+#include "stats.h"
+
+
+// Started before main(), so every thread reads the same, already running
+// timer
+static struct StatsClock
+{
+  StatsClock() { timer.start(); }
+  QElapsedTimer timer;
+} stats_clock;
+
+
+jack_time_t Stats::now(void)
+{
+  return stats_clock.timer.nsecsElapsed() / 1000;
+}
+
+
+Histogram::Histogram()
+{
+  for (int i = 0; i < STATS_BUCKETS; i++)
+  {
+    _taken[i] = 0;
+  }
+}
+
+
+void Histogram::add(jack_time_t usecs)
+{
+  int bucket = 0;
+  while (usecs >> bucket && bucket < STATS_BUCKETS - 1)
+  {
+    bucket++;
+  }
+  _counts[bucket].fetchAndAddRelaxed(1);
+
+  int value = usecs < 0x7fffffff ? (int)usecs : 0x7fffffff;
+  int max = _max;
+  while (value > max && !_max.testAndSetRelaxed(max, value))
+  {
+    max = _max;
+  }
+}
+
+
+int Histogram::take(int *counts)
+{
+  for (int i = 0; i < STATS_BUCKETS; i++)
+  {
+    int count = _counts[i];
+    counts[i] += count - _taken[i];
+    _taken[i] = count;
+  }
+  return _max.fetchAndStoreRelaxed(0);
+}
+
+
+jack_time_t Histogram::percentile(const int *counts, double fraction)
+{
+  int total = 0;
+  for (int i = 0; i < STATS_BUCKETS; i++)
+  {
+    total += counts[i];
+  }
+
+  int seen = 0;
+  for (int i = 0; i < STATS_BUCKETS; i++)
+  {
+    seen += counts[i];
+    if (seen > 0 && seen >= total * fraction)
+    {
+      return i == 0 ? 0 : ((jack_time_t)1 << i) - 1;
+    }
+  }
+  return 0;
+}
+
+
+Stats::Stats()
+    : _reported_hops(0), _reported_failures(0), _reported_dropped(0)
+{
+  _last_report = now();
+}
+
+
+// Clocks on different cores can disagree by a little; never count backwards
+static jack_time_t elapsed(jack_time_t from, jack_time_t to)
+{
+  return to > from ? to - from : 0;
+}
+
+
+void Stats::record(const AnalysisFrame& frame, bool sent)
+{
+  const jack_time_t *t = frame.stamps;
+
+  _stages[STAGE_QUEUE].add(elapsed(frame.captured, t[STAMP_START]));
+  _stages[STAGE_FFT].add(elapsed(t[STAMP_START], t[STAMP_FFT]));
+  _stages[STAGE_SPECTRUM].add(elapsed(t[STAMP_FFT], t[STAMP_SPECTRUM]));
+  _stages[STAGE_PITCH].add(elapsed(t[STAMP_SPECTRUM], t[STAMP_PITCH]));
+  _stages[STAGE_ONSET].add(elapsed(t[STAMP_PITCH], t[STAMP_ONSET]));
+  _stages[STAGE_TEMPO].add(elapsed(t[STAMP_ONSET], t[STAMP_TEMPO]));
+  _stages[STAGE_ENVELOPE].add(elapsed(t[STAMP_TEMPO], t[STAMP_ENVELOPE]));
+  _stages[STAGE_HANDOFF].add(elapsed(t[STAMP_ENVELOPE], t[STAMP_TAKEN]));
+  _stages[STAGE_SEND].add(elapsed(t[STAMP_TAKEN], t[STAMP_SENT]));
+  _stages[STAGE_TOTAL].add(elapsed(frame.captured, t[STAMP_SENT]));
+  if (frame.onset)
+  {
+    _stages[STAGE_ONSET_TOTAL].add(elapsed(frame.captured, t[STAMP_SENT]));
+  }
+
+  _hops.fetchAndAddRelaxed(1);
+  if (!sent)
+  {
+    _send_failures.fetchAndAddRelaxed(1);
+  }
+}
+
+
+void Stats::report(int dropped)
+{
+  static const char *names[NUM_STAGES] = {
+    "queue", "fft", "spectrum", "pitch", "onset", "tempo", "envelope", "handoff", "send",
+    "total", "onset-total"
+  };
+
+  jack_time_t time = now();
+  double seconds = elapsed(_last_report, time) / 1e6;
+  int hops = _hops;
+  int failures = _send_failures;
+
+  char line[1024];
+  int len = snprintf(line, sizeof(line),
+                     "%.0f hops/s, %d dropped, %d send failures; latency us p50/p99/max:",
+                     seconds > 0 ? (hops - _reported_hops) / seconds : 0.0,
+                     dropped - _reported_dropped, failures - _reported_failures);
+
+  for (int s = 0; s < NUM_STAGES && len < (int)sizeof(line); s++)
+  {
+    int counts[STATS_BUCKETS] = { 0 };
+    int max = _stages[s].take(counts);
+    len += snprintf(line + len, sizeof(line) - len, " %s %u/%u/%d", names[s],
+                    (unsigned int)Histogram::percentile(counts, 0.5),
+                    (unsigned int)Histogram::percentile(counts, 0.99), max);
+  }
+
+  qDebug("Stats: %s", line);
+
+  _reported_hops = hops;
+  _reported_failures = failures;
+  _reported_dropped = dropped;
+  _last_report = time;
+}
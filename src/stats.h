@@ -0,0 +1,109 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <QtCore/QAtomicInt>
+
+#include "analysis_frame.h"
+
+// Latency histogram buckets: bucket 0 counts 0 us, bucket n counts
+// 2^(n-1) .. 2^n - 1 us, and the last bucket everything from about 4 s up
+#define STATS_BUCKETS 24
+
+#define DEFAULT_STATS_INTERVAL 10
+
+
+// A lock-free latency histogram with power-of-two microsecond buckets.
+// Any thread may add(); a reader takes the counts since its last look with
+// take(), without stopping the writers.
+class Histogram
+{
+public:
+  Histogram();
+
+  void add(jack_time_t usecs);
+
+  // Adds the counts since the previous take() to counts[STATS_BUCKETS] and
+  // returns the largest value added since then
+  int take(int *counts);
+
+  // Upper bound of the bucket holding the given fraction of counts
+  static jack_time_t percentile(const int *counts, double fraction);
+
+private:
+  QAtomicInt _counts[STATS_BUCKETS];
+  int _taken[STATS_BUCKETS];
+  QAtomicInt _max;
+};
+
+
+// Per-stage latency of every hop sent, from the capture of its last sample
+// to its datagram leaving, plus counters, logged every few seconds.  It is
+// cheap enough to leave on: a handful of clock reads per hop, and one
+// relaxed atomic increment per stage.
+class Stats
+{
+public:
+  // Stages, each measured from the end of the previous one
+  enum Stage
+  {
+    STAGE_QUEUE,      // capture until analysis starts
+    STAGE_FFT,        // windowing and FFT
+    STAGE_SPECTRUM,   // band binning
+    STAGE_PITCH,
+    STAGE_ONSET,
+    STAGE_TEMPO,
+    STAGE_ENVELOPE,
+    STAGE_HANDOFF,    // waiting for the sender
+    STAGE_SEND,       // encoding and sending
+    STAGE_TOTAL,      // capture until sent
+    STAGE_ONSET_TOTAL,  // STAGE_TOTAL of hops with an onset only
+    NUM_STAGES
+  };
+
+  Stats();
+
+  // Monotonic clock all the stamps in an AnalysisFrame are taken from
+  static jack_time_t now(void);
+
+  // Records a frame once it has been sent (or failed to be)
+  void record(const AnalysisFrame& frame, bool sent);
+
+  // Logs the latencies and counts since the last report.  dropped is the
+  // running total of hops lost before they reached the sender.
+  void report(int dropped);
+
+private:
+  Histogram _stages[NUM_STAGES];
+  QAtomicInt _hops;
+  QAtomicInt _send_failures;
+
+  // Reporter's state
+  int _reported_hops;
+  int _reported_failures;
+  int _reported_dropped;
+  jack_time_t _last_report;
+};
+
+#endif
@@ -0,0 +1,252 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "stream_monitor.h"
+#include "networking.h"
+
+
+StreamMonitor::Counts::Counts()
+    : datagrams(0), bytes(0), malformed(0), frames(0), lost(0), late(0), legacy(0),
+      onsets(0), spectra(0), undecoded(0), gaps(0), gap_sum_us(0), gap_max_us(0),
+      jitter_us(0)
+{
+}
+
+
+static void add_counts(StreamMonitor::Counts *to, const StreamMonitor::Counts& from)
+{
+    to->datagrams += from.datagrams;
+    to->bytes += from.bytes;
+    to->malformed += from.malformed;
+    to->frames += from.frames;
+    to->lost += from.lost;
+    to->late += from.late;
+    to->legacy += from.legacy;
+    to->onsets += from.onsets;
+    to->spectra += from.spectra;
+    to->undecoded += from.undecoded;
+    to->gaps += from.gaps;
+    to->gap_sum_us += from.gap_sum_us;
+    if (from.gap_max_us > to->gap_max_us) {
+        to->gap_max_us = from.gap_max_us;
+    }
+}
+
+
+StreamMonitor::StreamMonitor(double speed)
+    : _speed(speed > 0 ? speed : 1)
+{
+    memset(_channels, 0, sizeof(_channels));
+}
+
+
+StreamMonitor::Kind StreamMonitor::receive(const char *buf, int len, qint64 arrival_us,
+                                           AnalysisFrame *frame)
+{
+    Counts counts;
+    Kind kind;
+    uint32_t sequence;
+
+    frame->onset = false;
+    frame->has_spectrum = false;
+    frame->has_pitch = false;
+    frame->has_tempo = false;
+    frame->has_envelope = false;
+    frame->has_load = false;
+    frame->has_chroma = false;
+    frame->has_mel = false;
+
+    counts.datagrams = 1;
+    counts.bytes = len;
+
+    if (len > 0 && (unsigned char)buf[0] == MSG_FRAME) {
+        kind = KIND_MALFORMED;
+        if (Networking::decode_frame(buf, len, &sequence, frame, &_decoder)) {
+            kind = KIND_FRAME;
+            counts.frames = 1;
+            if ((buf[3] & FRAME_FLAG_SPECTRUM) && !frame->has_spectrum) {
+                counts.undecoded = 1;
+            }
+        }
+    } else {
+        kind = decode_legacy(buf, len, frame);
+        counts.legacy = kind != KIND_MALFORMED;
+    }
+
+    if (kind == KIND_MALFORMED) {
+        counts.malformed = 1;
+    } else {
+        counts.onsets = frame->onset;
+        counts.spectra = frame->has_spectrum;
+    }
+
+    // Sequence numbers and timing
+    if (kind == KIND_FRAME) {
+        Channel& c = _channels[frame->channel];
+        int32_t ahead = (int32_t)(sequence - c.expected);
+
+        if (c.seen && ahead < 0 && ahead > -MONITOR_RESTART_GAP) {
+            counts.late = 1;
+        } else {
+            if (c.seen && ahead > 0) {
+                counts.lost = ahead;
+            } else if (c.seen && ahead < 0) {
+                // Restarted: its frame times start over too
+                c.timed = false;
+            }
+            c.expected = sequence + 1;
+            count_frame(frame->channel, frame->time, frame->samplerate, arrival_us, &counts);
+        }
+        c.seen = true;
+    } else if (kind == KIND_FFT) {
+        count_gap(frame->channel, arrival_us, &counts);
+    }
+
+    add_counts(&_total, counts);
+    add_counts(&_interval, counts);
+
+    double jitter = 0;
+    for (int c = 0; c < MAX_CHANNELS; c++) {
+        if (_channels[c].jitter_us > jitter) {
+            jitter = _channels[c].jitter_us;
+        }
+    }
+    _total.jitter_us = jitter;
+    _interval.jitter_us = jitter;
+
+    return kind;
+}
+
+
+// The legacy messages have no sequence numbers or times, only their
+// lengths to check
+StreamMonitor::Kind StreamMonitor::decode_legacy(const char *buf, int len,
+                                                 AnalysisFrame *frame)
+{
+    if (len < 2) {
+        return KIND_MALFORMED;
+    }
+
+    unsigned char type = (unsigned char)buf[0];
+    int channel = (unsigned char)buf[len - 1];
+    if (channel >= MAX_CHANNELS) {
+        return KIND_MALFORMED;
+    }
+    frame->channel = channel;
+    frame->time = 0;
+    frame->samplerate = 0;
+
+    if (type == MSG_ONSET && len == 2) {
+        frame->onset = true;
+        return KIND_ONSET;
+    }
+
+    if (type == MSG_PITCH && len == 2 + 2 * (int)sizeof(float)) {
+        memcpy(&frame->pitch, buf + 1, sizeof(float));
+        memcpy(&frame->confidence, buf + 1 + sizeof(float), sizeof(float));
+        frame->has_pitch = true;
+        return KIND_PITCH;
+    }
+
+    // The band count is little-endian, whatever the host's byte order
+    if (type == MSG_FFT && len >= 4) {
+        unsigned int bands = (unsigned char)buf[1] | ((unsigned char)buf[2] << 8);
+        if (bands > MAX_BANDS || len != 4 + (int)(bands * sizeof(float))) {
+            return KIND_MALFORMED;
+        }
+        memcpy(frame->spectrum, buf + 3, bands * sizeof(float));
+        frame->bands = bands;
+        frame->has_spectrum = true;
+        return KIND_FFT;
+    }
+
+    return KIND_MALFORMED;
+}
+
+
+void StreamMonitor::count_frame(int channel, jack_nframes_t time, int samplerate,
+                                qint64 arrival_us, Counts *counts)
+{
+    Channel& c = _channels[channel];
+
+    if (c.timed && samplerate > 0) {
+        // Frame times wrap, so only their differences count
+        c.media_us += (int32_t)(time - c.last_time) * 1e6 / samplerate / _speed;
+        double transit = arrival_us - c.media_us;
+        double d = transit - c.last_transit_us;
+        c.jitter_us += ((d < 0 ? -d : d) - c.jitter_us) * MONITOR_JITTER_GAIN;
+        c.last_transit_us = transit;
+    } else {
+        c.media_us = 0;
+        c.last_transit_us = arrival_us;
+        c.jitter_us = 0;
+        c.timed = samplerate > 0;
+    }
+    c.last_time = time;
+
+    count_gap(channel, arrival_us, counts);
+}
+
+
+void StreamMonitor::count_gap(int channel, qint64 arrival_us, Counts *counts)
+{
+    Channel& c = _channels[channel];
+
+    if (c.arrived) {
+        qint64 gap = arrival_us - c.last_arrival_us;
+        counts->gaps = 1;
+        counts->gap_sum_us = gap;
+        counts->gap_max_us = gap;
+    }
+    c.arrived = true;
+    c.last_arrival_us = arrival_us;
+}
+
+
+StreamMonitor::Counts StreamMonitor::take_interval(void)
+{
+    Counts interval = _interval;
+    _interval = Counts();
+    _interval.jitter_us = interval.jitter_us;
+    return interval;
+}
+
+
+int StreamMonitor::describe(char *buf, int size, const Counts& counts, double seconds)
+{
+    if (seconds <= 0) {
+        seconds = 1;
+    }
+    return snprintf(buf, size,
+                    "datagrams %ld (%.0f/s, %.1f kB/s) frames %ld lost %ld late %ld "
+                    "legacy %ld malformed %ld undecoded %ld onsets %ld spectra %ld "
+                    "gap us avg/max %.0f/%lld jitter us %.0f",
+                    counts.datagrams, counts.datagrams / seconds,
+                    counts.bytes / seconds / 1000, counts.frames, counts.lost, counts.late,
+                    counts.legacy, counts.malformed, counts.undecoded, counts.onsets,
+                    counts.spectra,
+                    counts.gaps > 0 ? (double)counts.gap_sum_us / counts.gaps : 0.0,
+                    (long long)counts.gap_max_us, counts.jitter_us);
+}
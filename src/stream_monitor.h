@@ -0,0 +1,129 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _STREAM_MONITOR_H
+#define _STREAM_MONITOR_H
+
+#include <stdint.h>
+
+#include <QtCore/QtGlobal>
+
+#include "analysis_frame.h"
+#include "spectrum_codec.h"
+
+// Weight of each frame in the interarrival jitter, as in RTP (RFC 3550)
+#define MONITOR_JITTER_GAIN (1.0 / 16)
+
+// A sequence number this far behind the expected one means the sender
+// restarted, rather than that the frame is late
+#define MONITOR_RESTART_GAP 1000
+
+
+// Decodes whatever Networking sends, legacy messages and v2 frames alike,
+// and keeps count of what arrived for receivers and test harnesses: loss and
+// reordering (from the v2 sequence numbers), malformed datagrams, the time
+// between frames on a channel, interarrival jitter, and bytes.
+//
+// Jitter is computed as in RTP, from how much each frame's transit time (its
+// arrival less its frame time) differs from the previous frame's on the
+// channel, smoothed.  Frames from two chains on one channel interleave and
+// add to it.
+class StreamMonitor
+{
+public:
+    enum Kind { KIND_MALFORMED, KIND_FRAME, KIND_FFT, KIND_ONSET, KIND_PITCH };
+
+    // Counters over some period, summed over the channels
+    struct Counts
+    {
+        Counts();
+
+        long datagrams;
+        qint64 bytes;
+        long malformed;
+        // v2 frames, and of those, ones lost (missing sequence numbers) and
+        // late (behind one already seen: reordered or duplicated)
+        long frames;
+        long lost;
+        long late;
+        // Legacy messages of any kind
+        long legacy;
+        long onsets;
+        long spectra;
+        // Spectra that couldn't be decoded, i.e. deltas after a loss
+        long undecoded;
+        // Time between consecutive frames (or legacy spectra) of a channel
+        long gaps;
+        qint64 gap_sum_us;
+        qint64 gap_max_us;
+        // Highest jitter of any channel at the end of the period
+        double jitter_us;
+    };
+
+    // Frames are expected at speed times real time; it only matters for the
+    // jitter
+    StreamMonitor(double speed = 1);
+
+    // Decodes a datagram that arrived at arrival_us (microseconds on any
+    // steady clock) into *frame, setting only what the message carries, and
+    // counts it.  Returns what it was; after a malformed datagram *frame
+    // holds nothing useful.
+    Kind receive(const char *buf, int len, qint64 arrival_us, AnalysisFrame *frame);
+
+    // Everything since the monitor was created
+    const Counts& total(void) const { return _total; }
+
+    // Everything since the last call, or since the monitor was created
+    Counts take_interval(void);
+
+    // Writes a one-line summary of counts covering seconds to buf
+    static int describe(char *buf, int size, const Counts& counts, double seconds);
+
+private:
+    // Bookkeeping for one channel
+    struct Channel
+    {
+        bool seen;
+        uint32_t expected;
+        bool arrived;
+        qint64 last_arrival_us;
+        bool timed;
+        jack_nframes_t last_time;
+        double media_us;
+        double last_transit_us;
+        double jitter_us;
+    };
+
+    Kind decode_legacy(const char *buf, int len, AnalysisFrame *frame);
+    void count_frame(int channel, jack_nframes_t time, int samplerate, qint64 arrival_us,
+                     Counts *counts);
+    void count_gap(int channel, qint64 arrival_us, Counts *counts);
+
+    double _speed;
+    SpectrumCodec _decoder;
+    Channel _channels[MAX_CHANNELS];
+
+    Counts _total;
+    Counts _interval;
+};
+
+#endif
@@ -0,0 +1,255 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <math.h>
+
+#include "tempo_tracker.h"
+
+// Resolution of the beat period, in hops
+#define TEMPO_LAG_STEP 0.25
+// Weight of each beat in the phase comb relative to the one after it
+#define TEMPO_PHASE_DECAY 0.8f
+// Half-width of the moving mean the detection function is thresholded
+// against
+#define TEMPO_THRESHOLD_SECONDS 0.1
+
+
+TempoTracker::TempoTracker(unsigned int hop_size, int samplerate)
+    : _hop_size(hop_size), _samplerate(samplerate), _hops(0),
+      _frames(0), _last_beat(0), _period(0), _confidence(0)
+{
+  double rate = (double)samplerate / hop_size;
+
+  _min_lag = (unsigned int)(rate * 60 / TEMPO_MAX_BPM);
+  if (_min_lag < 2)
+  {
+    _min_lag = 2;
+  }
+  _max_lag = (unsigned int)ceil(rate * 60 / TEMPO_MIN_BPM);
+  if (_max_lag < _min_lag)
+  {
+    _max_lag = _min_lag;
+  }
+
+  // update() looks at lags up to three times the longest beat, and one more
+  // for interpolation
+  _length = (unsigned int)ceil(TEMPO_HISTORY_SECONDS * rate);
+  if (_length < 3 * _max_lag + 3)
+  {
+    _length = 3 * _max_lag + 3;
+  }
+  _history = new float[_length];
+  _df = new float[_length];
+  _acf = new float[3 * _max_lag + 2];
+  _phase = new float[_max_lag + 1];
+  for (unsigned int i = 0; i < _length; i++)
+  {
+    _history[i] = 0;
+  }
+
+  _update_hops = (unsigned int)(TEMPO_UPDATE_SECONDS * rate + 0.5);
+  if (_update_hops < 1)
+  {
+    _update_hops = 1;
+  }
+}
+
+
+TempoTracker::~TempoTracker()
+{
+  delete[] _history;
+  delete[] _df;
+  delete[] _acf;
+  delete[] _phase;
+}
+
+
+void TempoTracker::process(float novelty)
+{
+  _history[_hops % _length] = novelty;
+  _hops++;
+  _frames += _hop_size;
+
+  if (_hops % _update_hops == 0)
+  {
+    update();
+  }
+}
+
+
+float TempoTracker::bpm(void) const
+{
+  return _period > 0 ? 60 * _samplerate / _period : 0;
+}
+
+
+float TempoTracker::phase(void) const
+{
+  if (_period <= 0)
+  {
+    return 0;
+  }
+  double beats = (_frames - _last_beat) / _period;
+  return beats - floor(beats);
+}
+
+
+double TempoTracker::beat_in(unsigned int n) const
+{
+  if (_period <= 0)
+  {
+    return 0;
+  }
+  double beats = floor((_frames - _last_beat) / _period) + 1;
+  return _last_beat + (beats + n) * _period - _frames;
+}
+
+
+// Autocorrelation at a fractional lag, interpolated
+float TempoTracker::acf_at(double lag) const
+{
+  unsigned int i = (unsigned int)lag;
+  float frac = lag - i;
+  return (1 - frac) * _acf[i] + frac * _acf[i + 1];
+}
+
+
+float TempoTracker::lag_score(double lag) const
+{
+  double bpm = 60.0 * _samplerate / (_hop_size * lag);
+  double octaves = log(bpm / TEMPO_PREFERRED_BPM) / log(2.0) / TEMPO_PREFERENCE_OCTAVES;
+  return exp(-0.5 * octaves * octaves)
+         * (acf_at(lag / 2) + acf_at(lag) + acf_at(2 * lag) + acf_at(3 * lag));
+}
+
+
+void TempoTracker::update(void)
+{
+  unsigned int n = _hops < _length ? _hops : _length;
+  unsigned int lags = 3 * _max_lag + 2;
+  if (n < lags + 1)
+  {
+    return;
+  }
+
+  // Oldest first, less the local mean, negative values dropped, so that only
+  // the peaks stand out
+  unsigned int oldest = _hops - n;
+  unsigned int half = (unsigned int)(TEMPO_THRESHOLD_SECONDS * _samplerate / _hop_size + 0.5);
+  if (half < 1)
+  {
+    half = 1;
+  }
+  double sum = 0;
+  unsigned int lo = 0, hi = 0;
+  for (unsigned int i = 0; i < n; i++)
+  {
+    while (hi < n && hi <= i + half)
+    {
+      sum += _history[(oldest + hi++) % _length];
+    }
+    while (lo + half < i)
+    {
+      sum -= _history[(oldest + lo++) % _length];
+    }
+    float value = _history[(oldest + i) % _length] - sum / (hi - lo);
+    _df[i] = value > 0 ? value : 0;
+  }
+
+  // Spread each peak over its neighbours, so that beats a fractional number
+  // of hops apart still line up in the autocorrelation
+  float previous = 0;
+  for (unsigned int i = 0; i < n; i++)
+  {
+    float next = i + 1 < n ? _df[i + 1] : 0;
+    float value = 0.25f * previous + 0.5f * _df[i] + 0.25f * next;
+    previous = _df[i];
+    _df[i] = value;
+  }
+
+  for (unsigned int lag = 0; lag < lags; lag++)
+  {
+    float acf = 0;
+    for (unsigned int i = lag; i < n; i++)
+    {
+      acf += _df[i] * _df[i - lag];
+    }
+    _acf[lag] = acf / (n - lag);
+  }
+
+  if (_acf[0] <= 0)
+  {
+    // Silence: keep the beat grid going
+    _confidence = 0;
+    return;
+  }
+
+  double period = _min_lag;
+  float best_score = lag_score(period);
+  for (double lag = _min_lag + TEMPO_LAG_STEP; lag <= _max_lag; lag += TEMPO_LAG_STEP)
+  {
+    float score = lag_score(lag);
+    if (score > best_score)
+    {
+      period = lag;
+      best_score = score;
+    }
+  }
+
+  _confidence = acf_at(period) / _acf[0];
+  if (_confidence > 1)
+  {
+    _confidence = 1;
+  }
+
+  // Phase: how many hops before the newest the last beat fell
+  unsigned int offsets = (unsigned int)ceil(period);
+  unsigned int best_offset = 0;
+  for (unsigned int offset = 0; offset < offsets; offset++)
+  {
+    float score = 0, weight = 1;
+    for (double at = offset; at < n - 0.5; at += period)
+    {
+      score += weight * _df[n - 1 - (unsigned int)(at + 0.5)];
+      weight *= TEMPO_PHASE_DECAY;
+    }
+    _phase[offset] = score;
+    if (score > _phase[best_offset])
+    {
+      best_offset = offset;
+    }
+  }
+
+  double offset = best_offset;
+  float before = _phase[(best_offset + offsets - 1) % offsets];
+  float after = _phase[(best_offset + 1) % offsets];
+  float denom = before - 2 * _phase[best_offset] + after;
+  if (denom < 0)
+  {
+    offset += 0.5 * (before - after) / denom;
+  }
+
+  // A beat shows up in the first hop whose window includes it, so on
+  // average half a hop before that hop ends
+  _period = period * _hop_size;
+  _last_beat = _frames - (offset + 0.5) * _hop_size;
+}
@@ -0,0 +1,104 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _TEMPO_TRACKER_H
+#define _TEMPO_TRACKER_H
+
+// Tempo range searched, in beats per minute
+#define TEMPO_MIN_BPM 60
+#define TEMPO_MAX_BPM 200
+// Tempo preferred when the detection function fits several, e.g. half and
+// double time, and how sharply (in octaves)
+#define TEMPO_PREFERRED_BPM 120
+#define TEMPO_PREFERENCE_OCTAVES 1.0
+// Detection function history analyzed, and how often the estimate is redone
+#define TEMPO_HISTORY_SECONDS 6
+#define TEMPO_UPDATE_SECONDS 0.5
+
+
+// Beat tracking on the onset detector's detection function, one value per
+// hop, so that receivers can schedule effects on upcoming beats instead of
+// reacting to onsets after the fact.
+//
+// Every TEMPO_UPDATE_SECONDS the history is thresholded against its local
+// mean.  The beat period is the lag, in steps of a quarter hop, at which the
+// history's autocorrelation is strongest -- together with half, twice and
+// three times that lag, so that the beat wins over other periodicities in a
+// bar and the off-beats count for it -- weighted towards
+// TEMPO_PREFERRED_BPM.  The phase is the offset at which a comb of that
+// period, weighted towards recent beats, collects the most of the detection
+// function.  Between updates the beat grid is extrapolated.
+class TempoTracker
+{
+public:
+  TempoTracker(unsigned int hop_size, int samplerate);
+  ~TempoTracker();
+
+  // Call once per hop with that hop's detection function value
+  // (OnsetDetector::novelty())
+  void process(float novelty);
+
+  // Tempo in BPM, 0 until there is enough history for an estimate
+  float bpm(void) const;
+  // How periodic the detection function is, 0 to 1; near 0 in silence,
+  // when the beat grid is just carried over from before
+  float confidence(void) const { return _confidence; }
+  // Position within the current beat at the end of the last hop: 0 on the
+  // beat, approaching 1 just before the next
+  float phase(void) const;
+  // Samples from the end of the last hop to upcoming beat n (0 = the next)
+  double beat_in(unsigned int n) const;
+
+private:
+  TempoTracker(const TempoTracker&);
+  TempoTracker& operator=(const TempoTracker&);
+
+  void update(void);
+  float acf_at(double lag) const;
+  float lag_score(double lag) const;
+
+  unsigned int _hop_size;
+  int _samplerate;
+
+  // Detection function history, a ring of _length hops
+  unsigned int _length;
+  float *_history;
+  unsigned int _hops;
+  unsigned int _update_hops;
+
+  // Scratch for update(): the thresholded history, oldest first, its
+  // autocorrelation, and the phase comb's output at each offset
+  float *_df;
+  float *_acf;
+  float *_phase;
+  unsigned int _min_lag;
+  unsigned int _max_lag;
+
+  // Samples seen, and the beat grid: the last beat's position and the
+  // period in samples, 0 until known
+  double _frames;
+  double _last_beat;
+  double _period;
+  float _confidence;
+};
+
+#endif
@@ -0,0 +1,115 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "worker_pool.h"
+
+
+WorkerPool::WorkerPool(unsigned int workers, const RealtimeConfig& realtime)
+    : _realtime(realtime), _num_jobs(0)
+{
+  if (workers < 1)
+  {
+    workers = 1;
+  }
+  _num_workers = workers < MAX_WORKERS ? workers : MAX_WORKERS;
+
+  for (unsigned int i = 0; i < _num_workers; i++)
+  {
+    _workers[i]._done = &_done;
+    _workers[i]._realtime = &_realtime;
+    _workers[i]._index = i;
+  }
+  for (unsigned int i = 1; i < _num_workers; i++)
+  {
+    if (_realtime.lock_memory)
+    {
+      _workers[i].setStackSize(RT_STACK_SIZE);
+    }
+    _workers[i].start();
+  }
+}
+
+
+WorkerPool::~WorkerPool()
+{
+  for (unsigned int i = 1; i < _num_workers; i++)
+  {
+    _workers[i]._quit = true;
+    _workers[i]._start.release();
+    _workers[i].wait();
+  }
+}
+
+
+void WorkerPool::add_job(Job *job)
+{
+  Worker& worker = _workers[_num_jobs++ % _num_workers];
+  if (worker._num_jobs < MAX_JOBS)
+  {
+    worker._jobs[worker._num_jobs++] = job;
+  }
+}
+
+
+void WorkerPool::run(void)
+{
+  unsigned int busy = 0;
+
+  for (unsigned int i = 1; i < _num_workers; i++)
+  {
+    if (_workers[i]._num_jobs > 0)
+    {
+      _workers[i]._start.release();
+      busy++;
+    }
+  }
+
+  _workers[0].run_jobs();
+
+  _done.acquire(busy);
+}
+
+
+void WorkerPool::Worker::run_jobs(void)
+{
+  for (unsigned int i = 0; i < _num_jobs; i++)
+  {
+    _jobs[i]->run();
+  }
+}
+
+
+void WorkerPool::Worker::run(void)
+{
+  Realtime::configure_thread(*_realtime, _index);
+
+  for (;;)
+  {
+    _start.acquire();
+    if (_quit)
+    {
+      break;
+    }
+    run_jobs();
+    _done->release();
+  }
+}
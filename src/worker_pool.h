@@ -0,0 +1,88 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _WORKER_POOL_H
+#define _WORKER_POOL_H
+
+#include <QtCore/QThread>
+#include <QtCore/QSemaphore>
+
+#include "realtime.h"
+
+#define MAX_WORKERS 16
+#define MAX_JOBS 64
+
+
+// Runs a fixed set of jobs in lock-step rounds on a fixed set of threads.
+//
+// Job n always runs on worker n % workers(), so per-job state stays on one
+// core.  Worker 0 is the thread calling run(); the rest are started by the
+// pool.  Nothing is allocated or queued per round: run() just releases each
+// worker's semaphore and waits for them all to report back.  Each worker
+// applies the RealtimeConfig to itself as it starts; the caller of run() is
+// left to do the same.
+class WorkerPool
+{
+public:
+  class Job
+  {
+  public:
+    virtual ~Job() {}
+    virtual void run(void) = 0;
+  };
+
+  WorkerPool(unsigned int workers, const RealtimeConfig& realtime);
+  ~WorkerPool();
+
+  void add_job(Job *job);
+  unsigned int workers(void) const { return _num_workers; }
+
+  // Runs every job once and returns when all of them have finished
+  void run(void);
+
+private:
+  class Worker : public QThread
+  {
+  public:
+    Worker(void) : _quit(false), _num_jobs(0) {}
+    void run_jobs(void);
+
+    const RealtimeConfig *_realtime;
+    unsigned int _index;
+    volatile bool _quit;
+    QSemaphore _start;
+    QSemaphore *_done;
+    Job *_jobs[MAX_JOBS];
+    unsigned int _num_jobs;
+
+  protected:
+    void run(void);
+  };
+
+  RealtimeConfig _realtime;
+  unsigned int _num_workers;
+  Worker _workers[MAX_WORKERS];
+  QSemaphore _done;
+  unsigned int _num_jobs;
+};
+
+#endif
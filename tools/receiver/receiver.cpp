@@ -0,0 +1,280 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Receives what firemix-audio-processor sends, in place of FireMix, and
+// reports on the stream.
+//
+//   firemix-receiver [options]
+//
+// It listens on the processor's default port, so a processor started with
+// no host sends to it; with --subscribe it subscribes to a processor's
+// --listen port instead.  Every message type is decoded, legacy and v2.  A
+// summary line is printed every second: datagrams and bytes per second,
+// frames lost (gaps in the v2 sequence numbers) and late, malformed
+// datagrams, the time between frames and the interarrival jitter (see
+// StreamMonitor).  --print also prints every message in the --output text
+// format.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QStringList>
+#include <QHostInfo>
+
+#include "networking.h"
+#include "frame_writer.h"
+#include "stream_monitor.h"
+
+// How long to wait for a datagram before checking the clock again
+#define RECEIVE_TIMEOUT_MS 100
+
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "\n"
+            "Options:\n"
+            "  --port N        UDP port to receive on (default %d)\n"
+            "  --subscribe HOST[:PORT]\n"
+            "                  subscribe to a processor started with --listen\n"
+            "                  (default port %d), renewing it until exit\n"
+            "  --streams S     streams to subscribe to, e.g. spectrum+onset\n"
+            "                  (default all)\n"
+            "  --spectrum-encoding E\n"
+            "                  float (default), log16 or log8 to subscribe with\n"
+            "  --delta         subscribe to delta-coded spectra\n"
+            "  --rate HZ       subscribe to at most HZ spectra per second\n"
+            "  --protocol P    v2 (default) or legacy, to subscribe with\n"
+            "  --speed X       frames are sent at X times real time, e.g. from\n"
+            "                  firemix-soak, which the jitter allows for\n"
+            "  --print         print every message, in the --output text format\n"
+            "  --interval S    seconds between summary lines (default 1)\n"
+            "  --duration S    exit after S seconds (default: run until killed)\n"
+            "  --strict        exit with an error if any frame was lost or late,\n"
+            "                  not only if a datagram was malformed\n",
+            argv0, TRANSMIT_PORT, SUBSCRIBE_PORT);
+}
+
+
+static bool resolve(const QString& host, QHostAddress *address)
+{
+    QHostInfo host_info = QHostInfo::fromName(host);
+    if (host_info.error() != QHostInfo::NoError || host_info.addresses().empty()) {
+        fprintf(stderr, "Could not resolve host: %s: %s\n", host.toUtf8().constData(),
+                host_info.errorString().toUtf8().constData());
+        return false;
+    }
+    *address = host_info.addresses().first();
+    return true;
+}
+
+
+static bool parse_streams(const char *spec, unsigned int *streams)
+{
+    static const struct {
+        const char *name;
+        unsigned int stream;
+    } names[] = {
+        { "spectrum", STREAM_SPECTRUM }, { "pitch", STREAM_PITCH },
+        { "onset", STREAM_ONSET }, { "envelope", STREAM_ENVELOPE },
+        { "tempo", STREAM_TEMPO }, { "chroma", STREAM_CHROMA }, { "mel", STREAM_MEL },
+    };
+    QStringList list = QString(spec).split("+");
+
+    *streams = 0;
+    for (int i = 0; i < list.size(); i++) {
+        unsigned int k = 0;
+        while (k < sizeof(names) / sizeof(names[0]) && list[i] != names[k].name) {
+            k++;
+        }
+        if (k == sizeof(names) / sizeof(names[0])) {
+            return false;
+        }
+        *streams |= names[k].stream;
+    }
+    return true;
+}
+
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    uint16_t port = TRANSMIT_PORT;
+    const char *subscribe_host = NULL;
+    Networking::Subscriber subscriber;
+    double speed = 1;
+    bool print = false;
+    double interval = 1;
+    qint64 duration_ms = 0;
+    bool strict = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--subscribe") == 0 && i + 1 < argc) {
+            subscribe_host = argv[++i];
+        } else if (strcmp(argv[i], "--streams") == 0 && i + 1 < argc) {
+            if (!parse_streams(argv[++i], &subscriber.streams)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--spectrum-encoding") == 0 && i + 1 < argc) {
+            if (!SpectrumCodec::parse_encoding(argv[++i], &subscriber.encoding)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--delta") == 0) {
+            subscriber.delta = true;
+        } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            subscriber.spectrum_rate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--protocol") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            if (strcmp(name, "legacy") == 0) {
+                subscriber.protocol = Networking::PROTOCOL_LEGACY;
+            } else if (strcmp(name, "v2") == 0) {
+                subscriber.protocol = Networking::PROTOCOL_V2;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            speed = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--print") == 0) {
+            print = true;
+        } else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            interval = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+            duration_ms = atof(argv[++i]) * 1000;
+        } else if (strcmp(argv[i], "--strict") == 0) {
+            strict = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (speed <= 0 || interval <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Replies to a subscription come back to the port it was sent from
+    QHostAddress subscribe_address;
+    uint16_t subscribe_port = SUBSCRIBE_PORT;
+    if (subscribe_host != NULL) {
+        QString name(subscribe_host);
+        int colon = name.indexOf(":");
+        if (colon >= 0) {
+            bool ok;
+            subscribe_port = name.mid(colon + 1).toUShort(&ok);
+            if (!ok) {
+                usage(argv[0]);
+                return 1;
+            }
+            name = name.left(colon);
+        }
+        if (!resolve(name, &subscribe_address)) {
+            return 1;
+        }
+    }
+    subscriber.port = 0;
+
+    QUdpSocket socket;
+    if (!socket.bind(QHostAddress::Any, port)) {
+        fprintf(stderr, "Could not bind to port %d: %s\n", port,
+                socket.errorString().toUtf8().constData());
+        return 1;
+    }
+
+    FrameWriter *writer = NULL;
+    if (print) {
+        writer = new FrameWriter("-");
+    }
+
+    StreamMonitor monitor(speed);
+    static char buf[MAX_DATAGRAM_SIZE];
+    static AnalysisFrame frame;
+    char line[512];
+
+    QElapsedTimer timer, summary, subscribed;
+    timer.start();
+    summary.start();
+    bool subscribe_due = subscribe_host != NULL;
+
+    while (duration_ms <= 0 || timer.elapsed() < duration_ms) {
+        if (subscribe_due) {
+            char message[SUBSCRIBE_SIZE];
+            int len = Networking::encode_subscribe(message, subscriber);
+            socket.writeDatagram(message, len, subscribe_address, subscribe_port);
+            subscribed.start();
+            subscribe_due = false;
+        }
+
+        if (socket.hasPendingDatagrams() || socket.waitForReadyRead(RECEIVE_TIMEOUT_MS)) {
+            while (socket.hasPendingDatagrams()) {
+                int len = socket.readDatagram(buf, sizeof(buf));
+                if (len < 0) {
+                    break;
+                }
+                StreamMonitor::Kind kind = monitor.receive(buf, len, timer.nsecsElapsed() / 1000,
+                                                           &frame);
+                if (writer != NULL && kind != StreamMonitor::KIND_MALFORMED) {
+                    writer->transmit_frame(&frame);
+                }
+            }
+        }
+
+        if (summary.elapsed() >= interval * 1000) {
+            StreamMonitor::describe(line, sizeof(line), monitor.take_interval(),
+                                    summary.nsecsElapsed() / 1e9);
+            fprintf(stderr, "%s\n", line);
+            summary.restart();
+        }
+
+        // Well inside the subscription timeout
+        if (subscribe_host != NULL && subscribed.elapsed() >= SUBSCRIPTION_TIMEOUT * 1000 / 3) {
+            subscribe_due = true;
+        }
+    }
+
+    if (subscribe_host != NULL) {
+        char message[SUBSCRIBE_SIZE];
+        subscriber.streams = 0;
+        int len = Networking::encode_subscribe(message, subscriber);
+        socket.writeDatagram(message, len, subscribe_address, subscribe_port);
+    }
+    delete writer;
+
+    const StreamMonitor::Counts& total = monitor.total();
+    StreamMonitor::describe(line, sizeof(line), total, timer.nsecsElapsed() / 1e9);
+    fprintf(stderr, "total: %s\n", line);
+
+    if (total.malformed > 0 || (strict && (total.lost > 0 || total.late > 0))) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,21 @@
+TEMPLATE = app
+CONFIG += qt release console
+CONFIG -= app_bundle
+TARGET = firemix-receiver
+QT += core network
+DEFINES += QT_DLL QT_NETWORK_LIB
+INCLUDEPATH += ../../src
+
+SOURCES +=  receiver.cpp \
+			../../src/stream_monitor.cpp \
+			../../src/frame_writer.cpp \
+			../../src/spectrum_codec.cpp \
+			../../src/networking.cpp
+
+HEADERS +=  ../../src/analysis_frame.h \
+			../../src/stream_monitor.h \
+			../../src/byte_order.h \
+			../../src/spectrum_codec.h \
+			../../src/frame_sink.h \
+			../../src/frame_writer.h \
+			../../src/networking.h
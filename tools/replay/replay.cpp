@@ -0,0 +1,221 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Replays a recording made with "firemix-audio-processor --record FILE"
+// through Networking, so FireMix can be driven without audio hardware.
+//
+//   firemix-replay [options] FILE [HOST[:PORT]]
+//
+// Frames go out with their original timing unless --fast is given, in
+// which case they are sent as fast as possible, for load testing.  The
+// recording is memory-mapped a window at a time, so it can be hours long.
+// A summary line is printed every second: frames sent, sends that failed,
+// and how far behind the recorded timing the replay is.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QHostInfo>
+
+#include "recording.h"
+#include "networking.h"
+
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options] FILE [HOST[:PORT]]\n"
+            "\n"
+            "Sends the frames recorded in FILE to HOST (default localhost),\n"
+            "port %d.\n"
+            "\n"
+            "Options:\n"
+            "  --fast          send as fast as possible instead of in real time\n"
+            "  --loop          start over at the end of the recording\n"
+            "  --protocol P    v2 (default) or legacy\n"
+            "  --spectrum-encoding E\n"
+            "                  float (default), log16 or log8\n"
+            "  --delta         delta-code log spectra\n"
+            "  --listen PORT   also accept subscribe messages on UDP port PORT\n",
+            argv0, TRANSMIT_PORT);
+}
+
+
+static bool resolve(const QString& host, QHostAddress *address)
+{
+    QHostInfo host_info = QHostInfo::fromName(host);
+    if (host_info.error() != QHostInfo::NoError || host_info.addresses().empty()) {
+        fprintf(stderr, "Could not resolve host: %s: %s\n", host.toUtf8().constData(),
+                host_info.errorString().toUtf8().constData());
+        return false;
+    }
+    *address = host_info.addresses().first();
+    return true;
+}
+
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    const char *path = NULL;
+    const char *host = NULL;
+    bool fast = false;
+    bool loop = false;
+    int listen_port = 0;
+    Networking::Subscriber subscriber;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--fast") == 0) {
+            fast = true;
+        } else if (strcmp(argv[i], "--loop") == 0) {
+            loop = true;
+        } else if (strcmp(argv[i], "--protocol") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            if (strcmp(name, "legacy") == 0) {
+                subscriber.protocol = Networking::PROTOCOL_LEGACY;
+            } else if (strcmp(name, "v2") == 0) {
+                subscriber.protocol = Networking::PROTOCOL_V2;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--spectrum-encoding") == 0 && i + 1 < argc) {
+            if (!SpectrumCodec::parse_encoding(argv[++i], &subscriber.encoding)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--delta") == 0) {
+            subscriber.delta = true;
+        } else if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc) {
+            listen_port = atoi(argv[++i]);
+        } else if (strncmp(argv[i], "--", 2) == 0 || host != NULL) {
+            usage(argv[0]);
+            return 1;
+        } else if (path == NULL) {
+            path = argv[i];
+        } else {
+            host = argv[i];
+        }
+    }
+
+    if (path == NULL) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (host != NULL) {
+        QString name(host);
+        int colon = name.indexOf(":");
+        if (colon >= 0) {
+            bool ok;
+            subscriber.port = name.mid(colon + 1).toUShort(&ok);
+            if (!ok) {
+                usage(argv[0]);
+                return 1;
+            }
+            name = name.left(colon);
+        }
+        if (!resolve(name, &subscriber.address)) {
+            return 1;
+        }
+    }
+
+    Recording recording(path);
+    if (!recording.is_open()) {
+        return 1;
+    }
+
+    Networking networking;
+    if (host != NULL || listen_port == 0) {
+        networking.add_subscriber(subscriber);
+    }
+    if (listen_port != 0 && !networking.listen(listen_port)) {
+        return 1;
+    }
+
+    static AnalysisFrame frame;
+    SpectrumCodec decoder;
+    const char *buf;
+    int len;
+    uint64_t usecs;
+    uint32_t sequence;
+    long frames = 0, failed = 0, corrupt = 0, total = 0;
+    qint64 behind_us = 0;
+
+    // Where the recording's clock starts, shifted on each loop
+    uint64_t start_us = 0, end_us = 0;
+
+    QElapsedTimer timer, second;
+    timer.start();
+    second.start();
+
+    for (;;) {
+        if (!recording.next(&buf, &len, &usecs)) {
+            if (!loop || total == 0) {
+                break;
+            }
+            recording.rewind();
+            start_us = end_us;
+            continue;
+        }
+        usecs += start_us;
+        end_us = usecs;
+
+        if (!fast) {
+            qint64 wait_us = (qint64)usecs - timer.nsecsElapsed() / 1000;
+            if (wait_us > 0) {
+                usleep(wait_us);
+            } else if (-wait_us > behind_us) {
+                behind_us = -wait_us;
+            }
+        }
+
+        if (!Networking::decode_frame(buf, len, &sequence, &frame, &decoder)) {
+            corrupt++;
+            continue;
+        }
+        if (!networking.transmit_frame(&frame)) {
+            failed++;
+        }
+        frames++;
+        total++;
+
+        if (second.elapsed() >= 1000) {
+            fprintf(stderr, "frames %ld failed %ld behind %lld ms\n",
+                    frames, failed, behind_us / 1000);
+            frames = 0;
+            behind_us = 0;
+            second.restart();
+        }
+    }
+
+    double seconds = timer.nsecsElapsed() / 1e9;
+    fprintf(stderr, "total: frames %ld in %.1f s (%.0f/s) failed %ld corrupt %ld\n",
+            total, seconds, seconds > 0 ? total / seconds : 0.0, failed, corrupt);
+
+    return 0;
+}
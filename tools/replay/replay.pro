@@ -0,0 +1,19 @@
+TEMPLATE = app
+CONFIG += qt release console
+CONFIG -= app_bundle
+TARGET = firemix-replay
+QT += core network
+DEFINES += QT_DLL QT_NETWORK_LIB
+INCLUDEPATH += ../../src
+
+SOURCES +=  replay.cpp \
+			../../src/recording.cpp \
+			../../src/spectrum_codec.cpp \
+			../../src/networking.cpp
+
+HEADERS +=  ../../src/analysis_frame.h \
+			../../src/recording.h \
+			../../src/byte_order.h \
+			../../src/spectrum_codec.h \
+			../../src/frame_sink.h \
+			../../src/networking.h
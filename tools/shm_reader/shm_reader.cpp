@@ -0,0 +1,232 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Reads analysis frames from the shared memory ring published by
+// "firemix-audio-processor --shm NAME", to demonstrate and check that
+// transport.
+//
+//   firemix-shm-reader [options] NAME
+//
+// By default it follows every frame and prints a summary line per second:
+// frames read, frames lost to overruns, gaps in the per-channel sequence
+// numbers and onsets.  --latest polls only the newest spectrum instead,
+// the way a renderer running at its own frame rate would.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <QtCore/QElapsedTimer>
+
+#include "shm_ring.h"
+#include "networking.h"
+#include "frame_writer.h"
+
+// How long to sleep when there is nothing new to read
+#define IDLE_USEC 200
+
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options] NAME\n"
+            "\n"
+            "Options:\n"
+            "  --print         print every frame, in the --output text format\n"
+            "  --latest HZ     poll the newest spectrum of each channel HZ times\n"
+            "                  a second instead of following every frame\n"
+            "  --duration S    exit after S seconds (default: run until killed)\n",
+            argv0);
+}
+
+
+// Reads every frame in order, resynchronizing when the writer has lapped us,
+// and prints each to writer if given
+static void follow(ShmRing& ring, FrameWriter *writer, qint64 duration_ms)
+{
+    static char buf[MAX_DATAGRAM_SIZE];
+    static AnalysisFrame frame;
+    uint32_t expected_sequence[MAX_CHANNELS];
+    bool seen[MAX_CHANNELS];
+    long frames = 0, lost = 0, gaps = 0, onsets = 0;
+
+    memset(seen, 0, sizeof(seen));
+
+    QElapsedTimer timer, second;
+    timer.start();
+    second.start();
+
+    uint32_t pos = ring.head();
+
+    while (duration_ms <= 0 || timer.elapsed() < duration_ms) {
+        uint32_t head = ring.head();
+        bool idle = (pos == head);
+
+        while (pos != head) {
+            int len;
+            ShmRing::ReadResult result = ring.read(pos, buf, &len);
+
+            if (result == ShmRing::READ_NOT_READY) {
+                break;
+            }
+            if (result == ShmRing::READ_OVERRUN) {
+                // Skip to half a ring behind the writer, so there is room to
+                // catch up before being lapped again
+                uint32_t resync = ring.head() - ring.slot_count() / 2;
+                lost += resync - pos;
+                pos = resync;
+                break;
+            }
+            pos++;
+
+            uint32_t sequence;
+            if (!Networking::decode_frame(buf, len, &sequence, &frame)
+                || frame.channel >= MAX_CHANNELS)
+            {
+                continue;
+            }
+
+            int c = frame.channel;
+            if (seen[c] && sequence != expected_sequence[c]) {
+                gaps++;
+            }
+            seen[c] = true;
+            expected_sequence[c] = sequence + 1;
+
+            frames++;
+            if (frame.onset) {
+                onsets++;
+            }
+            if (writer != NULL) {
+                writer->transmit_frame(&frame);
+            }
+        }
+
+        if (writer == NULL && second.elapsed() >= 1000) {
+            fprintf(stderr, "frames %ld lost %ld gaps %ld onsets %ld\n",
+                    frames, lost, gaps, onsets);
+            second.restart();
+        }
+
+        if (idle) {
+            usleep(IDLE_USEC);
+        }
+    }
+
+    fprintf(stderr, "total: frames %ld lost %ld gaps %ld onsets %ld\n",
+            frames, lost, gaps, onsets);
+}
+
+
+// Samples the newest spectrum of each channel at a fixed rate
+static void poll_latest(ShmRing& ring, double hz, qint64 duration_ms)
+{
+    static char buf[MAX_DATAGRAM_SIZE];
+    static AnalysisFrame frame;
+    long polls = 0, retries = 0;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    while (duration_ms <= 0 || timer.elapsed() < duration_ms) {
+        for (unsigned int c = 0; c < ring.channels() && c < MAX_CHANNELS; c++) {
+            uint32_t n, sequence;
+            int len;
+
+            // A lapped read just means a newer spectrum is available
+            for (;;) {
+                if (!ring.latest_spectrum(c, &n)) {
+                    break;
+                }
+                if (ring.read(n, buf, &len) == ShmRing::READ_OK) {
+                    if (Networking::decode_frame(buf, len, &sequence, &frame)) {
+                        unsigned int peak = 0;
+                        for (unsigned int i = 1; i < frame.bands; i++) {
+                            if (frame.spectrum[i] > frame.spectrum[peak]) {
+                                peak = i;
+                            }
+                        }
+                        printf("channel %u frame %u time %u bands %u peak band %u (%g)\n",
+                               c, sequence, frame.time, frame.bands, peak,
+                               frame.bands ? frame.spectrum[peak] : 0.0f);
+                    }
+                    break;
+                }
+                retries++;
+            }
+        }
+        fflush(stdout);
+        polls++;
+        usleep((useconds_t)(1e6 / hz));
+    }
+
+    fprintf(stderr, "total: polls %ld torn reads retried %ld\n", polls, retries);
+}
+
+
+int main(int argc, char** argv)
+{
+    const char *name = NULL;
+    bool print = false;
+    double latest_hz = 0;
+    qint64 duration_ms = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--print") == 0) {
+            print = true;
+        } else if (strcmp(argv[i], "--latest") == 0 && i + 1 < argc) {
+            latest_hz = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+            duration_ms = atof(argv[++i]) * 1000;
+        } else if (strncmp(argv[i], "--", 2) == 0 || name != NULL) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            name = argv[i];
+        }
+    }
+
+    if (name == NULL) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    ShmRing ring;
+    if (!ring.open(name)) {
+        return 1;
+    }
+    fprintf(stderr, "Reading %s: %u slots, %u channel(s)\n", name, ring.slot_count(), ring.channels());
+
+    if (latest_hz > 0) {
+        poll_latest(ring, latest_hz, duration_ms);
+    } else {
+        FrameWriter *writer = NULL;
+        if (print) {
+            writer = new FrameWriter("-");
+        }
+        follow(ring, writer, duration_ms);
+        delete writer;
+    }
+
+    return 0;
+}
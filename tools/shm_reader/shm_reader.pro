@@ -0,0 +1,25 @@
+TEMPLATE = app
+CONFIG += qt release console
+CONFIG -= app_bundle
+TARGET = firemix-shm-reader
+QT += core network
+DEFINES += QT_DLL QT_NETWORK_LIB
+INCLUDEPATH += ../../src
+
+SOURCES +=  shm_reader.cpp \
+			../../src/shm_ring.cpp \
+			../../src/frame_writer.cpp \
+			../../src/spectrum_codec.cpp \
+			../../src/networking.cpp
+
+HEADERS +=  ../../src/analysis_frame.h \
+			../../src/shm_ring.h \
+			../../src/byte_order.h \
+			../../src/spectrum_codec.h \
+			../../src/frame_sink.h \
+			../../src/frame_writer.h \
+			../../src/networking.h
+
+unix:!macx {
+    LIBS += -lrt
+}
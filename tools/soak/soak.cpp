@@ -0,0 +1,532 @@
+// FireMix-Audio-Processor
+// Copyright (c) 2013 Jon Evans
+// http://craftyjon.com/projects/openlights/firemix
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Soak test for firemix-audio-processor: runs it for a long time on audio
+// fed faster than real time and checks that it holds up.
+//
+//   firemix-soak [options] [-- processor options]
+//
+// The processor reads raw audio from a pipe, either a synthetic signal (a
+// kick on every beat, a chord changing every bar and a little noise) or a
+// WAV file looped, written at --speed times real time.  It runs with
+// --drop-frames, so like live input it drops hops rather than waiting when
+// its sender falls behind.  It sends its frames
+// to a StreamMonitor here, and logs its stats every --stats seconds.  The
+// run passes if, until the end:
+//
+//   - no frame was lost, late or malformed on the way, and the processor
+//     dropped no hops for want of a free frame;
+//   - the p99 latency from reading a chunk to sending its frames stayed
+//     under --max-latency in every stats period;
+//   - the processor's resident memory never grew by more than --max-growth
+//     over what it was after the first --warmup seconds;
+//   - the processor kept up with the audio, and exited cleanly when its
+//     input ended.
+//
+// A summary line is printed every --interval seconds and a verdict at the
+// end; the exit status is 0 only if the run passed.  Memory is read from
+// /proc, so this runs on Linux only.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QProcess>
+#include <QtCore/QStringList>
+
+#include "networking.h"
+#include "file_source.h"
+#include "stream_monitor.h"
+
+#define SOAK_DEFAULT_PROCESSOR "firemix-audio-processor"
+#define SOAK_DEFAULT_SPEED 4
+#define SOAK_DEFAULT_DURATION 3600
+#define SOAK_DEFAULT_SAMPLERATE 48000
+#define SOAK_DEFAULT_WARMUP 60
+#define SOAK_DEFAULT_MAX_GROWTH_KB 2048
+#define SOAK_DEFAULT_MAX_LATENCY_MS 20
+#define SOAK_DEFAULT_STATS 10
+#define SOAK_DEFAULT_INTERVAL 60
+
+// Frames written to the processor at a time
+#define SOAK_CHUNK_FRAMES 256
+// Most bytes left waiting for the pipe before the processor counts as
+// falling behind, and how far behind the audio it may then fall
+#define SOAK_MAX_BACKLOG (256 * 1024)
+#define SOAK_MAX_BEHIND_SECONDS 1.0
+// How long to wait for datagrams between feeding, and for the processor to
+// finish once its input ends
+#define SOAK_POLL_MS 1
+#define SOAK_EXIT_TIMEOUT_MS 30000
+
+// The synthetic signal
+#define SOAK_BPM 120
+#define SOAK_NOISE_LEVEL 0.02f
+
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options] [-- processor options]\n"
+            "\n"
+            "Options:\n"
+            "  --processor PATH\n"
+            "                  the processor to test (default %s)\n"
+            "  --input FILE    loop this WAV file instead of the synthetic signal\n"
+            "  --channels N    synthetic channels (default 1); a file's own\n"
+            "                  channels are kept apart\n"
+            "  --samplerate HZ synthetic sample rate (default %d)\n"
+            "  --speed X       feed audio at X times real time (default %d)\n"
+            "  --duration S    run for S seconds (default %d)\n"
+            "  --warmup S      take the memory baseline after S seconds\n"
+            "                  (default %d)\n"
+            "  --max-growth KB most the resident memory may grow after warm-up\n"
+            "                  (default %d)\n"
+            "  --max-latency MS\n"
+            "                  most the p99 read-to-send latency may reach\n"
+            "                  (default %d)\n"
+            "  --stats S       processor stats period (default %d)\n"
+            "  --interval S    seconds between summary lines (default %d)\n",
+            argv0, SOAK_DEFAULT_PROCESSOR, SOAK_DEFAULT_SAMPLERATE, SOAK_DEFAULT_SPEED,
+            SOAK_DEFAULT_DURATION, SOAK_DEFAULT_WARMUP, SOAK_DEFAULT_MAX_GROWTH_KB,
+            SOAK_DEFAULT_MAX_LATENCY_MS, SOAK_DEFAULT_STATS, SOAK_DEFAULT_INTERVAL);
+}
+
+
+// Deterministic, so that runs can be compared: a decaying 60 Hz kick on
+// every beat, a triad changing every bar (quieter on each further channel)
+// and white noise
+static void synthesize(float *out, unsigned int frames, unsigned int channels,
+                       int samplerate, qint64 position, uint32_t *noise)
+{
+    static const struct {
+        double root;
+        int third;
+    } chords[] = { { 220.0, 3 }, { 174.61, 4 }, { 261.63, 4 }, { 196.0, 4 } };
+    const int num_chords = sizeof(chords) / sizeof(chords[0]);
+    qint64 beat = (qint64)samplerate * 60 / SOAK_BPM;
+
+    for (unsigned int i = 0; i < frames; i++) {
+        qint64 n = position + i;
+        double t = (double)n / samplerate;
+        double since_beat = (double)(n % beat) / samplerate;
+        double kick = 0.8 * exp(-since_beat / 0.05) * sin(2 * M_PI * 60 * since_beat);
+
+        int chord = (int)(n / (4 * beat) % num_chords);
+        double root = chords[chord].root;
+        double harmony = 0.1 * (sin(2 * M_PI * root * t)
+                                + sin(2 * M_PI * root * pow(2, chords[chord].third / 12.0) * t)
+                                + sin(2 * M_PI * root * pow(2, 7 / 12.0) * t));
+
+        for (unsigned int c = 0; c < channels; c++) {
+            *noise = *noise * 1664525 + 1013904223;
+            float white = (*noise >> 8) / (float)(1 << 24) * 2 - 1;
+            *out++ = kick + harmony / (1 + c) + SOAK_NOISE_LEVEL * white;
+        }
+    }
+}
+
+
+// Resident memory of a process in kB, or -1 if it can't be read
+static long resident_kb(Q_PID pid)
+{
+    char path[64], line[256];
+    long kb = -1;
+
+    snprintf(path, sizeof(path), "/proc/%ld/status", (long)pid);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "VmRSS: %ld kB", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+
+// What the processor's "Stats:" lines have said so far
+struct ProcessorStats
+{
+    ProcessorStats() : reports(0), dropped(0), send_failures(0), worst_p99_us(0),
+                       worst_max_us(0), over_latency(0) {}
+
+    int reports;
+    long dropped;
+    long send_failures;
+    unsigned int worst_p99_us;
+    unsigned int worst_max_us;
+    // Periods whose p99 total latency was over the limit
+    int over_latency;
+};
+
+
+static void parse_stats(const char *line, unsigned int max_latency_us, ProcessorStats *stats)
+{
+    const char *counts = strstr(line, "hops/s, ");
+    const char *total = strstr(line, " total ");
+    int dropped, failures;
+    unsigned int p50, p99, max;
+
+    if (counts == NULL || total == NULL
+        || sscanf(counts, "hops/s, %d dropped, %d send failures", &dropped, &failures) != 2
+        || sscanf(total, " total %u/%u/%u", &p50, &p99, &max) != 3)
+    {
+        return;
+    }
+
+    stats->reports++;
+    stats->dropped += dropped;
+    stats->send_failures += failures;
+    if (p99 > stats->worst_p99_us) {
+        stats->worst_p99_us = p99;
+    }
+    if (max > stats->worst_max_us) {
+        stats->worst_max_us = max;
+    }
+    if (p99 > max_latency_us) {
+        stats->over_latency++;
+    }
+}
+
+
+// Passes on the processor's log, picking out its stats
+static void read_log(QProcess& process, unsigned int max_latency_us, ProcessorStats *stats)
+{
+    char line[2048];
+
+    process.waitForReadyRead(0);
+    while (process.canReadLine()) {
+        qint64 len = process.readLine(line, sizeof(line));
+        if (len <= 0) {
+            break;
+        }
+        if (line[len - 1] == '\n') {
+            line[len - 1] = 0;
+        }
+        fprintf(stderr, "processor: %s\n", line);
+        parse_stats(line, max_latency_us, stats);
+    }
+}
+
+
+static void receive(QUdpSocket& socket, StreamMonitor& monitor, const QElapsedTimer& timer)
+{
+    static char buf[MAX_DATAGRAM_SIZE];
+    static AnalysisFrame frame;
+
+    while (socket.hasPendingDatagrams()) {
+        int len = socket.readDatagram(buf, sizeof(buf));
+        if (len < 0) {
+            break;
+        }
+        monitor.receive(buf, len, timer.nsecsElapsed() / 1000, &frame);
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    const char *processor = SOAK_DEFAULT_PROCESSOR;
+    const char *input_path = NULL;
+    unsigned int channels = 1;
+    int samplerate = SOAK_DEFAULT_SAMPLERATE;
+    double speed = SOAK_DEFAULT_SPEED;
+    double duration = SOAK_DEFAULT_DURATION;
+    double warmup = SOAK_DEFAULT_WARMUP;
+    long max_growth_kb = SOAK_DEFAULT_MAX_GROWTH_KB;
+    double max_latency_ms = SOAK_DEFAULT_MAX_LATENCY_MS;
+    int stats_interval = SOAK_DEFAULT_STATS;
+    double interval = SOAK_DEFAULT_INTERVAL;
+    QStringList extra;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--processor") == 0 && i + 1 < argc) {
+            processor = argv[++i];
+        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            input_path = argv[++i];
+        } else if (strcmp(argv[i], "--channels") == 0 && i + 1 < argc) {
+            channels = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--samplerate") == 0 && i + 1 < argc) {
+            samplerate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            speed = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+            duration = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            warmup = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--max-growth") == 0 && i + 1 < argc) {
+            max_growth_kb = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--max-latency") == 0 && i + 1 < argc) {
+            max_latency_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            stats_interval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            interval = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--") == 0) {
+            while (++i < argc) {
+                extra << argv[i];
+            }
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (speed <= 0 || duration <= 0 || interval <= 0 || stats_interval <= 0
+        || channels < 1 || channels > MAX_CHANNELS || samplerate <= 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FileSource *file = NULL;
+    if (input_path != NULL) {
+        file = new FileSource(input_path, 0, true);
+        if (!file->is_open()) {
+            delete file;
+            return 1;
+        }
+        channels = file->channels();
+        samplerate = file->samplerate();
+    }
+
+    // Any free port will do; the processor is told which
+    QUdpSocket socket;
+    if (!socket.bind(QHostAddress(QHostAddress::LocalHost), 0)) {
+        fprintf(stderr, "Could not bind a UDP port: %s\n",
+                socket.errorString().toUtf8().constData());
+        delete file;
+        return 1;
+    }
+
+    char number[32];
+    QStringList args;
+    snprintf(number, sizeof(number), "%d", samplerate);
+    // Dropping frames as it would for live input, so that a sender falling
+    // behind shows up instead of holding the analysis back
+    args << "--input" << "-" << "--raw" << number << "--drop-frames";
+    snprintf(number, sizeof(number), "%u", channels);
+    args << "--channels" << number;
+    snprintf(number, sizeof(number), "%d", stats_interval);
+    args << "--stats" << number;
+    for (int i = 0; i < extra.size(); i++) {
+        args << extra[i];
+    }
+    snprintf(number, sizeof(number), "127.0.0.1:%u", socket.localPort());
+    args << number;
+
+    QProcess process;
+    process.setStandardOutputFile("/dev/null");
+    process.setReadChannel(QProcess::StandardError);
+    process.start(processor, args);
+    if (!process.waitForStarted()) {
+        fprintf(stderr, "Could not start %s: %s\n", processor,
+                process.errorString().toUtf8().constData());
+        delete file;
+        return 1;
+    }
+
+    StreamMonitor monitor(speed);
+    ProcessorStats stats;
+    unsigned int max_latency_us = (unsigned int)(max_latency_ms * 1000);
+    static float samples[SOAK_CHUNK_FRAMES * MAX_CHANNELS];
+    static sample_t file_samples[MAX_CHANNELS][SOAK_CHUNK_FRAMES];
+    sample_t *file_bufs[MAX_CHANNELS];
+    for (unsigned int c = 0; c < MAX_CHANNELS; c++) {
+        file_bufs[c] = file_samples[c];
+    }
+    uint32_t noise = 1;
+    qint64 fed = 0;
+    // Where the file was last rewound, to notice one with no audio
+    qint64 looped_at = -1;
+    double worst_behind = 0;
+    long baseline_kb = -1, peak_kb = -1, last_kb = -1;
+    bool exited_early = false;
+    char line[512];
+
+    QElapsedTimer timer, summary, memory;
+    timer.start();
+    summary.start();
+    memory.start();
+
+    while (timer.elapsed() < duration * 1000) {
+        // Feed whatever audio is due, unless the pipe is backing up
+        double seconds = timer.nsecsElapsed() / 1e9;
+        qint64 due = (qint64)(seconds * speed * samplerate);
+        while (fed < due && process.bytesToWrite() < SOAK_MAX_BACKLOG) {
+            unsigned int n = SOAK_CHUNK_FRAMES;
+            if (file != NULL) {
+                jack_nframes_t time;
+                int got = file->read(file_bufs, n, &time);
+                if (got <= 0 && looped_at < fed) {
+                    delete file;
+                    file = new FileSource(input_path, 0, true);
+                    looped_at = fed;
+                    continue;
+                }
+                if (got <= 0) {
+                    fprintf(stderr, "Could not read any audio from %s\n", input_path);
+                    break;
+                }
+                n = got;
+                for (unsigned int i = 0; i < n; i++) {
+                    for (unsigned int c = 0; c < channels; c++) {
+                        samples[i * channels + c] = file_bufs[c][i];
+                    }
+                }
+            } else {
+                synthesize(samples, n, channels, samplerate, fed, &noise);
+            }
+            process.write((const char *)samples, n * channels * sizeof(float));
+            fed += n;
+        }
+        process.waitForBytesWritten(0);
+
+        double behind = (double)(due - fed) / samplerate;
+        if (behind > worst_behind) {
+            worst_behind = behind;
+        }
+
+        read_log(process, max_latency_us, &stats);
+        if (process.state() == QProcess::NotRunning) {
+            exited_early = true;
+            break;
+        }
+
+        if (memory.elapsed() >= 1000) {
+            last_kb = resident_kb(process.pid());
+            if (baseline_kb < 0 && seconds >= warmup) {
+                baseline_kb = last_kb;
+            }
+            if (baseline_kb >= 0 && last_kb > peak_kb) {
+                peak_kb = last_kb;
+            }
+            memory.restart();
+        }
+
+        if (summary.elapsed() >= interval * 1000) {
+            StreamMonitor::describe(line, sizeof(line), monitor.take_interval(),
+                                    summary.nsecsElapsed() / 1e9);
+            fprintf(stderr, "soak: %.0f s, audio %.0f s, behind %.2f s, rss %ld kB: %s\n",
+                    seconds, (double)fed / samplerate, behind, last_kb, line);
+            summary.restart();
+        }
+
+        if (socket.hasPendingDatagrams() || socket.waitForReadyRead(SOAK_POLL_MS)) {
+            receive(socket, monitor, timer);
+        }
+    }
+
+    // Let the processor finish what it has, then collect the last frames
+    double seconds = timer.nsecsElapsed() / 1e9;
+    process.closeWriteChannel();
+    QElapsedTimer finishing;
+    finishing.start();
+    while (process.state() != QProcess::NotRunning
+           && finishing.elapsed() < SOAK_EXIT_TIMEOUT_MS)
+    {
+        process.waitForFinished(SOAK_POLL_MS);
+        read_log(process, max_latency_us, &stats);
+        receive(socket, monitor, timer);
+    }
+    bool finished = process.state() == QProcess::NotRunning;
+    if (!finished) {
+        process.kill();
+        process.waitForFinished();
+    }
+    read_log(process, max_latency_us, &stats);
+    socket.waitForReadyRead(SOAK_POLL_MS);
+    receive(socket, monitor, timer);
+    delete file;
+
+    const StreamMonitor::Counts& total = monitor.total();
+    StreamMonitor::describe(line, sizeof(line), total, seconds);
+    fprintf(stderr, "total: %s\n", line);
+    fprintf(stderr, "total: audio %.0f s in %.0f s (%.1fx real time), most behind %.2f s, "
+            "rss %ld kB after warm-up, %ld kB at peak, %ld kB at end, processor dropped %ld, "
+            "send failures %ld, p99/max latency %u/%u us\n",
+            (double)fed / samplerate, seconds, (double)fed / samplerate / seconds,
+            worst_behind, baseline_kb, peak_kb, last_kb, stats.dropped, stats.send_failures,
+            stats.worst_p99_us, stats.worst_max_us);
+
+    // Everything that went wrong, not just the first thing
+    int failures = 0;
+    if (exited_early || !finished || process.exitStatus() != QProcess::NormalExit
+        || process.exitCode() != 0)
+    {
+        fprintf(stderr, "FAIL: processor %s\n", exited_early ? "exited early"
+                : !finished ? "didn't exit at the end of its input" : "exited with an error");
+        failures++;
+    }
+    if (total.lost > 0 || total.late > 0 || total.malformed > 0 || total.undecoded > 0) {
+        fprintf(stderr, "FAIL: %ld frames lost, %ld late, %ld malformed, %ld undecoded\n",
+                total.lost, total.late, total.malformed, total.undecoded);
+        failures++;
+    }
+    if (total.frames == 0) {
+        fprintf(stderr, "FAIL: no frames received\n");
+        failures++;
+    }
+    if (stats.reports == 0) {
+        fprintf(stderr, "FAIL: the processor logged no stats\n");
+        failures++;
+    }
+    if (stats.dropped > 0 || stats.send_failures > 0) {
+        fprintf(stderr, "FAIL: processor dropped %ld hops and failed %ld sends\n",
+                stats.dropped, stats.send_failures);
+        failures++;
+    }
+    if (stats.over_latency > 0) {
+        fprintf(stderr, "FAIL: p99 latency over %.0f ms in %d of %d stats periods "
+                "(worst %.1f ms)\n", max_latency_ms, stats.over_latency, stats.reports,
+                stats.worst_p99_us / 1000.0);
+        failures++;
+    }
+    if (worst_behind > SOAK_MAX_BEHIND_SECONDS) {
+        fprintf(stderr, "FAIL: the processor fell %.1f s behind the audio\n", worst_behind);
+        failures++;
+    }
+    if (baseline_kb < 0) {
+        fprintf(stderr, "FAIL: no memory baseline; run for longer than the warm-up\n");
+        failures++;
+    } else if (peak_kb - baseline_kb > max_growth_kb) {
+        // Even if it was given back later
+        fprintf(stderr, "FAIL: resident memory grew by %ld kB after warm-up, "
+                "%ld kB by the end\n", peak_kb - baseline_kb, last_kb - baseline_kb);
+        failures++;
+    }
+
+    if (failures > 0) {
+        return 1;
+    }
+    fprintf(stderr, "PASS\n");
+    return 0;
+}
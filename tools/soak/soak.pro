@@ -0,0 +1,24 @@
+TEMPLATE = app
+CONFIG += qt release console
+CONFIG -= app_bundle
+TARGET = firemix-soak
+QT += core network
+DEFINES += QT_DLL QT_NETWORK_LIB
+INCLUDEPATH += ../../src
+
+SOURCES +=  soak.cpp \
+			../../src/stream_monitor.cpp \
+			../../src/file_source.cpp \
+			../../src/stats.cpp \
+			../../src/spectrum_codec.cpp \
+			../../src/networking.cpp
+
+HEADERS +=  ../../src/analysis_frame.h \
+			../../src/audio_source.h \
+			../../src/file_source.h \
+			../../src/stats.h \
+			../../src/stream_monitor.h \
+			../../src/byte_order.h \
+			../../src/spectrum_codec.h \
+			../../src/frame_sink.h \
+			../../src/networking.h